@@ -0,0 +1,211 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Direct digital synthesis waveform generator on the timer2 PWM
+ * output.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef DDS_GEN_H
+#define DDS_GEN_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include "timer_utils.c"
+
+/* USE NOTES:
+ * 1.)	The generator takes ownership of timer2 and its overflow
+ *		interrupt (TIMER2_OVF_vect).  It cannot be used together
+ *		with anything else that needs timer2, such as an RTC or
+ *		the power-save mode of idle_utils.h.
+ * 2.)	Timer2 runs fast PWM with no prescaler, so one sample is
+ *		output every 256 CPU cycles (31.25kHz at 8MHz) on the OC2
+ *		pin, PD7 on atmega32.  Put an RC low pass filter on the
+ *		pin for an analog signal; a few kHz corner works for tones.
+ * 3.)	A 32-bit phase accumulator advances by the tuning word
+ *		every sample and its top byte indexes a 256 entry table.
+ *		The frequency step is F_CPU / 2^40, about 7uHz at 8MHz.
+ *		Useful output stops well below half the sample rate.
+ * 4.)	The overflow ISR is hand written assembly that only uses
+ *		r30/r31.  It takes 34 cycles of work plus 18 cycles to save
+ *		and restore registers, 52 cycles from vector jump to reti
+ *		(59 with the interrupt response), about 20% of the CPU at
+ *		one interrupt per 256 cycles.  Other ISRs are delayed by
+ *		at most those 59 cycles.
+ * 5.)	Wavetables are 256 bytes in program memory aligned to a
+ *		256 byte boundary, so the ISR can index them with the
+ *		phase byte alone.  Declare your own with DDS_WAVETABLE and
+ *		pass it to dds_setWave.  Flash must be below 64KB.
+ */
+
+// Declare a user wavetable: DDS_WAVETABLE(myWave) = { ...256 values... };
+#define DDS_WAVETABLE(name) const unsigned char name[256] PROGMEM __attribute__((aligned(256)))
+
+//**************************USER AREA***************************
+
+/** Start timer2 and the generator.
+ *  @param wave		Wavetable, ie. dds_sine, dds_square, dds_saw or a DDS_WAVETABLE
+ *  @param mHz		Output frequency in milli-Hz
+ */
+void dds_start(const unsigned char *wave, unsigned long mHz);
+
+/** Stop the generator and drive the OC2 pin low.
+ */
+void dds_stop();
+
+/** Switch the wavetable without a phase jump.
+ *  @param wave		Wavetable in program memory, 256 byte aligned
+ */
+void dds_setWave(const unsigned char *wave);
+
+/** Change the output frequency without a phase jump.
+ *  @param mHz		Output frequency in milli-Hz
+ */
+void dds_setFrequency(unsigned long mHz);
+
+/** Set the raw phase increment per sample.
+ *  @param tuning	Frequency = tuning * F_CPU / 2^40
+ */
+void dds_setTuningWord(unsigned long tuning);
+
+//****************************END USER AREA**************************************
+
+#define DDS_RAMP16(b) (b), (b) + 1, (b) + 2, (b) + 3, (b) + 4, (b) + 5, (b) + 6, (b) + 7, \
+	(b) + 8, (b) + 9, (b) + 10, (b) + 11, (b) + 12, (b) + 13, (b) + 14, (b) + 15
+#define DDS_FILL16(b) (b), (b), (b), (b), (b), (b), (b), (b), (b), (b), (b), (b), (b), (b), (b), (b)
+
+DDS_WAVETABLE(dds_sine) = {
+	0x80, 0x83, 0x86, 0x89, 0x8C, 0x8F, 0x92, 0x95, 0x98, 0x9B, 0x9E, 0xA2, 0xA5, 0xA7, 0xAA, 0xAD,
+	0xB0, 0xB3, 0xB6, 0xB9, 0xBC, 0xBE, 0xC1, 0xC4, 0xC6, 0xC9, 0xCB, 0xCE, 0xD0, 0xD3, 0xD5, 0xD7,
+	0xDA, 0xDC, 0xDE, 0xE0, 0xE2, 0xE4, 0xE6, 0xE8, 0xEA, 0xEB, 0xED, 0xEE, 0xF0, 0xF1, 0xF3, 0xF4,
+	0xF5, 0xF6, 0xF8, 0xF9, 0xFA, 0xFA, 0xFB, 0xFC, 0xFD, 0xFD, 0xFE, 0xFE, 0xFE, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFE, 0xFE, 0xFE, 0xFD, 0xFD, 0xFC, 0xFB, 0xFA, 0xFA, 0xF9, 0xF8, 0xF6,
+	0xF5, 0xF4, 0xF3, 0xF1, 0xF0, 0xEE, 0xED, 0xEB, 0xEA, 0xE8, 0xE6, 0xE4, 0xE2, 0xE0, 0xDE, 0xDC,
+	0xDA, 0xD7, 0xD5, 0xD3, 0xD0, 0xCE, 0xCB, 0xC9, 0xC6, 0xC4, 0xC1, 0xBE, 0xBC, 0xB9, 0xB6, 0xB3,
+	0xB0, 0xAD, 0xAA, 0xA7, 0xA5, 0xA2, 0x9E, 0x9B, 0x98, 0x95, 0x92, 0x8F, 0x8C, 0x89, 0x86, 0x83,
+	0x80, 0x7C, 0x79, 0x76, 0x73, 0x70, 0x6D, 0x6A, 0x67, 0x64, 0x61, 0x5D, 0x5A, 0x58, 0x55, 0x52,
+	0x4F, 0x4C, 0x49, 0x46, 0x43, 0x41, 0x3E, 0x3B, 0x39, 0x36, 0x34, 0x31, 0x2F, 0x2C, 0x2A, 0x28,
+	0x25, 0x23, 0x21, 0x1F, 0x1D, 0x1B, 0x19, 0x17, 0x15, 0x14, 0x12, 0x11, 0x0F, 0x0E, 0x0C, 0x0B,
+	0x0A, 0x09, 0x07, 0x06, 0x05, 0x05, 0x04, 0x03, 0x02, 0x02, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x02, 0x02, 0x03, 0x04, 0x05, 0x05, 0x06, 0x07, 0x09,
+	0x0A, 0x0B, 0x0C, 0x0E, 0x0F, 0x11, 0x12, 0x14, 0x15, 0x17, 0x19, 0x1B, 0x1D, 0x1F, 0x21, 0x23,
+	0x25, 0x28, 0x2A, 0x2C, 0x2F, 0x31, 0x34, 0x36, 0x39, 0x3B, 0x3E, 0x41, 0x43, 0x46, 0x49, 0x4C,
+	0x4F, 0x52, 0x55, 0x58, 0x5A, 0x5D, 0x61, 0x64, 0x67, 0x6A, 0x6D, 0x70, 0x73, 0x76, 0x79, 0x7C
+};
+
+DDS_WAVETABLE(dds_square) = {
+	DDS_FILL16(0xFF), DDS_FILL16(0xFF), DDS_FILL16(0xFF), DDS_FILL16(0xFF),
+	DDS_FILL16(0xFF), DDS_FILL16(0xFF), DDS_FILL16(0xFF), DDS_FILL16(0xFF),
+	DDS_FILL16(0x00), DDS_FILL16(0x00), DDS_FILL16(0x00), DDS_FILL16(0x00),
+	DDS_FILL16(0x00), DDS_FILL16(0x00), DDS_FILL16(0x00), DDS_FILL16(0x00)
+};
+
+DDS_WAVETABLE(dds_saw) = {
+	DDS_RAMP16(0x00), DDS_RAMP16(0x10), DDS_RAMP16(0x20), DDS_RAMP16(0x30),
+	DDS_RAMP16(0x40), DDS_RAMP16(0x50), DDS_RAMP16(0x60), DDS_RAMP16(0x70),
+	DDS_RAMP16(0x80), DDS_RAMP16(0x90), DDS_RAMP16(0xA0), DDS_RAMP16(0xB0),
+	DDS_RAMP16(0xC0), DDS_RAMP16(0xD0), DDS_RAMP16(0xE0), DDS_RAMP16(0xF0)
+};
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+// Not static: the ISR addresses them by symbol
+volatile unsigned long dds_phase = 0;
+volatile unsigned long dds_tuning = 0;
+volatile unsigned char dds_tableHi = 0; // High byte of the wavetable address
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* phase += tuning one byte at a time; lds and sts leave the
+ * carry flag alone so the add/adc chain works across them.
+ * The new top phase byte is then the low byte of the table
+ * address and the sample goes straight to OCR2. */
+ISR(TIMER2_OVF_vect, ISR_NAKED) {
+	asm volatile(
+		"push r30\n\t"
+		"in r30, __SREG__\n\t"
+		"push r30\n\t"
+		"push r31\n\t"
+		"lds r30, %[ph]\n\t"
+		"lds r31, %[tw]\n\t"
+		"add r30, r31\n\t"
+		"sts %[ph], r30\n\t"
+		"lds r30, %[ph]+1\n\t"
+		"lds r31, %[tw]+1\n\t"
+		"adc r30, r31\n\t"
+		"sts %[ph]+1, r30\n\t"
+		"lds r30, %[ph]+2\n\t"
+		"lds r31, %[tw]+2\n\t"
+		"adc r30, r31\n\t"
+		"sts %[ph]+2, r30\n\t"
+		"lds r30, %[ph]+3\n\t"
+		"lds r31, %[tw]+3\n\t"
+		"adc r30, r31\n\t"
+		"sts %[ph]+3, r30\n\t"
+		"lds r31, %[hi]\n\t"
+		"lpm r30, Z\n\t"
+		"out %[ocr], r30\n\t"
+		"pop r31\n\t"
+		"pop r30\n\t"
+		"out __SREG__, r30\n\t"
+		"pop r30\n\t"
+		"reti\n\t"
+		:
+		: [ph] "i" (&dds_phase), [tw] "i" (&dds_tuning), [hi] "i" (&dds_tableHi),
+		  [ocr] "I" (_SFR_IO_ADDR(OCR2))
+	);
+}
+
+void dds_start(const unsigned char *wave, unsigned long mHz) {
+	dds_stop();
+	dds_phase = 0;
+	dds_setWave(wave);
+	dds_setFrequency(mHz);
+
+	ASSR &= ~(1 << AS2);
+	OCR2 = 0x80;
+	initTmr2OutPort();
+	setTmr2Mode(TMR02_FAST_PWM_MODE, TMR_COMPARE_CLEAR_MODE);
+	TIFR = (1 << TOV2);
+	enableTmr2Interrupts(TMR02_OVERFLOW_INTERRUPT, 1);
+	setTmr2Prescaler(TMR_PRESCALER_OFF);
+}
+
+void dds_stop() {
+	enableTmr2Interrupts(TMR02_OVERFLOW_INTERRUPT, 0);
+	stopTmr2();
+	setTmr2Mode(TMR02_NORMAL_MODE, TMR_COMPARE_NORMAL_MODE);
+	*TMR2_OUT_PORT &= ~TMR2_OUT_COMP_MATCH_PIN;
+}
+
+void dds_setWave(const unsigned char *wave) {
+	dds_tableHi = (unsigned short)wave >> 8;
+}
+
+void dds_setFrequency(unsigned long mHz) {
+	// tuning = mHz * 2^32 / (sample rate * 1000), sample rate = F_CPU / 256
+	dds_setTuningWord(((unsigned long long)mHz << 32) / (F_CPU * 1000ULL / 256));
+}
+
+void dds_setTuningWord(unsigned long tuning) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	dds_tuning = tuning;
+	SREG = sreg;
+}
+
+#endif
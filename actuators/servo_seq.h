@@ -0,0 +1,310 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Drives up to 10 RC servos on any output pins from the timer1
+ * compare units.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef SERVO_SEQ_H
+#define SERVO_SEQ_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "clock_utils.h"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	The sequencer takes ownership of both timer1 compare units
+ *		and their interrupts (TIMER1_COMPA_vect, TIMER1_COMPB_vect).
+ *		It cannot be used together with idle_utils.h, which also
+ *		needs compare unit B.  clock_init must be called first;
+ *		edges are scheduled relative to the free running count.
+ * 2.)	Channels 0-4 run on compare unit A and channels 5-9 on
+ *		compare unit B.  Each unit pulses its five servos one
+ *		after the other in 4ms slots, repeating every 20ms.  The B
+ *		chain runs half a slot behind the A chain.
+ * 3.)	Pick a clock prescaler that gives microsecond ticks or
+ *		better: TMR_PRESCALER_8TH at 8MHz, or TMR_PRESCALER_OFF.
+ * 4.)	Jitter:  each compare is set SERVO_LEAD_US early and the
+ *		interrupt spins on TCNT1 until the exact edge time before
+ *		writing the pin.  Interrupt latency therefore does not
+ *		move the edge as long as every other ISR in the program
+ *		(and every cli section) is shorter than SERVO_LEAD_US.
+ *		Edges of the two chains that fall close together are
+ *		handled in the same interrupt.  The spinning costs at most
+ *		20 * SERVO_LEAD_US per frame (about 2.5% CPU by default).
+ * 5.)	servo_setPulse never blocks or disables interrupts.  Each
+ *		channel has two pulse width slots; the new width goes into
+ *		the one the interrupt is not using and a single byte index
+ *		switches over.  A pulse always uses the width it started
+ *		with.
+ * 6.)	The interrupts read-modify-write the servo ports.  Other
+ *		pins on those ports must only be changed with interrupts
+ *		disabled or with single sbi/cbi instructions.
+ */
+
+#define SERVO_CHANNELS 10
+#define SERVO_CHAIN_LENGTH 5
+#define SERVO_FRAME_US 20000UL
+
+// Pulse width limits in microseconds
+#ifndef SERVO_MIN_US
+#define SERVO_MIN_US 500
+#endif
+#ifndef SERVO_MAX_US
+#define SERVO_MAX_US 2500
+#endif
+
+// How early the compare interrupt fires ahead of each edge
+#ifndef SERVO_LEAD_US
+#define SERVO_LEAD_US 24
+#endif
+
+//**************************USER AREA***************************
+
+/** Start the sequencer.  Every channel starts at a 1500us (center) pulse.
+ *  Call after clock_init.
+ */
+void servo_init();
+
+/** Stop the sequencer and drive all servo pins low.
+ */
+void servo_stop();
+
+/** Bind a channel to an output pin.  The pin is made an output and driven low.
+ *  @param channel	Channel number [0, SERVO_CHANNELS - 1]
+ *  @param port		PORT register of the pin (ie. &PORTA)
+ *  @param dir		DDR register of the pin (ie. &DDRA)
+ *  @param pin		Pin number [0, 7]
+ *  @return			1 on success, 0 if the channel or pin is invalid
+ */
+unsigned char servo_attach(unsigned char channel, volatile unsigned char *port,
+	volatile unsigned char *dir, unsigned char pin);
+
+/** Stop pulsing a channel and drive its pin low.
+ *  @param channel	Channel number
+ */
+void servo_detach(unsigned char channel);
+
+/** Set the pulse width used from the channel's next pulse on.
+ *  @param channel	Channel number
+ *  @param us		Pulse width in microseconds, limited to [SERVO_MIN_US, SERVO_MAX_US]
+ */
+void servo_setPulse(unsigned char channel, unsigned short us);
+
+//****************************END USER AREA**************************************
+
+// Largest compare step; longer gaps are split into hops so TCNT1 comparisons stay signed-safe
+#define SERVO_HOP_TICKS 0x4000
+
+// State of the servo chain on one compare unit
+struct servo_chain {
+	unsigned short target; // TCNT1 value of the next edge (or hop)
+	unsigned long pending; // Ticks still to wait after a hop
+	unsigned short width; // Width of the pulse in progress
+	unsigned char slot;
+	unsigned char high; // 1 while the slot's pulse is high
+	unsigned char hopping; // 1 if the armed compare is a hop, not an edge
+};
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static volatile unsigned char *volatile servo_ports[SERVO_CHANNELS];
+static volatile unsigned char servo_masks[SERVO_CHANNELS]; // 0 == channel not attached
+static volatile unsigned short servo_widths[SERVO_CHANNELS][2]; // Pulse widths in ticks
+static volatile unsigned char servo_sel[SERVO_CHANNELS]; // Which servo_widths slot is live
+static struct servo_chain servo_chains[2];
+static unsigned long servo_slotTicks = 0;
+static unsigned short servo_leadTicks = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the servo
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned long servo_usToTicks(unsigned long us) {
+	return (unsigned long long)us * F_CPU / (clock_getDivider() * 1000000ULL);
+}
+
+/* This function is designed to be used by the servo
+ * interrupts only and is not intended to be used as a
+ * stand alone library function.  Arms chain c's compare
+ * unit for the point delta ticks after its current target. */
+static inline void servo_schedule(unsigned char c, unsigned long delta) {
+	struct servo_chain *chain = &servo_chains[c];
+	unsigned short compare;
+
+	if(delta > 2 * SERVO_HOP_TICKS) {
+		chain->target += SERVO_HOP_TICKS;
+		chain->pending = delta - SERVO_HOP_TICKS;
+		chain->hopping = 1;
+		compare = chain->target;
+	}
+	else {
+		chain->target += delta;
+		chain->hopping = 0;
+		compare = chain->target - servo_leadTicks;
+	}
+	if(c)
+		OCR1B = compare;
+	else
+		OCR1A = compare;
+}
+
+/* This function is designed to be used by the servo
+ * interrupts only and is not intended to be used as a
+ * stand alone library function.  Waits for chain c's
+ * edge, writes the pin and arms the next edge. */
+static inline void servo_edge(unsigned char c) {
+	struct servo_chain *chain = &servo_chains[c];
+	unsigned char ch = c * SERVO_CHAIN_LENGTH + chain->slot;
+	unsigned char mask = servo_masks[ch];
+
+	while((short)(chain->target - TCNT1) > 0)
+		continue;
+
+	if(!chain->high) {
+		if(mask)
+			*servo_ports[ch] |= mask;
+		chain->width = servo_widths[ch][servo_sel[ch]];
+		chain->high = 1;
+		servo_schedule(c, chain->width);
+	}
+	else {
+		if(mask)
+			*servo_ports[ch] &= ~mask;
+		chain->high = 0;
+		chain->slot = (chain->slot + 1 == SERVO_CHAIN_LENGTH) ? 0 : chain->slot + 1;
+		servo_schedule(c, servo_slotTicks - chain->width);
+	}
+}
+
+/* This function is designed to be used by the servo
+ * interrupts only and is not intended to be used as a
+ * stand alone library function. */
+static inline void servo_run(unsigned char c) {
+	struct servo_chain *other = &servo_chains[c ^ 1];
+
+	if(servo_chains[c].hopping) {
+		servo_schedule(c, servo_chains[c].pending);
+		return;
+	}
+	servo_edge(c);
+
+	// Take the other chain's edge now if it is too close to wait for its own interrupt
+	if(!other->hopping && (short)(other->target - TCNT1) <= (short)servo_leadTicks) {
+		servo_edge(c ^ 1);
+		TIFR = c ? (1 << OCF1A) : (1 << OCF1B);
+	}
+}
+
+ISR(TIMER1_COMPA_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR1_COMPA);
+	ISR_STATS_LATENCY(ISR_ID_TMR1_COMPA, OCR1A);
+	servo_run(0);
+	ISR_STATS_END(ISR_ID_TMR1_COMPA);
+}
+
+ISR(TIMER1_COMPB_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR1_COMPB);
+	ISR_STATS_LATENCY(ISR_ID_TMR1_COMPB, OCR1B);
+	servo_run(1);
+	ISR_STATS_END(ISR_ID_TMR1_COMPB);
+}
+
+void servo_init() {
+	unsigned char ch, sreg;
+	unsigned short center;
+	unsigned long start;
+
+	servo_stop();
+	servo_slotTicks = servo_usToTicks(SERVO_FRAME_US / SERVO_CHAIN_LENGTH);
+	servo_leadTicks = servo_usToTicks(SERVO_LEAD_US);
+	center = servo_usToTicks((SERVO_MIN_US + SERVO_MAX_US) / 2);
+	for(ch = 0; ch < SERVO_CHANNELS; ++ch) {
+		servo_widths[ch][0] = center;
+		servo_widths[ch][1] = center;
+		servo_sel[ch] = 0;
+	}
+
+	start = servo_leadTicks + servo_usToTicks(100);
+	sreg = SREG;
+	SREG &= 0x7F;
+	servo_chains[0].target = TCNT1;
+	servo_chains[1].target = servo_chains[0].target;
+	servo_chains[0].slot = 0;
+	servo_chains[1].slot = 0;
+	servo_chains[0].high = 0;
+	servo_chains[1].high = 0;
+	servo_schedule(0, start);
+	servo_schedule(1, start + servo_slotTicks / 2);
+	TIFR = (1 << OCF1A) | (1 << OCF1B);
+	enableTmr1Interrupts(TMR1_COMPARE_A_INTERRUPT, 1);
+	enableTmr1Interrupts(TMR1_COMPARE_B_INTERRUPT, 1);
+	SREG = sreg;
+}
+
+void servo_stop() {
+	unsigned char ch, sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	enableTmr1Interrupts(TMR1_COMPARE_A_INTERRUPT, 0);
+	enableTmr1Interrupts(TMR1_COMPARE_B_INTERRUPT, 0);
+	for(ch = 0; ch < SERVO_CHANNELS; ++ch) {
+		if(servo_masks[ch])
+			*servo_ports[ch] &= ~servo_masks[ch];
+	}
+	SREG = sreg;
+}
+
+unsigned char servo_attach(unsigned char channel, volatile unsigned char *port,
+	volatile unsigned char *dir, unsigned char pin) {
+	if(channel >= SERVO_CHANNELS || pin > 7)
+		return 0;
+
+	servo_detach(channel);
+	*dir |= (1 << pin);
+	*port &= ~(1 << pin);
+	// The interrupt checks the mask first, so the port is in place before the mask is set
+	servo_ports[channel] = port;
+	servo_masks[channel] = (1 << pin);
+	return 1;
+}
+
+void servo_detach(unsigned char channel) {
+	unsigned char sreg;
+
+	if(channel >= SERVO_CHANNELS)
+		return;
+	sreg = SREG;
+	SREG &= 0x7F;
+	if(servo_masks[channel])
+		*servo_ports[channel] &= ~servo_masks[channel];
+	servo_masks[channel] = 0;
+	SREG = sreg;
+}
+
+void servo_setPulse(unsigned char channel, unsigned short us) {
+	unsigned char next;
+
+	if(channel >= SERVO_CHANNELS)
+		return;
+	if(us < SERVO_MIN_US)
+		us = SERVO_MIN_US;
+	else if(us > SERVO_MAX_US)
+		us = SERVO_MAX_US;
+
+	next = servo_sel[channel] ^ 1;
+	servo_widths[channel][next] = servo_usToTicks(us);
+	servo_sel[channel] = next;
+}
+
+#endif
@@ -0,0 +1,273 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Software PWM for up to 16 channels on any output pins.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef SOFT_PWM_H
+#define SOFT_PWM_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "timer_utils.c"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	The engine takes ownership of timer0 and both of its
+ *		interrupts (TIMER0_OVF_vect, TIMER0_COMP_vect).  One PWM
+ *		period is 256 timer0 ticks: all active channels are set
+ *		on overflow and each channel is cleared when the count
+ *		reaches its duty value.
+ * 2.)	The interrupt cost follows the number of distinct duty
+ *		values, not the resolution.  One compare interrupt fires
+ *		per distinct edge and every channel that shares an edge
+ *		and a port is cleared with a single port write.
+ * 3.)	Use TMR_PRESCALER_64TH or slower.  With an 8MHz CPU
+ *		64TH gives a 488Hz period (LEDs) and 1024TH gives 30Hz
+ *		(heaters).  Faster clocks leave too few cycles between
+ *		neighbouring edges.
+ * 4.)	Duty values run 0 (always off) to 255 (always on);
+ *		values in between are high for duty/256 of the period.
+ * 5.)	softPwm_setDuty only stages a value.  softPwm_commit
+ *		rebuilds the edge schedule into a spare buffer which the
+ *		overflow interrupt swaps in at the start of the next
+ *		period, so a period never mixes old and new values.
+ * 6.)	The interrupts read-modify-write the PWM ports.  Other
+ *		pins on those ports must only be changed with interrupts
+ *		disabled or with single sbi/cbi instructions.
+ */
+
+#define SOFT_PWM_MAX_CHANNELS 16
+#define SOFT_PWM_MAX_PORTS 4
+
+//**************************USER AREA***************************
+
+/** Start timer0 and the PWM engine.  All channels start at duty 0.
+ *  @param prescaler	One of the enum TIMER_PRESCALERS values from timer_utils.c
+ */
+void softPwm_init(int prescaler);
+
+/** Bind a channel to an output pin.  The pin is made an output and driven low.
+ *  @param channel	Channel number [0, SOFT_PWM_MAX_CHANNELS - 1]
+ *  @param port		PORT register of the pin (ie. &PORTA)
+ *  @param dir		DDR register of the pin (ie. &DDRA)
+ *  @param pin		Pin number [0, 7]
+ *  @return			1 on success, 0 if the channel is invalid or too many ports are in use
+ */
+unsigned char softPwm_attach(unsigned char channel, volatile unsigned char *port,
+	volatile unsigned char *dir, unsigned char pin);
+
+/** Stage a new duty value.  Takes effect after softPwm_commit.
+ *  @param channel	Channel number
+ *  @param duty		0 == off, 255 == on, other == high for duty/256 of the period
+ */
+void softPwm_setDuty(unsigned char channel, unsigned char duty);
+
+/** Build the edge schedule from the staged duty values and hand it to
+ *  the interrupt, which starts using it at the next period boundary.
+ */
+void softPwm_commit();
+
+/** @return	1 while the last committed schedule has not been picked up yet, 0 else
+ */
+unsigned char softPwm_commitPending();
+
+//****************************END USER AREA**************************************
+
+// One distinct clear time and the pins to clear on each port
+struct softPwm_edge {
+	unsigned char time;
+	unsigned char clearMask[SOFT_PWM_MAX_PORTS];
+};
+
+// Everything the interrupts need for one PWM period
+struct softPwm_schedule {
+	unsigned char setMask[SOFT_PWM_MAX_PORTS];
+	unsigned char edgeCount;
+	struct softPwm_edge edges[SOFT_PWM_MAX_CHANNELS];
+};
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static volatile unsigned char *softPwm_ports[SOFT_PWM_MAX_PORTS];
+static unsigned char softPwm_portCount = 0;
+static unsigned char softPwm_chPort[SOFT_PWM_MAX_CHANNELS];
+static unsigned char softPwm_chMask[SOFT_PWM_MAX_CHANNELS]; // 0 == channel not attached
+static unsigned char softPwm_duty[SOFT_PWM_MAX_CHANNELS];
+
+static struct softPwm_schedule softPwm_schedules[2];
+static volatile unsigned char softPwm_activeIdx = 0;
+static volatile unsigned char softPwm_swapPending = 0;
+static volatile unsigned char softPwm_nextEdge = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the timer0
+ * interrupts only and is not intended to be used as a
+ * stand alone library function.  Clears every edge that
+ * is due (or about to be) and arms the compare unit for
+ * the next one. */
+static inline void softPwm_runEdges() {
+	struct softPwm_schedule *sched = &softPwm_schedules[softPwm_activeIdx];
+	unsigned char idx = softPwm_nextEdge;
+	unsigned char p, mask;
+
+	do {
+		for(p = 0; p < softPwm_portCount; ++p) {
+			mask = sched->edges[idx].clearMask[p];
+			if(mask)
+				*softPwm_ports[p] &= ~mask;
+		}
+		++idx;
+	} while(idx < sched->edgeCount && sched->edges[idx].time <= (unsigned char)(TCNT0 + 1));
+
+	if(idx < sched->edgeCount) {
+		OCR0 = sched->edges[idx].time;
+		TIFR = (1 << OCF0); // Drop any match on the previous compare value
+	}
+	else
+		TIMSK &= ~(1 << OCIE0);
+	softPwm_nextEdge = idx;
+}
+
+ISR(TIMER0_OVF_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR0_OVF);
+	struct softPwm_schedule *sched;
+	unsigned char p;
+
+	if(softPwm_swapPending) {
+		softPwm_activeIdx ^= 1;
+		softPwm_swapPending = 0;
+	}
+	sched = &softPwm_schedules[softPwm_activeIdx];
+	for(p = 0; p < softPwm_portCount; ++p)
+		*softPwm_ports[p] |= sched->setMask[p];
+
+	softPwm_nextEdge = 0;
+	if(sched->edgeCount) {
+		TIMSK |= (1 << OCIE0);
+		if(sched->edges[0].time <= (unsigned char)(TCNT0 + 1)) {
+			softPwm_runEdges();
+		}
+		else {
+			OCR0 = sched->edges[0].time;
+			TIFR = (1 << OCF0);
+		}
+	}
+	ISR_STATS_END(ISR_ID_TMR0_OVF);
+}
+
+ISR(TIMER0_COMP_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR0_COMP);
+	softPwm_runEdges();
+	ISR_STATS_END(ISR_ID_TMR0_COMP);
+}
+
+void softPwm_init(int prescaler) {
+	unsigned char i;
+
+	stopTmr0();
+	for(i = 0; i < SOFT_PWM_MAX_CHANNELS; ++i)
+		softPwm_duty[i] = 0;
+	softPwm_schedules[0].edgeCount = 0;
+	softPwm_schedules[1].edgeCount = 0;
+	for(i = 0; i < SOFT_PWM_MAX_PORTS; ++i) {
+		softPwm_schedules[0].setMask[i] = 0;
+		softPwm_schedules[1].setMask[i] = 0;
+	}
+	softPwm_swapPending = 0;
+
+	setTmr0Mode(TMR02_NORMAL_MODE, TMR_COMPARE_NORMAL_MODE);
+	setTmr0(0);
+	TIFR = (1 << TOV0) | (1 << OCF0);
+	enableTmr0Interrupts(TMR02_OVERFLOW_INTERRUPT, 1);
+	setTmr0Prescaler(prescaler);
+}
+
+unsigned char softPwm_attach(unsigned char channel, volatile unsigned char *port,
+	volatile unsigned char *dir, unsigned char pin) {
+	unsigned char p;
+
+	if(channel >= SOFT_PWM_MAX_CHANNELS || pin > 7)
+		return 0;
+	for(p = 0; p < softPwm_portCount; ++p) {
+		if(softPwm_ports[p] == port)
+			break;
+	}
+	if(p == softPwm_portCount) {
+		if(softPwm_portCount == SOFT_PWM_MAX_PORTS)
+			return 0;
+		softPwm_ports[p] = port;
+		++softPwm_portCount;
+	}
+
+	softPwm_chPort[channel] = p;
+	softPwm_chMask[channel] = (1 << pin);
+	*dir |= (1 << pin);
+	*port &= ~(1 << pin);
+	return 1;
+}
+
+void softPwm_setDuty(unsigned char channel, unsigned char duty) {
+	if(channel < SOFT_PWM_MAX_CHANNELS)
+		softPwm_duty[channel] = duty;
+}
+
+void softPwm_commit() {
+	struct softPwm_schedule *back;
+	unsigned char order[SOFT_PWM_MAX_CHANNELS];
+	unsigned char count, i, j, ch, p;
+	unsigned char sreg;
+
+	// Withdraw any schedule the interrupt has not taken yet so the spare buffer is ours
+	sreg = SREG;
+	SREG &= 0x7F;
+	softPwm_swapPending = 0;
+	SREG = sreg;
+	back = &softPwm_schedules[softPwm_activeIdx ^ 1];
+
+	for(p = 0; p < SOFT_PWM_MAX_PORTS; ++p)
+		back->setMask[p] = 0;
+
+	// Insertion sort the channels that need a clear edge by duty
+	count = 0;
+	for(ch = 0; ch < SOFT_PWM_MAX_CHANNELS; ++ch) {
+		if(!softPwm_chMask[ch] || !softPwm_duty[ch])
+			continue;
+		back->setMask[softPwm_chPort[ch]] |= softPwm_chMask[ch];
+		if(softPwm_duty[ch] == 255)
+			continue;
+		for(j = count; j > 0 && softPwm_duty[order[j - 1]] > softPwm_duty[ch]; --j)
+			order[j] = order[j - 1];
+		order[j] = ch;
+		++count;
+	}
+
+	// Merge channels with equal duty into one edge with per-port masks
+	back->edgeCount = 0;
+	for(i = 0; i < count; ++i) {
+		ch = order[i];
+		if(!back->edgeCount || back->edges[back->edgeCount - 1].time != softPwm_duty[ch]) {
+			back->edges[back->edgeCount].time = softPwm_duty[ch];
+			for(p = 0; p < SOFT_PWM_MAX_PORTS; ++p)
+				back->edges[back->edgeCount].clearMask[p] = 0;
+			++back->edgeCount;
+		}
+		back->edges[back->edgeCount - 1].clearMask[softPwm_chPort[ch]] |= softPwm_chMask[ch];
+	}
+
+	softPwm_swapPending = 1;
+}
+
+unsigned char softPwm_commitPending() {
+	return softPwm_swapPending;
+}
+
+#endif
@@ -0,0 +1,305 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Interrupt driven timer1 input capture for period, frequency and
+ * duty cycle measurement.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef CAPTURE_UTILS_H
+#define CAPTURE_UTILS_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "clock_utils.h"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	The engine takes ownership of the timer1 input capture
+ *		unit and its interrupt (TIMER1_CAPT_vect).  The signal
+ *		goes to the ICP1 pin, PD6 on atmega32.  clock_init must
+ *		be called first; timestamps are clock_ticks values.
+ * 2.)	Do not use the HC-SR04 library while the engine is
+ *		running, it polls the same capture unit.
+ * 3.)	Every captured edge is pushed into a ring buffer of
+ *		CAPTURE_BUFFER_SIZE timestamps (a power of two).  Edges
+ *		that arrive while the buffer is full are counted and
+ *		dropped.  Define CAPTURE_BUFFER_SIZE as 0 before including
+ *		this file to skip the buffer and shorten the interrupt
+ *		when only capture_measure is used.
+ * 4.)	The interrupt also keeps running totals so capture_measure
+ *		can report the average period, frequency and duty cycle
+ *		since its last call without reading the buffer.  The
+ *		total of the periods is 32 bits wide, so call
+ *		capture_measure at least every 2^32 clock ticks (about
+ *		71 minutes with 1 microsecond ticks, 9 minutes at 8MHz
+ *		without a prescaler) or the average is wrong.
+ * 5.)	CAPTURE_BOTH_EDGES flips the edge select after every
+ *		capture to time pulse widths and duty cycle.  It needs two
+ *		interrupts per period; at 8MHz the single edge modes keep
+ *		up with roughly 50kHz and the alternating mode with about
+ *		half of that.  A pulse shorter than the interrupt latency
+ *		loses its second edge; the engine notices the repeated
+ *		level and resynchronizes on the next period.
+ * 6.)	The period is measured between edges of the selected type
+ *		(rising edges in CAPTURE_BOTH_EDGES mode).  Pick a clock
+ *		prescaler whose tick is small compared to the period.
+ */
+
+#ifndef CAPTURE_BUFFER_SIZE
+#define CAPTURE_BUFFER_SIZE 16
+#endif
+
+// Use for the first argument to capture_init
+enum CAPTURE_MODES { CAPTURE_RISING_EDGE, CAPTURE_FALLING_EDGE, CAPTURE_BOTH_EDGES };
+
+// Result of capture_measure
+struct capture_measurement {
+	unsigned long periods; // Full periods seen since the last call, 0 == none
+	unsigned long periodTicks; // Average period in clock ticks, 0 == no signal
+	unsigned long frequency; // Average frequency in milli-Hz, 0 == no signal
+	unsigned short duty; // High time in tenths of a percent (0 - 1000), CAPTURE_BOTH_EDGES only
+};
+
+//**************************USER AREA***************************
+
+/** Start capturing edges on ICP1.  Empties the buffer and the running totals.
+ *  @param mode			One of the enum CAPTURE_MODES values
+ *  @param noiseFilter	1 to enable the 4 cycle capture noise canceler, 0 else
+ */
+void capture_init(unsigned char mode, unsigned char noiseFilter);
+
+/** Stop capturing.  Buffered timestamps can still be read.
+ */
+void capture_stop();
+
+/** @return	Number of timestamps waiting in the buffer
+ */
+unsigned char capture_available();
+
+/** Take the oldest timestamp out of the buffer.
+ *  @param stamp	Destination for the clock_ticks value of the edge
+ *  @param rising	Destination for 1 (rising) or 0 (falling) edge, may be 0
+ *  @return			1 if a timestamp was read, 0 if the buffer was empty
+ */
+unsigned char capture_read(unsigned long *stamp, unsigned char *rising);
+
+/** @return	Number of edges dropped because the buffer was full
+ */
+unsigned short capture_getDropped();
+
+/** Average the periods captured since the last call.  When no full
+ *  period has completed the previous result is kept until the input
+ *  has been quiet for two periods, then the signal reads as lost.
+ *  @param result	Destination for the measurement
+ */
+void capture_measure(struct capture_measurement *result);
+
+//****************************END USER AREA**************************************
+
+#if CAPTURE_BUFFER_SIZE & (CAPTURE_BUFFER_SIZE - 1)
+#error "CAPTURE_BUFFER_SIZE must be a power of two"
+#endif
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+#if CAPTURE_BUFFER_SIZE
+static volatile unsigned long capture_stamps[CAPTURE_BUFFER_SIZE];
+static volatile unsigned char capture_levels[CAPTURE_BUFFER_SIZE];
+static volatile unsigned char capture_head = 0;
+static volatile unsigned char capture_tail = 0;
+#endif
+static volatile unsigned short capture_dropped = 0;
+static unsigned char capture_alternate = 0;
+static unsigned char capture_periodLevel = 0; // ICES1 state of the edge that starts a period
+static volatile unsigned char capture_expectLevel = 0; // Edge the next capture should be, alternating mode
+static volatile unsigned char capture_havePeriodEdge = 0;
+static volatile unsigned long capture_lastEdge = 0; // Last edge that started a period
+// Running totals, cleared by capture_measure
+static volatile unsigned long capture_periodSum = 0;
+static volatile unsigned long capture_periodCount = 0;
+static volatile unsigned long capture_highSum = 0;
+static volatile unsigned long capture_highCount = 0;
+static struct capture_measurement capture_last;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+ISR(TIMER1_CAPT_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR1_CAPT);
+	unsigned short raw = ICR1;
+	unsigned char level = TCCR1B & (1 << ICES1);
+	unsigned long stamp;
+#if CAPTURE_BUFFER_SIZE
+	unsigned char head, next;
+#endif
+
+	if(capture_alternate) {
+		TCCR1B ^= (1 << ICES1);
+		TIFR = (1 << ICF1); // Changing ICES1 can raise a false capture
+	}
+	stamp = clock_extend(raw);
+
+#if CAPTURE_BUFFER_SIZE
+	head = capture_head;
+	next = (head + 1) & (CAPTURE_BUFFER_SIZE - 1);
+	if(next != capture_tail) {
+		capture_stamps[head] = stamp;
+		capture_levels[head] = level;
+		capture_head = next;
+	}
+	else
+		++capture_dropped;
+#endif
+
+	if(capture_alternate) {
+		// A missed edge shows up as the same level twice, restart the period
+		if(level != capture_expectLevel)
+			capture_havePeriodEdge = 0;
+		capture_expectLevel = level ^ (1 << ICES1);
+	}
+
+	if(level == capture_periodLevel) {
+		if(capture_havePeriodEdge) {
+			capture_periodSum += stamp - capture_lastEdge;
+			++capture_periodCount;
+		}
+		capture_lastEdge = stamp;
+		capture_havePeriodEdge = 1;
+	}
+	else if(capture_havePeriodEdge) {
+		capture_highSum += stamp - capture_lastEdge;
+		++capture_highCount;
+	}
+	ISR_STATS_LATENCY(ISR_ID_TMR1_CAPT, raw);
+	ISR_STATS_END(ISR_ID_TMR1_CAPT);
+}
+
+void capture_init(unsigned char mode, unsigned char noiseFilter) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	enableTmr1Interrupts(TMR1_INPUT_CAPTURE_INTERRUPT, 0);
+	initTmr1InCaptPort();
+	setTmr1NoiseFilter(noiseFilter);
+	setTmr1EdgeTrigger(mode == CAPTURE_FALLING_EDGE ? FALLING_EDGE : RISING_EDGE);
+	capture_alternate = (mode == CAPTURE_BOTH_EDGES);
+	capture_periodLevel = TCCR1B & (1 << ICES1);
+	capture_expectLevel = capture_periodLevel;
+#if CAPTURE_BUFFER_SIZE
+	capture_head = 0;
+	capture_tail = 0;
+#endif
+	capture_dropped = 0;
+	capture_havePeriodEdge = 0;
+	capture_periodSum = 0;
+	capture_periodCount = 0;
+	capture_highSum = 0;
+	capture_highCount = 0;
+	capture_last.periods = 0;
+	capture_last.periodTicks = 0;
+	capture_last.frequency = 0;
+	capture_last.duty = 0;
+	TIFR = (1 << ICF1);
+	enableTmr1Interrupts(TMR1_INPUT_CAPTURE_INTERRUPT, 1);
+	SREG = sreg;
+}
+
+void capture_stop() {
+	enableTmr1Interrupts(TMR1_INPUT_CAPTURE_INTERRUPT, 0);
+}
+
+unsigned char capture_available() {
+#if CAPTURE_BUFFER_SIZE
+	return (capture_head - capture_tail) & (CAPTURE_BUFFER_SIZE - 1);
+#else
+	return 0;
+#endif
+}
+
+unsigned char capture_read(unsigned long *stamp, unsigned char *rising) {
+#if CAPTURE_BUFFER_SIZE
+	unsigned char tail = capture_tail;
+
+	if(tail == capture_head)
+		return 0;
+	// The interrupt never writes a slot that has not been read yet
+	*stamp = capture_stamps[tail];
+	if(rising)
+		*rising = capture_levels[tail] ? 1 : 0;
+	capture_tail = (tail + 1) & (CAPTURE_BUFFER_SIZE - 1);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+unsigned short capture_getDropped() {
+	unsigned char sreg;
+	unsigned short dropped;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	dropped = capture_dropped;
+	SREG = sreg;
+	return dropped;
+}
+
+void capture_measure(struct capture_measurement *result) {
+	unsigned char sreg;
+	unsigned long periodSum, highSum, lastEdge;
+	unsigned long periodCount, highCount;
+	unsigned long long duty;
+	unsigned char haveEdge;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	periodSum = capture_periodSum;
+	periodCount = capture_periodCount;
+	highSum = capture_highSum;
+	highCount = capture_highCount;
+	lastEdge = capture_lastEdge;
+	haveEdge = capture_havePeriodEdge;
+	if(periodCount) {
+		capture_periodSum = 0;
+		capture_periodCount = 0;
+		capture_highSum = 0;
+		capture_highCount = 0;
+	}
+	SREG = sreg;
+
+	if(periodCount) {
+		capture_last.periods = periodCount;
+		capture_last.periodTicks = (periodSum + periodCount / 2) / periodCount;
+		capture_last.frequency = ((unsigned long long)F_CPU * 1000 * periodCount +
+			(unsigned long long)clock_getDivider() * periodSum / 2) /
+			((unsigned long long)clock_getDivider() * periodSum);
+		duty = 0;
+		if(capture_alternate && highCount) {
+			/* Compare average high time to average period.  The
+			 * average high time goes first so the product stays
+			 * within 64 bits for any number of periods. */
+			duty = (unsigned long long)highSum * 1000 / highCount * periodCount / periodSum;
+			if(duty > 1000)
+				duty = 1000;
+		}
+		capture_last.duty = duty;
+	}
+	else {
+		capture_last.periods = 0;
+		if(!haveEdge || clock_ticks() - lastEdge > 2 * capture_last.periodTicks) {
+			capture_last.periodTicks = 0;
+			capture_last.frequency = 0;
+			capture_last.duty = 0;
+		}
+	}
+	*result = capture_last;
+}
+
+#endif
@@ -0,0 +1,242 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef CLOCK_UTILS_H
+#define CLOCK_UTILS_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include "timer_utils.c"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	The clock takes ownership of timer1 and its overflow
+ *		interrupt (TIMER1_OVF_vect).  Timer1 is left free running
+ *		in normal mode and is never reset, so do not call setTmr1,
+ *		stopTmr1 or put timer1 into a CTC/PWM mode that changes
+ *		its TOP value while the clock is in use.
+ * 2.)	The compare A/B units and the input capture unit are still
+ *		available.  Schedule compare events relative to the
+ *		running count (OCR1A = readTmr1() + delay) and read
+ *		captures relative to the running count instead of
+ *		clearing TCNT1 first.  clock_extend and clock_toRaw
+ *		convert between raw timer1 values and clock_ticks; do
+ *		not mix the two directly, they drift apart with every
+ *		clock_advance.
+ * 3.)	Global interrupts must be enabled (sei()) or the clock
+ *		will lose one 65536 tick period per missed overflow.
+ * 4.)	Pick the prescaler to trade resolution for range. With
+ *		an 8MHz CPU, TMR_PRESCALER_8TH gives 1 microsecond ticks
+ *		and clock_ticks wraps after about 71 minutes.  Always
+ *		compare times using unsigned subtraction
+ *		(now - then >= period) so a wrap is harmless.
+ * 5.)	clock_ticks is the cheap call and is safe to use in hot
+ *		paths.  clock_micros and clock_millis scale a 48-bit
+ *		count and cost considerably more cycles.
+ */
+
+//**************************USER AREA***************************
+
+/** Start timer1 as a free running 32-bit time base.
+ *  @param prescaler	One of the enum TIMER_PRESCALERS values from timer_utils.c.
+ *						External clock sources are not supported.
+ */
+void clock_init(int prescaler);
+
+/** @return	Timer1 ticks since clock_init.  Wraps at 2^32 ticks.
+ */
+unsigned long clock_ticks();
+
+/** @return	Microseconds since clock_init.  Wraps at 2^32 microseconds.
+ */
+unsigned long clock_micros();
+
+/** @return	Milliseconds since clock_init.  Wraps at 2^32 milliseconds.
+ */
+unsigned long clock_millis();
+
+/** @return	The timer1 clock division selected by clock_init (1, 8, 64, 256 or 1024).
+ */
+unsigned short clock_getDivider();
+
+/** Extend a 16-bit timer1 stamp, such as an ICR1 or OCR1x value,
+ *  into the 32-bit clock_ticks time line.  Call with interrupts
+ *  disabled (ie. from an ISR) and within half a timer1 period
+ *  (32768 ticks) of the stamp being taken.
+ *  @param stamp	Raw 16-bit timer1 value
+ *  @return			Matching clock_ticks value
+ */
+unsigned long clock_extend(unsigned short stamp);
+
+/** The inverse of clock_extend: the raw 16-bit timer1 count at which
+ *  TCNT1 reaches a clock_ticks value.  Use it to load OCR1A/OCR1B,
+ *  as the two differ once clock_advance has been called.
+ *  @param ticks	clock_ticks value
+ *  @return			Matching raw timer1 value
+ */
+unsigned short clock_toRaw(unsigned long ticks);
+
+/** Move the clock forward to account for time that passed while
+ *  timer1 was halted, such as during power-save sleep.
+ *  @param ticks	Number of timer1 ticks to add
+ */
+void clock_advance(unsigned long ticks);
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static volatile unsigned long clock_overflows = 0; // Upper 32 bits of the 48-bit tick count
+static volatile unsigned long long clock_offset = 0; // Ticks added by clock_advance while timer1 was halted
+static unsigned short clock_divider = 1;
+// microseconds = ticks * clock_usNum / clock_usDen
+static unsigned long clock_usNum = 1;
+static unsigned long clock_usDen = 1;
+static unsigned char clock_usDenShift = 0; // log2(clock_usDen) or 0xFF if not a power of two
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+ISR(TIMER1_OVF_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR1_OVF);
+	ISR_STATS_LATENCY(ISR_ID_TMR1_OVF, 0); // The count restarted at 0
+	++clock_overflows;
+	ISR_STATS_END(ISR_ID_TMR1_OVF);
+}
+
+void clock_init(int prescaler) {
+	unsigned long a, b, t;
+
+	switch(prescaler) {
+		case TMR_PRESCALER_8TH:
+			clock_divider = 8;
+			break;
+		case TMR_PRESCALER_64TH:
+			clock_divider = 64;
+			break;
+		case TMR_PRESCALER_256TH:
+			clock_divider = 256;
+			break;
+		case TMR_PRESCALER_1024TH:
+			clock_divider = 1024;
+			break;
+		case TMR_PRESCALER_OFF:
+		default:
+			prescaler = TMR_PRESCALER_OFF;
+			clock_divider = 1;
+	}
+
+	// Reduce (divider * 1000000) / F_CPU so the scaling never overflows
+	a = clock_divider * 1000000UL;
+	b = F_CPU;
+	while(b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	clock_usNum = clock_divider * 1000000UL / a;
+	clock_usDen = F_CPU / a;
+	clock_usDenShift = 0xFF;
+	for(t = 0; t < 32; ++t) {
+		if(clock_usDen == (1UL << t)) {
+			clock_usDenShift = t;
+			break;
+		}
+	}
+
+	stopTmr1();
+	setTmr1Mode(TMR1_NORMAL_MODE, TMR_COMPARE_NORMAL_MODE, TMR_COMPARE_NORMAL_MODE);
+	clock_overflows = 0;
+	clock_offset = 0;
+	setTmr1(0);
+	TIFR = (1 << TOV1);
+	enableTmr1Interrupts(TMR1_OVERFLOW_INTERRUPT, 1);
+	setTmr1Prescaler(prescaler);
+}
+
+unsigned long clock_extend(unsigned short stamp) {
+	unsigned long overflows = clock_overflows;
+	// An overflow that has not been serviced yet belongs to any stamp taken after it
+	if((TIFR & (1 << TOV1)) && stamp < 0x8000)
+		++overflows;
+	return ((overflows << 16) | stamp) + (unsigned long)clock_offset;
+}
+
+unsigned short clock_toRaw(unsigned long ticks) {
+	unsigned char sreg;
+	unsigned short offset;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	offset = (unsigned short)clock_offset;
+	SREG = sreg;
+	return (unsigned short)ticks - offset;
+}
+
+/* This function is designed to be used by the clock
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Returns the full 48-bit
+ * tick count. */
+unsigned long long clock_readTicks48() {
+	unsigned char sreg;
+	unsigned short count;
+	unsigned long overflows;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	count = TCNT1;
+	overflows = clock_overflows;
+	if((TIFR & (1 << TOV1)) && count < 0x8000)
+		++overflows;
+	SREG = sreg;
+	return (((unsigned long long)overflows << 16) | count) + clock_offset;
+}
+
+unsigned long clock_ticks() {
+	unsigned char sreg;
+	unsigned long ticks;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	ticks = clock_extend(TCNT1);
+	SREG = sreg;
+	return ticks;
+}
+
+unsigned long clock_micros() {
+	unsigned long long ticks = clock_readTicks48() * clock_usNum;
+	if(clock_usDenShift != 0xFF)
+		return ticks >> clock_usDenShift;
+	return ticks / clock_usDen;
+}
+
+unsigned long clock_millis() {
+	return clock_readTicks48() * clock_usNum / (clock_usDen * 1000ULL);
+}
+
+void clock_advance(unsigned long ticks) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	clock_offset += ticks;
+	SREG = sreg;
+}
+
+unsigned short clock_getDivider() {
+	return clock_divider;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Minimal text output for diagnostic dumps.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef DUMP_UTILS_H
+#define DUMP_UTILS_H
+
+#include <avr/io.h>
+
+/* USE NOTES:
+ * 1.)	Dumps are written one byte at a time to a sink function.
+ *		The default sink, dump_usartSink, polls the USART data
+ *		register and writes to it; the USART must already be set
+ *		up (baud rate, transmitter enabled).  Use dump_setSink to
+ *		send the output anywhere else (LCD, buffer, SPI...).
+ * 2.)	All output is blocking and meant for on-demand debug dumps,
+ *		never call these functions from an ISR.
+ * 3.)	Numbers are printed without leading zeros or padding; use
+ *		dump_char('\t') between columns for host side parsing.
+ */
+
+//**************************USER AREA***************************
+
+/** Select where dump output goes.
+ *  @param sink	Function that outputs one byte, 0 restores dump_usartSink
+ */
+void dump_setSink(void (*sink)(unsigned char));
+
+/** Default sink.  Waits for the USART data register to empty and writes the byte.
+ *  @param data	Byte to send
+ */
+void dump_usartSink(unsigned char data);
+
+/** @param c	Character to output
+ */
+void dump_char(char c);
+
+/** @param str	Null terminated string to output
+ */
+void dump_string(const char *str);
+
+/** Output "\r\n".
+ */
+void dump_newline();
+
+/** @param value	Number to output in decimal
+ */
+void dump_ulong(unsigned long value);
+
+/** @param value	Number to output in decimal, with a leading '-' if negative
+ */
+void dump_long(long value);
+
+/** @param value	Number to output in hexadecimal, upper case, no prefix
+ *  @param digits	Number of least significant digits to output [1, 8]
+ */
+void dump_hex(unsigned long value, unsigned char digits);
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static void (*dump_sink)(unsigned char) = dump_usartSink;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+void dump_setSink(void (*sink)(unsigned char)) {
+	dump_sink = sink ? sink : dump_usartSink;
+}
+
+void dump_usartSink(unsigned char data) {
+#ifdef UDR
+	while(!(UCSRA & (1 << UDRE)))
+		continue;
+	UDR = data;
+#else
+	while(!(UCSR0A & (1 << UDRE0)))
+		continue;
+	UDR0 = data;
+#endif
+}
+
+void dump_char(char c) {
+	dump_sink((unsigned char)c);
+}
+
+void dump_string(const char *str) {
+	while(*str)
+		dump_sink((unsigned char)*str++);
+}
+
+void dump_newline() {
+	dump_sink('\r');
+	dump_sink('\n');
+}
+
+void dump_ulong(unsigned long value) {
+	char digits[10];
+	unsigned char i = 0;
+
+	do {
+		digits[i++] = '0' + value % 10;
+		value /= 10;
+	} while(value);
+	while(i)
+		dump_sink(digits[--i]);
+}
+
+void dump_long(long value) {
+	if(value < 0) {
+		dump_sink('-');
+		dump_ulong(-(unsigned long)value);
+	}
+	else
+		dump_ulong(value);
+}
+
+void dump_hex(unsigned long value, unsigned char digits) {
+	unsigned char nibble;
+
+	if(digits > 8)
+		digits = 8;
+	while(digits) {
+		--digits;
+		nibble = (value >> (digits * 4)) & 0x0F;
+		dump_sink(nibble < 10 ? '0' + nibble : 'A' + nibble - 10);
+	}
+}
+
+#endif
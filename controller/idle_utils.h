@@ -0,0 +1,296 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef IDLE_UTILS_H
+#define IDLE_UTILS_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "clock_utils.h"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	Tickless idle sleeps straight through to the next deadline
+ *		instead of waking on a periodic tick.  Call idle_sleepUntil
+ *		from your scheduler loop whenever no task is ready to run,
+ *		passing the clock_ticks value at which the next task is due.
+ * 2.)	clock_init must be called before idle_init.  Deadlines are
+ *		clock_ticks values and the clock is corrected after a
+ *		power-save sleep so it stays monotonic.
+ * 3.)	Without a 32.768kHz crystal on TOSC1/TOSC2 (PC6/PC7) the
+ *		deadline is loaded into timer1 compare unit B and the MCU
+ *		uses idle sleep; timer1 keeps counting so no correction is
+ *		needed.  TIMER1_COMPB_vect is owned by this library.
+ * 4.)	With the crystal, pass 1 to idle_init.  Timer2 runs
+ *		asynchronously and the deadline is loaded into OCR2 so the
+ *		MCU can use power-save, the deepest mode that keeps timer2
+ *		alive.  TIMER2_COMP_vect is owned by this library.  If timer2
+ *		is already asynchronous (ie. an RTC is running on it) its
+ *		prescaler is left alone and reused.  Short deadlines, closer
+ *		than a few timer2 ticks, still use idle sleep on timer1.
+ * 5.)	Any interrupt wakes the MCU.  An ISR that makes a task
+ *		runnable should call idle_wake so idle_sleepUntil returns
+ *		early instead of going back to sleep.
+ * 6.)	The 32.768kHz crystal needs up to a second to stabilize
+ *		after power up.  Allow for this before relying on timer2.
+ */
+
+// Use to index the idle_stats arrays below
+enum IDLE_SLEEP_MODES { IDLE_MODE_IDLE, IDLE_MODE_PWR_SAVE, IDLE_MODE_COUNT };
+
+// Idle residency statistics, see idle_getStats
+struct idle_stats {
+	unsigned long sleeps[IDLE_MODE_COUNT]; // Times each sleep mode was entered
+	unsigned long sleepTicks[IDLE_MODE_COUNT]; // Clock ticks spent in each sleep mode
+	unsigned long earlyWakes; // idle_sleepUntil calls ended by idle_wake
+	unsigned long elapsedTicks; // Clock ticks since the statistics were reset
+};
+
+//**************************USER AREA***************************
+
+/** Prepare the deadline timers.  Call after clock_init.
+ *  @param useAsyncTmr2	1 if a 32.768kHz crystal is fitted and timer2 may be used
+ *						for power-save sleep, 0 to only use idle sleep on timer1.
+ */
+void idle_init(unsigned char useAsyncTmr2);
+
+/** Sleep in the deepest usable mode until the deadline is reached or
+ *  idle_wake is called.
+ *  @param deadline	clock_ticks value to wake up at
+ *  @return			1 when the deadline was reached, 0 when woken by idle_wake
+ */
+unsigned char idle_sleepUntil(unsigned long deadline);
+
+/** Ask a pending or running idle_sleepUntil call to return.  Safe to call from an ISR.
+ */
+void idle_wake();
+
+/** Copy the idle residency statistics gathered since the last reset.
+ *  @param stats	Destination for the statistics
+ */
+void idle_getStats(struct idle_stats *stats);
+
+/** @return	Time spent asleep since the last reset in tenths of a percent (0 - 1000)
+ */
+unsigned short idle_getResidency();
+
+/** Clear the idle residency statistics.
+ */
+void idle_resetStats();
+
+//****************************END USER AREA**************************************
+
+// Smallest number of timer2 ticks worth a power-save sleep (1 to align, 2 asleep)
+const unsigned char IDLE_MIN_ASYNC_TICKS = 3;
+// Smallest number of CPU cycles worth an idle sleep
+const unsigned char IDLE_MIN_SLEEP_CYCLES = 100;
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static volatile unsigned char idle_wakeRequest = 0;
+static unsigned char idle_useAsync = 0;
+static unsigned short idle_minIdleTicks = 1;
+// clock ticks per timer2 tick = idle_asyncNum / 32768
+static unsigned long long idle_asyncNum = 0;
+static unsigned long idle_statsStart = 0;
+static struct idle_stats idle_statistics;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+// Deadline wakeups only need to bring the MCU out of sleep
+ISR(TIMER1_COMPB_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR1_COMPB);
+	ISR_STATS_LATENCY(ISR_ID_TMR1_COMPB, OCR1B);
+	ISR_STATS_END(ISR_ID_TMR1_COMPB);
+}
+
+ISR(TIMER2_COMP_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR2_COMP);
+	ISR_STATS_END(ISR_ID_TMR2_COMP);
+}
+
+void idle_init(unsigned char useAsyncTmr2) {
+	// Timer2 division indexed by the CS22:0 bits
+	static const unsigned short TMR2_DIVIDERS[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+	idle_minIdleTicks = IDLE_MIN_SLEEP_CYCLES / clock_getDivider() + 1;
+	idle_useAsync = useAsyncTmr2;
+	if(useAsyncTmr2) {
+		if(!(ASSR & (1 << AS2)) || !(TCCR2 & ((1 << CS20) | (1 << CS21) | (1 << CS22)))) {
+			startAsyncTmr2(TMR2_PRESCALER_128TH);
+		}
+		idle_asyncNum = (unsigned long long)F_CPU * TMR2_DIVIDERS[TCCR2 & 0x07] / clock_getDivider();
+	}
+	idle_resetStats();
+}
+
+void idle_wake() {
+	idle_wakeRequest = 1;
+}
+
+/* This function is designed to be used by idle_sleepUntil
+ * only and is not intended to be used as a stand alone
+ * library function.  Must be called with global interrupts
+ * disabled; returns with them enabled. */
+void idle_sleepTmr1(unsigned long deadline) {
+	OCR1B = clock_toRaw(deadline);
+	TIFR = (1 << OCF1B);
+	TIMSK |= (1 << OCIE1B);
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sei(); // The instruction following sei is always executed before an interrupt
+	sleep_cpu();
+	sleep_disable();
+	TIMSK &= ~(1 << OCIE1B);
+}
+
+/* This function is designed to be used by idle_sleepUntil
+ * only and is not intended to be used as a stand alone
+ * library function.  Sleeps for up to asyncTicks timer2
+ * ticks, the first in idle mode to line up with a timer2
+ * tick edge and the rest in power-save.  Must be called with
+ * global interrupts disabled; returns with them enabled. */
+void idle_sleepTmr2(unsigned char asyncTicks) {
+	unsigned char start, now;
+	unsigned long alignStart, aligned, elapsed, after;
+
+	// Wake on the next timer2 edge so the power-save sleep starts on a known phase
+	alignStart = clock_ticks();
+	start = TCNT2;
+	OCR2 = start + 1;
+	waitOnTmr2Busy();
+	TIFR = (1 << OCF2);
+	TIMSK |= (1 << OCIE2);
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	while(TCNT2 == start && !idle_wakeRequest) {
+		sei(); // The instruction following sei is always executed before an interrupt
+		sleep_cpu();
+		cli();
+	}
+	aligned = clock_ticks();
+	start = TCNT2;
+	++idle_statistics.sleeps[IDLE_MODE_IDLE];
+	idle_statistics.sleepTicks[IDLE_MODE_IDLE] += aligned - alignStart;
+
+	// Timer1 halts in power-save, timer2 keeps counting
+	--asyncTicks;
+	OCR2 = start + asyncTicks;
+	waitOnTmr2Busy(); // Also makes sure the interrupt logic has reset before sleeping
+	TIFR = (1 << OCF2);
+	if(!idle_wakeRequest && (unsigned char)(TCNT2 - start) < asyncTicks) {
+		set_sleep_mode(SLEEP_MODE_PWR_SAVE);
+		sei();
+		sleep_cpu();
+		cli();
+		++idle_statistics.sleeps[IDLE_MODE_PWR_SAVE];
+	}
+	sleep_disable();
+	TIMSK &= ~(1 << OCIE2);
+
+	// TCNT2 reads stale right after power-save, force a resync first
+	OCR2 = OCR2;
+	waitOnTmr2Busy();
+	now = TCNT2;
+	elapsed = (idle_asyncNum * (unsigned char)(now - start)) >> 15;
+	after = clock_ticks();
+	if((long)(aligned + elapsed - after) > 0)
+		clock_advance(aligned + elapsed - after);
+	idle_statistics.sleepTicks[IDLE_MODE_PWR_SAVE] += clock_ticks() - aligned;
+	sei();
+}
+
+unsigned char idle_sleepUntil(unsigned long deadline) {
+	unsigned char sreg, reached;
+	unsigned long now, before, asyncTicks;
+	long remaining;
+
+	sreg = SREG;
+	for(;;) {
+		cli();
+		if(idle_wakeRequest) {
+			idle_wakeRequest = 0;
+			++idle_statistics.earlyWakes;
+			reached = 0;
+			break;
+		}
+		now = clock_ticks();
+		remaining = deadline - now;
+		if(remaining <= 0) {
+			reached = 1;
+			break;
+		}
+
+		asyncTicks = 0;
+		if(idle_useAsync) {
+			asyncTicks = ((unsigned long long)remaining << 15) / idle_asyncNum;
+			if(asyncTicks > 255)
+				asyncTicks = 255;
+		}
+
+		if(asyncTicks >= IDLE_MIN_ASYNC_TICKS) {
+			idle_sleepTmr2(asyncTicks);
+		}
+		else if(remaining >= idle_minIdleTicks) {
+			before = now;
+			idle_sleepTmr1(deadline);
+			cli();
+			++idle_statistics.sleeps[IDLE_MODE_IDLE];
+			idle_statistics.sleepTicks[IDLE_MODE_IDLE] += clock_ticks() - before;
+			sei();
+		}
+		else {
+			SREG = sreg;
+			while((long)(deadline - clock_ticks()) > 0)
+				continue;
+		}
+	}
+	SREG = sreg;
+	return reached;
+}
+
+void idle_getStats(struct idle_stats *stats) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	*stats = idle_statistics;
+	SREG = sreg;
+	stats->elapsedTicks = clock_ticks() - idle_statsStart;
+}
+
+unsigned short idle_getResidency() {
+	struct idle_stats stats;
+	unsigned long asleep;
+
+	idle_getStats(&stats);
+	asleep = stats.sleepTicks[IDLE_MODE_IDLE] + stats.sleepTicks[IDLE_MODE_PWR_SAVE];
+	if(!stats.elapsedTicks)
+		return 0;
+	return (unsigned long long)asleep * 1000 / stats.elapsedTicks;
+}
+
+void idle_resetStats() {
+	unsigned char i, sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	for(i = 0; i < IDLE_MODE_COUNT; ++i) {
+		idle_statistics.sleeps[i] = 0;
+		idle_statistics.sleepTicks[i] = 0;
+	}
+	idle_statistics.earlyWakes = 0;
+	idle_statsStart = clock_ticks();
+	SREG = sreg;
+}
+
+#endif
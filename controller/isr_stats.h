@@ -0,0 +1,224 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Interrupt latency and execution time histograms.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef ISR_STATS_H
+#define ISR_STATS_H
+
+/* USE NOTES:
+ * 1.)	Define ISR_STATS_ENABLE before including any library file
+ *		to instrument the interrupt handlers defined by the library.
+ *		Without it the ISR_STATS_ macros expand to nothing and the
+ *		handlers carry no overhead.
+ * 2.)	Times are timer1 ticks, so timer1 must be free running
+ *		(clock_init).  Use TMR_PRESCALER_OFF to measure in cycles.
+ *		The execution time covers the handler body; the register
+ *		saves and restores the compiler adds around it and the
+ *		4 cycle interrupt response are not included.
+ * 3.)	Latency, the time from the hardware event to the handler
+ *		body, is only recorded where the hardware timestamps the
+ *		event: timer1 capture (ICR1), compare (OCR1A/OCR1B) and
+ *		overflow (the count restarts at 0).
+ * 4.)	Both histograms have ISR_STATS_BUCKETS log2 buckets:
+ *		bucket 0 counts 0 ticks, bucket n counts 2^(n-1) to 2^n - 1
+ *		ticks and the last bucket also counts everything longer.
+ *		Bucket counts stop at 65535.
+ * 5.)	Your own handlers can be instrumented the same way:
+ *		ISR_STATS_BEGIN(id) as the first line, optionally
+ *		ISR_STATS_LATENCY(id, eventStamp), and ISR_STATS_END(id)
+ *		as the last line, with an id from enum ISR_STATS_IDS.
+ *		Handlers must not return early between BEGIN and END.
+ * 6.)	Statistics take about 500 bytes of RAM with the defaults.
+ *		Lower ISR_STATS_BUCKETS if that is too much.
+ */
+
+// Identifies each interrupt source.  Only the timer1 sources (before ISR_ID_TMR0_OVF) record latency.
+enum ISR_STATS_IDS { ISR_ID_TMR1_CAPT, ISR_ID_TMR1_COMPA, ISR_ID_TMR1_COMPB, ISR_ID_TMR1_OVF,
+	ISR_ID_TMR0_OVF, ISR_ID_TMR0_COMP, ISR_ID_TMR2_COMP, ISR_ID_TMR2_OVF, ISR_ID_ADC,
+	ISR_ID_USART_RX, ISR_ID_USART_UDRE, ISR_ID_TWI, ISR_ID_SPI, ISR_ID_SPI_SS, ISR_ID_COUNT };
+
+#define ISR_STATS_LATENCY_IDS (ISR_ID_TMR1_OVF + 1)
+
+#ifndef ISR_STATS_BUCKETS
+#define ISR_STATS_BUCKETS 12
+#endif
+
+#ifdef ISR_STATS_ENABLE
+
+#include <avr/io.h>
+
+#include "dump_utils.h"
+
+// Snapshot of one interrupt source, see isrStats_get
+struct isr_stats {
+	unsigned long count; // Times the handler ran
+	unsigned short maxExec; // Longest execution time in ticks
+	unsigned short maxLatency; // Longest latency in ticks, timer1 sources only
+	unsigned short exec[ISR_STATS_BUCKETS];
+	unsigned short latency[ISR_STATS_BUCKETS]; // All 0 for sources without a timestamp
+};
+
+//**************************USER AREA***************************
+
+// First line of a handler: samples the handler start time
+#define ISR_STATS_BEGIN(id)				unsigned short isrStats_start = TCNT1
+// Record the time since the 16-bit timer1 event stamp
+#define ISR_STATS_LATENCY(id, stamp)	isrStats_addLatency(id, isrStats_start - (unsigned short)(stamp))
+// Last line of a handler: records the execution time
+#define ISR_STATS_END(id)				isrStats_addExec(id, TCNT1 - isrStats_start)
+
+/** Copy the statistics of one interrupt source.
+ *  @param id		One of the enum ISR_STATS_IDS values
+ *  @param stats	Destination for the statistics
+ */
+void isrStats_get(unsigned char id, struct isr_stats *stats);
+
+/** Clear the statistics of all interrupt sources.
+ */
+void isrStats_reset();
+
+/** Write the statistics of every source that has run through dump_utils.h.
+ *  One line per histogram: name, exec or lat, count, max ticks and the
+ *  bucket counts, tab separated.
+ */
+void isrStats_dump();
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned long isrStats_count[ISR_ID_COUNT];
+static unsigned short isrStats_maxExec[ISR_ID_COUNT];
+static unsigned short isrStats_exec[ISR_ID_COUNT][ISR_STATS_BUCKETS];
+static unsigned short isrStats_maxLatency[ISR_STATS_LATENCY_IDS];
+static unsigned short isrStats_latency[ISR_STATS_LATENCY_IDS][ISR_STATS_BUCKETS];
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the statistics
+ * macros only and is not intended to be used as a stand
+ * alone library function.  Returns the log2 bucket. */
+static inline unsigned char isrStats_bucket(unsigned short ticks) {
+	unsigned char bucket = 0;
+
+	if(ticks >> 8) {
+		bucket = 8;
+		ticks >>= 8;
+	}
+	while(ticks) {
+		++bucket;
+		ticks >>= 1;
+	}
+	return bucket < ISR_STATS_BUCKETS ? bucket : ISR_STATS_BUCKETS - 1;
+}
+
+static inline void isrStats_addExec(unsigned char id, unsigned short ticks) {
+	unsigned short *bucket = &isrStats_exec[id][isrStats_bucket(ticks)];
+
+	++isrStats_count[id];
+	if(ticks > isrStats_maxExec[id])
+		isrStats_maxExec[id] = ticks;
+	if(*bucket != 0xFFFF)
+		++*bucket;
+}
+
+static inline void isrStats_addLatency(unsigned char id, unsigned short ticks) {
+	unsigned short *bucket = &isrStats_latency[id][isrStats_bucket(ticks)];
+
+	if(ticks > isrStats_maxLatency[id])
+		isrStats_maxLatency[id] = ticks;
+	if(*bucket != 0xFFFF)
+		++*bucket;
+}
+
+void isrStats_get(unsigned char id, struct isr_stats *stats) {
+	unsigned char i, sreg;
+
+	if(id >= ISR_ID_COUNT)
+		return;
+	sreg = SREG;
+	SREG &= 0x7F;
+	stats->count = isrStats_count[id];
+	stats->maxExec = isrStats_maxExec[id];
+	stats->maxLatency = id < ISR_STATS_LATENCY_IDS ? isrStats_maxLatency[id] : 0;
+	for(i = 0; i < ISR_STATS_BUCKETS; ++i) {
+		stats->exec[i] = isrStats_exec[id][i];
+		stats->latency[i] = id < ISR_STATS_LATENCY_IDS ? isrStats_latency[id][i] : 0;
+	}
+	SREG = sreg;
+}
+
+void isrStats_reset() {
+	unsigned char id, i, sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	for(id = 0; id < ISR_ID_COUNT; ++id) {
+		isrStats_count[id] = 0;
+		isrStats_maxExec[id] = 0;
+		for(i = 0; i < ISR_STATS_BUCKETS; ++i)
+			isrStats_exec[id][i] = 0;
+	}
+	for(id = 0; id < ISR_STATS_LATENCY_IDS; ++id) {
+		isrStats_maxLatency[id] = 0;
+		for(i = 0; i < ISR_STATS_BUCKETS; ++i)
+			isrStats_latency[id][i] = 0;
+	}
+	SREG = sreg;
+}
+
+/* This function is designed to be used by isrStats_dump
+ * only and is not intended to be used as a stand alone
+ * library function. */
+void isrStats_dumpLine(const char *name, const char *kind, unsigned long count,
+	unsigned short max, const unsigned short *buckets) {
+	unsigned char i;
+
+	dump_string(name);
+	dump_char('\t');
+	dump_string(kind);
+	dump_char('\t');
+	dump_ulong(count);
+	dump_char('\t');
+	dump_ulong(max);
+	for(i = 0; i < ISR_STATS_BUCKETS; ++i) {
+		dump_char('\t');
+		dump_ulong(buckets[i]);
+	}
+	dump_newline();
+}
+
+void isrStats_dump() {
+	static const char *const NAMES[ISR_ID_COUNT] = { "TMR1_CAPT", "TMR1_COMPA", "TMR1_COMPB",
+		"TMR1_OVF", "TMR0_OVF", "TMR0_COMP", "TMR2_COMP", "TMR2_OVF", "ADC", "USART_RX",
+		"USART_UDRE", "TWI", "SPI", "SPI_SS" };
+	struct isr_stats stats;
+	unsigned char id;
+
+	for(id = 0; id < ISR_ID_COUNT; ++id) {
+		isrStats_get(id, &stats);
+		if(!stats.count)
+			continue;
+		isrStats_dumpLine(NAMES[id], "exec", stats.count, stats.maxExec, stats.exec);
+		if(id < ISR_STATS_LATENCY_IDS)
+			isrStats_dumpLine(NAMES[id], "lat", stats.count, stats.maxLatency, stats.latency);
+	}
+}
+
+#else
+
+#define ISR_STATS_BEGIN(id)				((void)0)
+#define ISR_STATS_LATENCY(id, stamp)	((void)0)
+#define ISR_STATS_END(id)				((void)0)
+
+#endif
+
+#endif
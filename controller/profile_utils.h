@@ -0,0 +1,197 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Cycle counting profiler for hot code paths.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef PROFILE_UTILS_H
+#define PROFILE_UTILS_H
+
+/* USE NOTES:
+ * 1.)	Define PROFILE_ENABLE before including this file to turn
+ *		the profiler on.  Without it every PROFILE_ macro below
+ *		expands to nothing, so the markers can stay in release
+ *		builds.
+ * 2.)	Sections are numbered 0 to PROFILE_MAX_SECTIONS - 1; an enum
+ *		of section names in the application works well.  Wrap the
+ *		code with PROFILE_BEGIN(id) and PROFILE_END(id).
+ * 3.)	The markers sample timer1, which must be free running from
+ *		clock_init.  Use TMR_PRESCALER_OFF for cycle resolution;
+ *		with other prescalers the results are still reported in
+ *		cycles but are only as fine as one timer tick.  A section
+ *		must be shorter than 65536 timer ticks (8ms at 8MHz with
+ *		no prescaler).
+ * 4.)	A marker costs about a dozen cycles for the begin and a few
+ *		dozen for the end.  PROFILE_INIT measures the time between
+ *		the two timer reads and subtracts it from every result,
+ *		so an empty section reads close to 0 cycles.
+ * 5.)	Each section must only be used from one context: either
+ *		from the main loop or from one ISR.  Sections may nest
+ *		or overlap as long as their ids differ.
+ * 6.)	PROFILE_DUMP writes one tab separated line per section
+ *		that has run through dump_utils.h:
+ *		id, name, count, min, max, total and average cycles.
+ *		Totals wrap after 2^32 cycles (9 minutes of busy time at
+ *		8MHz); use PROFILE_RESET between runs.
+ */
+
+#ifndef PROFILE_MAX_SECTIONS
+#define PROFILE_MAX_SECTIONS 8
+#endif
+
+#ifdef PROFILE_ENABLE
+
+#include <avr/io.h>
+
+#include "clock_utils.h"
+#include "dump_utils.h"
+
+//**************************USER AREA***************************
+
+// Measure the marker overhead and clear the table.  Call after clock_init.
+#define PROFILE_INIT()			profile_init()
+// Mark the start of section id
+#define PROFILE_BEGIN(id)		profile_begin(id)
+// Mark the end of section id and add the time since PROFILE_BEGIN to its statistics
+#define PROFILE_END(id)			profile_end(id)
+// Give section id a name (string literal) for PROFILE_DUMP
+#define PROFILE_NAME(id, name)	profile_setName(id, name)
+// Write the statistics table through dump_utils.h
+#define PROFILE_DUMP()			profile_dump()
+// Clear the statistics, names are kept
+#define PROFILE_RESET()			profile_reset()
+
+//****************************END USER AREA**************************************
+
+// Statistics for one section, in timer1 ticks
+struct profile_section {
+	unsigned short start;
+	unsigned short min;
+	unsigned short max;
+	unsigned long count;
+	unsigned long total;
+	const char *name;
+};
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static struct profile_section profile_sections[PROFILE_MAX_SECTIONS];
+static unsigned short profile_overhead = 0; // Ticks between the begin and end timer reads
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the profiler
+ * markers only and is not intended to be used as a stand
+ * alone library function.  A 16-bit timer read must not be
+ * split by an ISR that touches another timer1 register. */
+static inline unsigned short profile_stamp() {
+	unsigned char sreg;
+	unsigned short now;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	now = TCNT1;
+	SREG = sreg;
+	return now;
+}
+
+static inline void profile_begin(unsigned char id) {
+	profile_sections[id].start = profile_stamp();
+}
+
+static inline void profile_end(unsigned char id) {
+	unsigned short elapsed = profile_stamp();
+	struct profile_section *section = &profile_sections[id];
+
+	elapsed -= section->start;
+	elapsed = elapsed > profile_overhead ? elapsed - profile_overhead : 0;
+	if(elapsed < section->min)
+		section->min = elapsed;
+	if(elapsed > section->max)
+		section->max = elapsed;
+	++section->count;
+	section->total += elapsed;
+}
+
+void profile_reset() {
+	unsigned char i;
+
+	for(i = 0; i < PROFILE_MAX_SECTIONS; ++i) {
+		profile_sections[i].min = 0xFFFF;
+		profile_sections[i].max = 0;
+		profile_sections[i].count = 0;
+		profile_sections[i].total = 0;
+	}
+}
+
+void profile_init() {
+	unsigned char i;
+	unsigned short first, elapsed;
+
+	profile_overhead = 0xFFFF;
+	for(i = 0; i < 8; ++i) {
+		first = profile_stamp();
+		elapsed = profile_stamp() - first;
+		if(elapsed < profile_overhead)
+			profile_overhead = elapsed;
+	}
+	for(i = 0; i < PROFILE_MAX_SECTIONS; ++i)
+		profile_sections[i].name = 0;
+	profile_reset();
+}
+
+void profile_setName(unsigned char id, const char *name) {
+	profile_sections[id].name = name;
+}
+
+void profile_dump() {
+	struct profile_section section;
+	unsigned short divider = clock_getDivider();
+	unsigned char i, sreg;
+
+	dump_string("id\tname\tcount\tmin\tmax\ttotal\tavg");
+	dump_newline();
+	for(i = 0; i < PROFILE_MAX_SECTIONS; ++i) {
+		// An ISR section may update while we copy it
+		sreg = SREG;
+		SREG &= 0x7F;
+		section = profile_sections[i];
+		SREG = sreg;
+		if(!section.count)
+			continue;
+
+		dump_ulong(i);
+		dump_char('\t');
+		dump_string(section.name ? section.name : "-");
+		dump_char('\t');
+		dump_ulong(section.count);
+		dump_char('\t');
+		dump_ulong((unsigned long)section.min * divider);
+		dump_char('\t');
+		dump_ulong((unsigned long)section.max * divider);
+		dump_char('\t');
+		dump_ulong(section.total * divider);
+		dump_char('\t');
+		dump_ulong(section.total * divider / section.count);
+		dump_newline();
+	}
+}
+
+#else
+
+#define PROFILE_INIT()			((void)0)
+#define PROFILE_BEGIN(id)		((void)0)
+#define PROFILE_END(id)			((void)0)
+#define PROFILE_NAME(id, name)	((void)0)
+#define PROFILE_DUMP()			((void)0)
+#define PROFILE_RESET()			((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,292 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Real time clock on timer2 driven by a 32.768kHz watch crystal.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef RTC_UTILS_H
+#define RTC_UTILS_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "timer_utils.c"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	Fit a 32.768kHz crystal to TOSC1/TOSC2 (PC6/PC7).  The RTC
+ *		takes ownership of timer2's counter, prescaler and overflow
+ *		interrupt (TIMER2_OVF_vect): the crystal divided by 128
+ *		overflows the 8-bit counter exactly once per second.  It
+ *		cannot be used together with dds_gen.h.
+ * 2.)	The compare unit and TIMER2_COMP_vect are left free.
+ *		idle_utils.h detects the running RTC and reuses it for
+ *		power-save deadlines.
+ * 3.)	Time is kept as seconds since 2000-01-01 00:00:00 and only
+ *		turned into a calendar date when read, so the interrupt
+ *		is a counter increment and an alarm compare.  Valid until
+ *		2136.
+ * 4.)	The crystal needs up to a second to stabilize after power
+ *		up.  Allow for this before relying on the time.
+ * 5.)	Registers of an asynchronous timer2 are written through
+ *		temporary registers that take up to two crystal cycles to
+ *		transfer.  All writes here wait on the ASSR busy flags;
+ *		do the same (waitOnTmr2Busy) if you touch TCNT2, OCR2 or
+ *		TCCR2 yourself.
+ * 6.)	rtc_sleep puts the MCU into power-save, where only timer2
+ *		and asynchronous wakeup sources keep running.  A logger
+ *		that calls it in its main loop wakes once per second, for
+ *		as long as its work takes, and sleeps the rest.
+ */
+
+// Calendar time, see rtc_getTime
+struct rtc_time {
+	unsigned char second; // 0 - 59
+	unsigned char minute; // 0 - 59
+	unsigned char hour; // 0 - 23
+	unsigned char day; // 1 - 31
+	unsigned char month; // 1 - 12
+	unsigned short year; // 2000 - 2135
+	unsigned char weekday; // 0 == Sunday, 6 == Saturday
+};
+
+//**************************USER AREA***************************
+
+/** Switch timer2 to the crystal and start counting seconds from 0
+ *  (2000-01-01 00:00:00).  Enables the overflow interrupt; global
+ *  interrupts must be enabled for the clock to run.
+ */
+void rtc_init();
+
+/** @return	Seconds since 2000-01-01 00:00:00
+ */
+unsigned long rtc_getSeconds();
+
+/** Set the time and restart the current second.
+ *  @param seconds	Seconds since 2000-01-01 00:00:00
+ */
+void rtc_setSeconds(unsigned long seconds);
+
+/** @param time	Destination for the current calendar time
+ */
+void rtc_getTime(struct rtc_time *time);
+
+/** Set the time from a calendar time.  The weekday field is ignored.
+ *  @param time	New calendar time
+ */
+void rtc_setTime(const struct rtc_time *time);
+
+/** Convert a calendar time to seconds since 2000-01-01 00:00:00.
+ *  @param time	Calendar time, the weekday field is ignored
+ *  @return		Seconds since 2000-01-01 00:00:00
+ */
+unsigned long rtc_toSeconds(const struct rtc_time *time);
+
+/** Convert seconds since 2000-01-01 00:00:00 to a calendar time.
+ *  @param seconds	Seconds since 2000-01-01 00:00:00
+ *  @param time		Destination for the calendar time
+ */
+void rtc_fromSeconds(unsigned long seconds, struct rtc_time *time);
+
+/** Arm the alarm.  The alarm fires once, when the clock reaches the given second.
+ *  @param seconds	Alarm time in seconds since 2000-01-01 00:00:00
+ */
+void rtc_setAlarm(unsigned long seconds);
+
+/** Disarm the alarm and clear a pending alarm.
+ */
+void rtc_clearAlarm();
+
+/** @return	1 once after the alarm has fired, 0 else
+ */
+unsigned char rtc_alarmFired();
+
+/** Sleep in power-save mode until the next interrupt, at the latest
+ *  the next second.  Returns with global interrupts enabled.
+ */
+void rtc_sleep();
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static volatile unsigned long rtc_seconds = 0;
+static volatile unsigned long rtc_alarm = 0;
+static volatile unsigned char rtc_alarmArmed = 0;
+static volatile unsigned char rtc_alarmFlag = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+ISR(TIMER2_OVF_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TMR2_OVF);
+	++rtc_seconds;
+	if(rtc_alarmArmed && rtc_seconds == rtc_alarm) {
+		rtc_alarmArmed = 0;
+		rtc_alarmFlag = 1;
+	}
+	ISR_STATS_END(ISR_ID_TMR2_OVF);
+}
+
+void rtc_init() {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	startAsyncTmr2(TMR2_PRESCALER_128TH);
+	rtc_seconds = 0;
+	rtc_alarmArmed = 0;
+	rtc_alarmFlag = 0;
+	enableTmr2Interrupts(TMR02_OVERFLOW_INTERRUPT, 1);
+	SREG = sreg;
+}
+
+unsigned long rtc_getSeconds() {
+	unsigned char sreg;
+	unsigned long seconds;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	seconds = rtc_seconds;
+	SREG = sreg;
+	return seconds;
+}
+
+void rtc_setSeconds(unsigned long seconds) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	waitOnTmr2Busy();
+	TCNT2 = 0;
+	resetTmr2Prescaler();
+	waitOnTmr2Busy();
+	TIFR = (1 << TOV2);
+	rtc_seconds = seconds;
+	SREG = sreg;
+}
+
+void rtc_getTime(struct rtc_time *time) {
+	rtc_fromSeconds(rtc_getSeconds(), time);
+}
+
+void rtc_setTime(const struct rtc_time *time) {
+	rtc_setSeconds(rtc_toSeconds(time));
+}
+
+/* This function is designed to be used by the rtc
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned char rtc_isLeapYear(unsigned short year) {
+	return (!(year % 4) && (year % 100)) || !(year % 400);
+}
+
+/* This function is designed to be used by the rtc
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned char rtc_daysInMonth(unsigned char month, unsigned short year) {
+	static const unsigned char DAYS[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	if(month == 2 && rtc_isLeapYear(year))
+		return 29;
+	return DAYS[month - 1];
+}
+
+unsigned long rtc_toSeconds(const struct rtc_time *time) {
+	unsigned long days = 0;
+	unsigned short year;
+	unsigned char month;
+
+	for(year = 2000; year < time->year; ++year)
+		days += rtc_isLeapYear(year) ? 366 : 365;
+	for(month = 1; month < time->month; ++month)
+		days += rtc_daysInMonth(month, time->year);
+	days += time->day - 1;
+	return ((days * 24 + time->hour) * 60 + time->minute) * 60 + time->second;
+}
+
+void rtc_fromSeconds(unsigned long seconds, struct rtc_time *time) {
+	unsigned long days;
+	unsigned short yearDays;
+	unsigned char monthDays;
+
+	time->second = seconds % 60;
+	seconds /= 60;
+	time->minute = seconds % 60;
+	seconds /= 60;
+	time->hour = seconds % 24;
+	days = seconds / 24;
+	time->weekday = (days + 6) % 7; // 2000-01-01 was a Saturday
+
+	time->year = 2000;
+	for(;;) {
+		yearDays = rtc_isLeapYear(time->year) ? 366 : 365;
+		if(days < yearDays)
+			break;
+		days -= yearDays;
+		++time->year;
+	}
+	time->month = 1;
+	for(;;) {
+		monthDays = rtc_daysInMonth(time->month, time->year);
+		if(days < monthDays)
+			break;
+		days -= monthDays;
+		++time->month;
+	}
+	time->day = days + 1;
+}
+
+void rtc_setAlarm(unsigned long seconds) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	rtc_alarm = seconds;
+	rtc_alarmFlag = 0;
+	rtc_alarmArmed = 1;
+	SREG = sreg;
+}
+
+void rtc_clearAlarm() {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	rtc_alarmArmed = 0;
+	rtc_alarmFlag = 0;
+	SREG = sreg;
+}
+
+unsigned char rtc_alarmFired() {
+	unsigned char sreg, fired;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	fired = rtc_alarmFlag;
+	rtc_alarmFlag = 0;
+	SREG = sreg;
+	return fired;
+}
+
+void rtc_sleep() {
+	cli();
+	/* After a timer2 wakeup the interrupt logic needs one crystal
+	 * cycle to reset or the MCU cannot wake again.  A dummy OCR2
+	 * write that has completed guarantees it. */
+	OCR2 = OCR2;
+	waitOnTmr2Busy();
+	set_sleep_mode(SLEEP_MODE_PWR_SAVE);
+	sleep_enable();
+	sei(); // The instruction following sei is always executed before an interrupt
+	sleep_cpu();
+	sleep_disable();
+}
+
+#endif
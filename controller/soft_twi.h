@@ -0,0 +1,449 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Bit banged I2C master on any two port pins, a second bus next to
+ * the TWI unit.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Choose the pins by defining SOFT_TWI_PORT, SOFT_TWI_DDR,
+ *		SOFT_TWI_PIN, SOFT_TWI_SCL and SOFT_TWI_SDA before including
+ *		this file (default PB0 = SCL, PB1 = SDA).  They are compile
+ *		time constants, so every line change is one sbi/cbi on the
+ *		DDR register.  Both lines need pull-up resistors like the
+ *		TWI bus; the pins are never driven high.
+ * 2.)	The calls mirror twi_utils.h with a softTwi_ prefix and set
+ *		the same TWI_MSTR_STAT_ status codes, so code written for
+ *		the TWI ports over by renaming the calls.  One difference:
+ *		every call completes before it returns.  softTwi_receiveAck
+ *		and softTwi_receiveNack clock in a byte, (not) acknowledge it
+ *		and return it, and softTwi_waitOnBusy never waits.
+ * 3.)	SOFT_TWI_SCL_HZ sets the bit rate (default 100kHz).  Each
+ *		half period is a _delay_us of 500000 / SOFT_TWI_SCL_HZ, so the
+ *		real rate is a little lower because of the instructions in
+ *		between; at 8MHz expect roughly 90kHz for 100kHz.  Interrupts
+ *		only stretch the bus, they never corrupt it.
+ * 4.)	Slaves may stretch the clock: after SCL is released it is read
+ *		back until it goes high, for at most SOFT_TWI_STRETCH_LIMIT
+ *		polls.  A slave that holds SCL longer ends the transfer with
+ *		TWI_STAT_BUS_ERR.
+ * 5.)	If SDA reads low while sending a 1 another master has won
+ *		the bus: the call stops with TWI_MSTR_STAT_ARBITRATION_LOST
+ *		and the lines are released.
+ * 6.)	Two devices with the same fixed address (ie. two nunchucks)
+ *		can be used by putting one on the TWI and one here.
+ */
+
+#ifndef SOFT_TWI_H
+#define SOFT_TWI_H
+
+#include <avr/io.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include <util/delay.h>
+
+#include "twi_utils.h"
+
+#ifndef SOFT_TWI_PORT
+#define SOFT_TWI_PORT	PORTB
+#define SOFT_TWI_DDR	DDRB
+#define SOFT_TWI_PIN	PINB
+#define SOFT_TWI_SCL	PB0
+#define SOFT_TWI_SDA	PB1
+#endif
+
+#ifndef SOFT_TWI_SCL_HZ
+#define SOFT_TWI_SCL_HZ 100000UL
+#endif
+
+// Polls of SCL before a stretched clock counts as a stuck bus
+#ifndef SOFT_TWI_STRETCH_LIMIT
+#define SOFT_TWI_STRETCH_LIMIT 10000
+#endif
+
+//**************************USER AREA***************************
+
+/** Release both lines and reset the status.
+ */
+void softTwi_init();
+
+/** @return	Always 0, every call completes before it returns
+ */
+unsigned char softTwi_isBusy();
+
+/** Nothing to wait for, kept so twi_utils.h sequences port over unchanged.
+ *  @return	1
+ */
+unsigned char softTwi_waitOnBusy();
+
+/** Checks against the status of the last call.
+ *  @return 1 == status confirmed, 0 == not confirmed
+ */
+unsigned char softTwi_confirmStatus(unsigned char statCode);
+
+/** Send START, or a repeated START if the bus is already ours.
+ */
+void softTwi_sendStart();
+
+/** Send STOP and release the bus.
+ */
+void softTwi_sendStop();
+
+/** Contact a particular slave and indicate whether you want to read or write from/to it
+ *  @param slaveAddress	The unique address of the slave you want to reach. Values [0, 127]
+ *  @param read			0 for write request, all else for read
+ */
+void softTwi_addressSlave(unsigned char slaveAddress, unsigned char read);
+
+/** Send one byte.
+ *  @param data		Byte to send
+ */
+void softTwi_transmitUchar(unsigned char data);
+
+/** @return	The next byte from the slave, acknowledged so the slave sends more
+ */
+unsigned char softTwi_receiveAck();
+
+/** @return	The next byte from the slave, not acknowledged, ending the read
+ */
+unsigned char softTwi_receiveNack();
+
+/** As twi_writeRead on the software bus.
+ */
+unsigned char softTwi_writeRead(unsigned char slaveAddress, const unsigned char *writeBuf,
+	unsigned char writeLen, unsigned char *readBuf, unsigned char readLen);
+
+/** As twi_write_regs on the software bus.
+ */
+unsigned char softTwi_write_regs(unsigned char slaveAddress, unsigned char reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize);
+
+/** As twi_read_regs on the software bus.
+ */
+unsigned char softTwi_read_regs(unsigned char slaveAddress, unsigned char reg,
+	unsigned char *buf, unsigned short len);
+
+/** As twi_write_regs16 on the software bus.
+ */
+unsigned char softTwi_write_regs16(unsigned char slaveAddress, unsigned short reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize);
+
+/** As twi_read_regs16 on the software bus.
+ */
+unsigned char softTwi_read_regs16(unsigned char slaveAddress, unsigned short reg,
+	unsigned char *buf, unsigned short len);
+
+//****************************END USER AREA**************************************
+
+#define SOFT_TWI_HALF_US	(500000.0 / SOFT_TWI_SCL_HZ)
+
+// Open drain line control: output low pulls the line down, input lets the pull-up raise it
+#define SOFT_TWI_SCL_LOW()		(SOFT_TWI_DDR |= (1 << SOFT_TWI_SCL))
+#define SOFT_TWI_SCL_RELEASE()	(SOFT_TWI_DDR &= ~(1 << SOFT_TWI_SCL))
+#define SOFT_TWI_SDA_LOW()		(SOFT_TWI_DDR |= (1 << SOFT_TWI_SDA))
+#define SOFT_TWI_SDA_RELEASE()	(SOFT_TWI_DDR &= ~(1 << SOFT_TWI_SDA))
+#define SOFT_TWI_SCL_IS_HIGH()	(SOFT_TWI_PIN & (1 << SOFT_TWI_SCL))
+#define SOFT_TWI_SDA_IS_HIGH()	(SOFT_TWI_PIN & (1 << SOFT_TWI_SDA))
+#define SOFT_TWI_DELAY()		_delay_us(SOFT_TWI_HALF_US)
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned char softTwi_status = 0xF8; // TWI_STAT_NO_INFO_AVAIL
+static unsigned char softTwi_owner = 0; // 1 between START and STOP
+static unsigned char softTwi_data = 0; // Last byte softTwi_receiveStart clocked in
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the software
+ * bus functions only and is not intended to be used as a
+ * stand alone library function.  Releases SCL and waits
+ * out clock stretching.  Returns 0 if SCL stays low. */
+static inline unsigned char softTwi_sclHigh() {
+	unsigned short polls = SOFT_TWI_STRETCH_LIMIT;
+
+	SOFT_TWI_SCL_RELEASE();
+	while(!SOFT_TWI_SCL_IS_HIGH()) {
+		if(!--polls)
+			return 0;
+	}
+	return 1;
+}
+
+/* This function is designed to be used by the software
+ * bus functions only and is not intended to be used as a
+ * stand alone library function.  Gives up the bus after an
+ * error without generating a STOP. */
+void softTwi_abort(unsigned char status) {
+	SOFT_TWI_SDA_RELEASE();
+	SOFT_TWI_SCL_RELEASE();
+	softTwi_status = status;
+	softTwi_owner = 0;
+}
+
+/* This function is designed to be used by the software
+ * bus functions only and is not intended to be used as a
+ * stand alone library function.  Clocks out a byte with
+ * SCL low on entry and exit.
+ * @return	1 if the slave acknowledged, 0 if not or on error */
+unsigned char softTwi_writeByte(unsigned char data) {
+	unsigned char bit, ack;
+
+	for(bit = 0x80; bit; bit >>= 1) {
+		if(data & bit)
+			SOFT_TWI_SDA_RELEASE();
+		else
+			SOFT_TWI_SDA_LOW();
+		SOFT_TWI_DELAY();
+		if(!softTwi_sclHigh()) {
+			softTwi_abort(TWI_STAT_BUS_ERR);
+			return 0;
+		}
+		if((data & bit) && !SOFT_TWI_SDA_IS_HIGH()) {
+			softTwi_abort(TWI_MSTR_STAT_ARBITRATION_LOST);
+			return 0;
+		}
+		SOFT_TWI_DELAY();
+		SOFT_TWI_SCL_LOW();
+	}
+
+	SOFT_TWI_SDA_RELEASE();
+	SOFT_TWI_DELAY();
+	if(!softTwi_sclHigh()) {
+		softTwi_abort(TWI_STAT_BUS_ERR);
+		return 0;
+	}
+	ack = !SOFT_TWI_SDA_IS_HIGH();
+	SOFT_TWI_DELAY();
+	SOFT_TWI_SCL_LOW();
+	return ack;
+}
+
+/* This function is designed to be used by the software
+ * bus functions only and is not intended to be used as a
+ * stand alone library function.  Clocks in a byte and
+ * answers with ACK or NACK, SCL low on entry and exit. */
+unsigned char softTwi_readByte(unsigned char ack) {
+	unsigned char bit, data = 0;
+
+	SOFT_TWI_SDA_RELEASE();
+	for(bit = 0; bit < 8; ++bit) {
+		SOFT_TWI_DELAY();
+		if(!softTwi_sclHigh()) {
+			softTwi_abort(TWI_STAT_BUS_ERR);
+			return 0;
+		}
+		data <<= 1;
+		if(SOFT_TWI_SDA_IS_HIGH())
+			data |= 0x01;
+		SOFT_TWI_DELAY();
+		SOFT_TWI_SCL_LOW();
+	}
+
+	if(ack)
+		SOFT_TWI_SDA_LOW();
+	SOFT_TWI_DELAY();
+	if(!softTwi_sclHigh()) {
+		softTwi_abort(TWI_STAT_BUS_ERR);
+		return 0;
+	}
+	SOFT_TWI_DELAY();
+	SOFT_TWI_SCL_LOW();
+	SOFT_TWI_SDA_RELEASE();
+	softTwi_status = ack ? TWI_MSTR_STAT_DATA_RECEIVE_ACK : TWI_MSTR_STAT_DATA_RECEIVE_NACK;
+	return data;
+}
+
+void softTwi_init() {
+	SOFT_TWI_PORT &= ~((1 << SOFT_TWI_SCL) | (1 << SOFT_TWI_SDA));
+	SOFT_TWI_SDA_RELEASE();
+	SOFT_TWI_SCL_RELEASE();
+	softTwi_status = TWI_STAT_NO_INFO_AVAIL;
+	softTwi_owner = 0;
+}
+
+unsigned char softTwi_isBusy() {
+	return 0;
+}
+
+unsigned char softTwi_waitOnBusy() {
+	return 1;
+}
+
+unsigned char softTwi_confirmStatus(unsigned char statCode) {
+	return softTwi_status == statCode;
+}
+
+void softTwi_sendStart() {
+	unsigned char restart = softTwi_owner;
+
+	if(restart) {
+		SOFT_TWI_SDA_RELEASE();
+		SOFT_TWI_DELAY();
+		if(!softTwi_sclHigh()) {
+			softTwi_abort(TWI_STAT_BUS_ERR);
+			return;
+		}
+		SOFT_TWI_DELAY();
+	}
+	else if(!SOFT_TWI_SCL_IS_HIGH() || !SOFT_TWI_SDA_IS_HIGH()) {
+		// Someone else is using the bus
+		softTwi_abort(TWI_MSTR_STAT_ARBITRATION_LOST);
+		return;
+	}
+
+	// START: SDA falls while SCL is high
+	SOFT_TWI_SDA_LOW();
+	SOFT_TWI_DELAY();
+	SOFT_TWI_SCL_LOW();
+	softTwi_owner = 1;
+	softTwi_status = restart ? TWI_MSTR_STAT_RESTART_TRANSMITTED : TWI_MSTR_STAT_START_TRANSMITTED;
+}
+
+void softTwi_sendStop() {
+	// STOP: SDA rises while SCL is high
+	SOFT_TWI_SDA_LOW();
+	SOFT_TWI_DELAY();
+	softTwi_sclHigh();
+	SOFT_TWI_DELAY();
+	SOFT_TWI_SDA_RELEASE();
+	SOFT_TWI_DELAY();
+	softTwi_owner = 0;
+	softTwi_status = TWI_STAT_NO_INFO_AVAIL;
+}
+
+void softTwi_addressSlave(unsigned char slaveAddress, unsigned char read) {
+	unsigned char ack;
+
+	if(!softTwi_owner)
+		return;
+	ack = softTwi_writeByte((slaveAddress << 1) | (read == TWI_READ));
+	if(!softTwi_owner)
+		return;
+	if(read == TWI_READ)
+		softTwi_status = ack ? TWI_MSTR_STAT_SLA_R_ACK : TWI_MSTR_STAT_SLA_R_NACK;
+	else
+		softTwi_status = ack ? TWI_MSTR_STAT_SLA_W_ACK : TWI_MSTR_STAT_SLA_W_NACK;
+}
+
+void softTwi_transmitUchar(unsigned char data) {
+	unsigned char ack;
+
+	if(!softTwi_owner)
+		return;
+	ack = softTwi_writeByte(data);
+	if(softTwi_owner)
+		softTwi_status = ack ? TWI_MSTR_STAT_DATA_SEND_ACK : TWI_MSTR_STAT_DATA_SEND_NACK;
+}
+
+unsigned char softTwi_receiveAck() {
+	return softTwi_owner ? softTwi_readByte(1) : 0;
+}
+
+unsigned char softTwi_receiveNack() {
+	return softTwi_owner ? softTwi_readByte(0) : 0;
+}
+
+/* This function is designed to be used by the software
+ * bus functions only and is not intended to be used as a
+ * stand alone library function.  Sends STOP unless the bus
+ * was lost, then reports failure. */
+unsigned char softTwi_fail() {
+	if(softTwi_owner)
+		softTwi_sendStop();
+	return 0;
+}
+
+unsigned char softTwi_writeRead(unsigned char slaveAddress, const unsigned char *writeBuf,
+	unsigned char writeLen, unsigned char *readBuf, unsigned char readLen) {
+	unsigned char i;
+
+	softTwi_sendStart();
+	if(!softTwi_owner)
+		return 0;
+
+	if(writeLen || !readLen) {
+		softTwi_addressSlave(slaveAddress, TWI_WRITE);
+		if(!softTwi_confirmStatus(TWI_MSTR_STAT_SLA_W_ACK))
+			return softTwi_fail();
+		for(i = 0; i < writeLen; ++i) {
+			softTwi_transmitUchar(writeBuf[i]);
+			if(!softTwi_confirmStatus(TWI_MSTR_STAT_DATA_SEND_ACK))
+				return softTwi_fail();
+		}
+		if(readLen) {
+			softTwi_sendStart(); // Repeated START, we still own the bus
+			if(!softTwi_owner)
+				return 0;
+		}
+	}
+
+	if(readLen) {
+		softTwi_addressSlave(slaveAddress, TWI_READ);
+		if(!softTwi_confirmStatus(TWI_MSTR_STAT_SLA_R_ACK))
+			return softTwi_fail();
+		// ACK every byte but the last so the slave releases the bus after it
+		for(i = 0; i + 1 < readLen && softTwi_owner; ++i)
+			readBuf[i] = softTwi_receiveAck();
+		readBuf[i] = softTwi_receiveNack();
+		if(!softTwi_owner)
+			return 0;
+	}
+
+	softTwi_sendStop();
+	return 1;
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  As twi_await: checks the
+ * status of the last call and releases the bus if it is not
+ * statCode. */
+unsigned char softTwi_await(unsigned char statCode) {
+	if(softTwi_status == statCode)
+		return 1;
+	return softTwi_fail();
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  As softTwi_await for a
+ * START, which may be a repeated START. */
+unsigned char softTwi_awaitStart() {
+	if(softTwi_status == TWI_MSTR_STAT_START_TRANSMITTED || softTwi_status == TWI_MSTR_STAT_RESTART_TRANSMITTED)
+		return 1;
+	return softTwi_fail();
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  Clocks in the next byte
+ * and answers it with ACK if ack is set, NACK else. */
+void softTwi_receiveStart(unsigned char ack) {
+	if(softTwi_owner)
+		softTwi_data = softTwi_readByte(ack);
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  The byte
+ * softTwi_receiveStart clocked in. */
+unsigned char softTwi_receivedData() {
+	return softTwi_data;
+}
+
+// Register burst functions, shared with twi_utils.h
+#define TWI_REGS_(name)		softTwi_##name
+#define TWI_REGS_BEGIN()	((void)0)
+#include "twi_regs.h"
+
+#endif
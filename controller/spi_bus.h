@@ -0,0 +1,194 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * SPI bus manager: device descriptors with their own mode, bit order
+ * and clock rate, and a bus lock.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef SPI_BUS_H
+#define SPI_BUS_H
+
+#include <avr/io.h>
+
+#include "spi_utils.h"
+
+/* USE NOTES:
+ * 1.)	Set up the master with initMasterSPI from spi_utils.h
+ *		first, with allowSlaveSwitch 0, then describe every chip
+ *		once with spiBus_deviceInit: its chip select pin, SPI mode,
+ *		bit order and prescaler.  The complete SPCR and SPSR values
+ *		are worked out then.
+ * 2.)	spiBus_select loads a device's settings, but only the
+ *		registers that differ from the settings loaded last, so
+ *		back to back accesses to devices with the same settings
+ *		never touch SPCR or SPSR.  The last settings are kept in
+ *		RAM; call spiBus_invalidate after changing SPCR or SPSR by
+ *		hand (ie. with setSPIprescaler or SPIbitOrder).
+ * 3.)	Wrap every access with spiBus_begin and spiBus_end.  Begin
+ *		takes the bus lock, selects the device's settings and
+ *		pulls its chip select low; end releases both.  Begin
+ *		returns 0 without waiting if the bus is in use, so it may
+ *		be called from an interrupt.  spiBus_acquire waits for the
+ *		bus instead; only call it from the main loop.
+ * 4.)	spi_master_async.h takes the same lock for as long as its
+ *		queue is running, so queued transfers and spiBus_begin
+ *		accesses never interleave.  Transfers queued while the
+ *		main loop holds the bus start when it calls spiBus_end.
+ */
+
+// Use for the mode argument of spiBus_deviceInit: clock polarity and phase
+enum SPI_MODES { SPI_MODE0, SPI_MODE1, SPI_MODE2, SPI_MODE3 };
+
+// A chip on the bus, set up with spiBus_deviceInit
+struct spi_device {
+	volatile unsigned char *port; // Port of the chip select pin
+	unsigned char csMask; // Chip select pin mask, ie. (1 << 1)
+	unsigned char spcr; // SPCR for the device, without SPIE
+	unsigned char spsr; // SPSR for the device (SPI2X)
+};
+
+//**************************USER AREA***************************
+
+/** Describe a chip and release its chip select.
+ *  @param dev			Descriptor to fill in
+ *  @param port			Port of the chip select pin, ie. &PORTC
+ *  @param ddr			Direction register of that port, ie. &DDRC
+ *  @param csMask		Chip select pin mask, ie. (1 << 1)
+ *  @param mode			enum SPI_MODES value
+ *  @param bitOrder		enum SPI_BIT_ORDER value
+ *  @param prescaler	enum SPI_PRESCALERS value
+ */
+void spiBus_deviceInit(struct spi_device *dev, volatile unsigned char *port,
+	volatile unsigned char *ddr, unsigned char csMask,
+	unsigned char mode, unsigned char bitOrder, unsigned char prescaler);
+
+/** Load a device's settings into SPCR and SPSR where they differ from the
+ *  settings loaded last.  Does not take the lock or touch chip select.
+ *  @param dev	Device descriptor
+ */
+void spiBus_select(const struct spi_device *dev);
+
+/** Forget the settings loaded last, so the next spiBus_select writes both registers.
+ */
+void spiBus_invalidate();
+
+/** Take the bus lock.
+ *  @return	1 if the bus was free and is now taken, 0 if it is in use
+ */
+unsigned char spiBus_tryLock();
+
+/** Release the bus lock and start any queued spi_master_async.h transfers.
+ */
+void spiBus_unlock();
+
+/** Take the bus if it is free, load the device's settings and select it.
+ *  @param dev	Device descriptor
+ *  @return		1 if the device is selected, 0 if the bus is in use
+ */
+unsigned char spiBus_begin(const struct spi_device *dev);
+
+/** Wait for the bus, then spiBus_begin.  Main loop only.
+ *  @param dev	Device descriptor
+ */
+void spiBus_acquire(const struct spi_device *dev);
+
+/** Release the device's chip select and the bus.
+ *  @param dev	Device descriptor passed to spiBus_begin
+ */
+void spiBus_end(const struct spi_device *dev);
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned char spiBus_spcr = 0; // SPCR loaded last, without SPIE; 0 is never a valid setting
+static unsigned char spiBus_spsr = 0xFF; // SPSR loaded last; 0xFF is never a valid setting
+static volatile unsigned char spiBus_locked = 0;
+static void (*spiBus_releaseHook)() = 0; // Set by spi_master_async.h
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+void spiBus_deviceInit(struct spi_device *dev, volatile unsigned char *port,
+	volatile unsigned char *ddr, unsigned char csMask,
+	unsigned char mode, unsigned char bitOrder, unsigned char prescaler) {
+	// SPR1:SPR0 and SPI2X for each enum SPI_PRESCALERS value
+	static const unsigned char SPR[] = { 0, 0, 1, 1, 2, 2, 3 };
+	static const unsigned char DOUBLE[] = { 1, 0, 1, 0, 1, 0, 0 };
+
+	if(prescaler > SPI_PRESCALER_128TH)
+		prescaler = SPI_PRESCALER_QTR;
+	dev->port = port;
+	dev->csMask = csMask;
+	dev->spcr = (1 << SPE) | (1 << MSTR) | ((mode & 0x03) << CPHA) | SPR[prescaler];
+	if(bitOrder == SPI_LSB_FIRST)
+		dev->spcr |= (1 << DORD);
+	dev->spsr = DOUBLE[prescaler] << SPI2X;
+	*port |= csMask;
+	*ddr |= csMask;
+}
+
+void spiBus_select(const struct spi_device *dev) {
+	if(dev->spcr != spiBus_spcr) {
+		SPCR = dev->spcr | (SPCR & (1 << SPIE));
+		spiBus_spcr = dev->spcr;
+	}
+	if(dev->spsr != spiBus_spsr) {
+		SPSR = dev->spsr;
+		spiBus_spsr = dev->spsr;
+	}
+}
+
+void spiBus_invalidate() {
+	spiBus_spcr = 0;
+	spiBus_spsr = 0xFF;
+}
+
+unsigned char spiBus_tryLock() {
+	unsigned char sreg, taken = 0;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	if(!spiBus_locked) {
+		spiBus_locked = 1;
+		taken = 1;
+	}
+	SREG = sreg;
+	return taken;
+}
+
+void spiBus_unlock() {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	spiBus_locked = 0;
+	if(spiBus_releaseHook)
+		spiBus_releaseHook();
+	SREG = sreg;
+}
+
+unsigned char spiBus_begin(const struct spi_device *dev) {
+	if(!spiBus_tryLock())
+		return 0;
+	spiBus_select(dev);
+	*dev->port &= ~dev->csMask;
+	return 1;
+}
+
+void spiBus_acquire(const struct spi_device *dev) {
+	while(!spiBus_begin(dev))
+		continue;
+}
+
+void spiBus_end(const struct spi_device *dev) {
+	*dev->port |= dev->csMask;
+	spiBus_unlock();
+}
+
+#endif
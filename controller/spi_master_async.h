@@ -0,0 +1,225 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Interrupt driven SPI master that runs a queue of transfers, each
+ * with its own chip select pin.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef SPI_MASTER_ASYNC_H
+#define SPI_MASTER_ASYNC_H
+
+/* USE NOTES:
+ * 1.)	Set up the master with initMasterSPI from spi_utils.h
+ *		first, with allowSlaveSwitch 0, then call spiAsync_init.
+ *		The library takes ownership of the SPI interrupt
+ *		(SPI_STC_vect) and enables it only while its queue runs.
+ * 2.)	Describe every chip once with spiBus_deviceInit from
+ *		spi_bus.h.  Each transfer loads its device's SPI settings
+ *		before it starts (only where they differ).  The queue
+ *		holds the spi_bus.h lock while it runs, so blocking
+ *		accesses wrapped in spiBus_begin/spiBus_end cannot
+ *		interleave with it; a transfer submitted while the main
+ *		loop holds the bus starts at spiBus_end.
+ * 3.)	Fill in a struct spi_transaction with spiAsync_prepare and
+ *		pass it to spiAsync_submit.  The descriptor, its device and
+ *		its buffers belong to the library until spiAsync_isDone
+ *		returns 1, so keep them in static or otherwise long lived
+ *		memory.
+ * 4.)	A transaction pulls its device's chip select low, shifts
+ *		len bytes and releases chip select again.  Every byte sent
+ *		is a byte received: without a TX buffer 0xFF is sent,
+ *		without an RX buffer the received bytes are dropped.
+ * 5.)	The CPU is free while a byte shifts: at fck/2 the next byte
+ *		is due 16 cycles later, so the interrupt overhead roughly
+ *		halves the throughput at the highest rates.  Queued
+ *		transfers pay off at slower SCK or for long transfers that
+ *		would otherwise block.
+ * 6.)	The callback, if any, runs in interrupt context right after
+ *		chip select is released.  Keep it short.  It may submit the
+ *		same or another descriptor.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "spi_utils.h"
+#include "spi_bus.h"
+#include "isr_stats.h"
+
+// Status of a struct spi_transaction
+enum SPI_TRANSACTION_STATUS { SPI_TRANS_IDLE, SPI_TRANS_QUEUED, SPI_TRANS_BUSY, SPI_TRANS_DONE };
+
+// One queued transfer.  Set up with spiAsync_prepare.
+struct spi_transaction {
+	const struct spi_device *device;
+	const unsigned char *txBuf; // May be 0 to send 0xFF
+	unsigned char *rxBuf; // May be 0 to drop what comes back
+	unsigned short len;
+	volatile unsigned char status; // enum SPI_TRANSACTION_STATUS value
+	void (*callback)(struct spi_transaction *transaction); // May be 0
+	struct spi_transaction *next; // Library use only
+};
+
+//**************************USER AREA***************************
+
+/** Enable the SPI interrupt driven master.  Call after initMasterSPI.
+ */
+void spiAsync_init();
+
+/** Fill in a transaction descriptor.
+ *  @param t		Descriptor to fill in
+ *  @param device	Chip to talk to
+ *  @param txBuf	Bytes to send, or 0 to send 0xFF
+ *  @param rxBuf	Destination for the bytes received, or 0 to drop them
+ *  @param len		Number of bytes, at least 1
+ *  @param callback	Called from the interrupt when the transfer ends, may be 0
+ */
+void spiAsync_prepare(struct spi_transaction *t, const struct spi_device *device,
+	const unsigned char *txBuf, unsigned char *rxBuf, unsigned short len,
+	void (*callback)(struct spi_transaction *transaction));
+
+/** Append a transaction to the queue.  The bus starts right away if it is free.
+ *  @param t	Prepared descriptor
+ *  @return		1 if queued, 0 if it is already queued or running or has no bytes
+ */
+unsigned char spiAsync_submit(struct spi_transaction *t);
+
+/** @param t	Submitted descriptor
+ *  @return		1 once the transfer has ended, 0 else
+ */
+unsigned char spiAsync_isDone(const struct spi_transaction *t);
+
+/** @return	1 if no transaction is queued or running, 0 else
+ */
+unsigned char spiAsync_isIdle();
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static struct spi_transaction *volatile spiAsync_head = 0;
+static struct spi_transaction *spiAsync_tail = 0;
+static volatile unsigned char spiAsync_active = 0; // 1 while the queue holds the bus
+static unsigned short spiAsync_index = 0; // Byte now in SPDR
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the SPI
+ * async functions only and is not intended to be used as
+ * a stand alone library function.  Loads the head
+ * transaction's settings, selects its chip and sends its
+ * first byte. */
+void spiAsync_begin(struct spi_transaction *t) {
+	t->status = SPI_TRANS_BUSY;
+	spiAsync_index = 0;
+	spiBus_select(t->device);
+	*t->device->port &= ~t->device->csMask;
+	SPDR = t->txBuf ? t->txBuf[0] : 0xFF;
+}
+
+/* This function is designed to be used by the SPI
+ * async functions and spiBus_unlock only and is not
+ * intended to be used as a stand alone library function.
+ * Starts the queue if it has work and the bus is free.
+ * Runs with interrupts off. */
+void spiAsync_kick() {
+	if(spiAsync_active || !spiAsync_head || !spiBus_tryLock())
+		return;
+	spiAsync_active = 1;
+	// A blocking transfer may have left SPIF set; clear it before enabling the interrupt
+	(void)SPSR;
+	(void)SPDR;
+	SPCR |= (1 << SPIE);
+	spiAsync_begin(spiAsync_head);
+}
+
+ISR(SPI_STC_vect) {
+	ISR_STATS_BEGIN(ISR_ID_SPI);
+	struct spi_transaction *t = spiAsync_head;
+	unsigned char data = SPDR;
+
+	if(t->rxBuf)
+		t->rxBuf[spiAsync_index] = data;
+	if(++spiAsync_index < t->len) {
+		SPDR = t->txBuf ? t->txBuf[spiAsync_index] : 0xFF;
+	}
+	else {
+		*t->device->port |= t->device->csMask;
+		spiAsync_head = t->next;
+		if(!spiAsync_head)
+			spiAsync_tail = 0;
+		t->next = 0;
+		t->status = SPI_TRANS_DONE;
+		if(t->callback)
+			t->callback(t);
+
+		if(spiAsync_head)
+			spiAsync_begin(spiAsync_head);
+		else {
+			SPCR &= ~(1 << SPIE);
+			spiAsync_active = 0;
+			spiBus_unlock();
+		}
+	}
+	ISR_STATS_END(ISR_ID_SPI);
+}
+
+void spiAsync_init() {
+	spiAsync_head = 0;
+	spiAsync_tail = 0;
+	spiAsync_active = 0;
+	enableSPIinterrupt(0);
+	spiBus_releaseHook = spiAsync_kick;
+}
+
+void spiAsync_prepare(struct spi_transaction *t, const struct spi_device *device,
+	const unsigned char *txBuf, unsigned char *rxBuf, unsigned short len,
+	void (*callback)(struct spi_transaction *transaction)) {
+	t->device = device;
+	t->txBuf = txBuf;
+	t->rxBuf = rxBuf;
+	t->len = len;
+	t->callback = callback;
+	t->status = SPI_TRANS_IDLE;
+	t->next = 0;
+}
+
+unsigned char spiAsync_submit(struct spi_transaction *t) {
+	unsigned char sreg;
+
+	if(!t->len)
+		return 0;
+	sreg = SREG;
+	SREG &= 0x7F;
+	if(t->status == SPI_TRANS_QUEUED || t->status == SPI_TRANS_BUSY) {
+		SREG = sreg;
+		return 0;
+	}
+	t->status = SPI_TRANS_QUEUED;
+	t->next = 0;
+	if(spiAsync_tail)
+		spiAsync_tail->next = t;
+	else
+		spiAsync_head = t;
+	spiAsync_tail = t;
+	spiAsync_kick();
+	SREG = sreg;
+	return 1;
+}
+
+unsigned char spiAsync_isDone(const struct spi_transaction *t) {
+	unsigned char status = t->status;
+	return status != SPI_TRANS_QUEUED && status != SPI_TRANS_BUSY;
+}
+
+unsigned char spiAsync_isIdle() {
+	return !spiAsync_active && !spiAsync_head;
+}
+
+#endif
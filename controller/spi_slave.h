@@ -0,0 +1,364 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Interrupt driven SPI slave with receive and transmit ring buffers
+ * and frame detection on the Slave Select (SS) pin.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef SPI_SLAVE_H
+#define SPI_SLAVE_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "spi_utils.h"
+#include "isr_stats.h"
+
+/* USE NOTES:
+ * 1.)	The library takes ownership of the SPI interrupt
+ *		(SPI_STC_vect) and the SS edge interrupt, so it cannot be
+ *		combined with spi_master_async.h.
+ * 2.)	Every byte the master clocks in is pushed into a ring of
+ *		SPI_SLAVE_RX_SIZE bytes and SPDR is loaded with the next
+ *		byte of the transmit ring in the same interrupt, so the
+ *		answer is ready before the master clocks the next byte.
+ *		With an empty transmit ring SPI_SLAVE_IDLE_BYTE is sent.
+ *		Both sizes must be powers of two.
+ * 3.)	A slave cannot load SPDR while a byte shifts, so the next
+ *		byte is loaded by the interrupt in the gap between bytes.
+ *		That takes about 60 cycles from the end of a byte (the
+ *		interrupt response and the handler up to its SPDR write),
+ *		plus any time interrupts are held off elsewhere.  The
+ *		master must pause at least that long after every byte: at
+ *		8MHz leave 10us between bytes, whatever the SCK rate.
+ *		Bytes sent back to back all collide (see note 4).
+ * 4.)	Bytes that arrive while the receive ring is full are
+ *		dropped and counted as overruns.  Writes to SPDR that
+ *		collide with a transfer already running (the master
+ *		started the next byte before the interrupt loaded it) set
+ *		WCOL and are counted as collisions; that byte goes out as
+ *		whatever was in SPDR.
+ * 5.)	The end of a frame (SS going high) is counted and passed
+ *		to the frame handler, if any, with the number of bytes
+ *		received since SS went low.  The handler runs in
+ *		interrupt context.  The byte loaded after the last byte
+ *		of a frame is the idle byte when nothing was queued; it is
+ *		replaced by the first queued byte at the end of the frame
+ *		or, for a reply queued with spiSlave_write while SS is
+ *		high, right away.  A reply queued between frames (the
+ *		usual command/response pattern) therefore goes out from
+ *		the first byte of the next frame.  spiSlave_flushTx
+ *		between frames puts the idle byte back.
+ * 6.)	SS is watched through a pin change interrupt on chips that
+ *		have one (ie. atmega1284: PB4 = PCINT12).  The atmega32
+ *		has none; there the SS line must also be wired to INT2
+ *		(PB2), whose edge select is flipped after every edge.
+ */
+
+#ifndef SPI_SLAVE_RX_SIZE
+#define SPI_SLAVE_RX_SIZE 64
+#endif
+
+#ifndef SPI_SLAVE_TX_SIZE
+#define SPI_SLAVE_TX_SIZE 32
+#endif
+
+// Sent when the master clocks a byte and the transmit ring is empty
+#ifndef SPI_SLAVE_IDLE_BYTE
+#define SPI_SLAVE_IDLE_BYTE 0xFF
+#endif
+
+#if (SPI_SLAVE_RX_SIZE & (SPI_SLAVE_RX_SIZE - 1)) || (SPI_SLAVE_TX_SIZE & (SPI_SLAVE_TX_SIZE - 1))
+#error "SPI_SLAVE_RX_SIZE and SPI_SLAVE_TX_SIZE must be powers of two"
+#endif
+
+#if SPI_SLAVE_RX_SIZE > 256 || SPI_SLAVE_TX_SIZE > 256
+#error "SPI_SLAVE_RX_SIZE and SPI_SLAVE_TX_SIZE must not exceed 256"
+#endif
+
+// SS edge interrupt: pin change where available, else INT2
+#if defined(PCICR)
+#define SPI_SLAVE_SS_VECT	PCINT1_vect
+#define SPI_SLAVE_SS_PCIE	PCIE1
+#define SPI_SLAVE_SS_PCMSK	PCMSK1
+#define SPI_SLAVE_SS_PCINT	PCINT12
+#else
+#define SPI_SLAVE_SS_VECT	INT2_vect
+#endif
+
+// Error counts, see spiSlave_getErrors
+struct spi_slave_errors {
+	unsigned short overruns; // Bytes dropped because the receive ring was full
+	unsigned short collisions; // SPDR writes that hit a running transfer (WCOL)
+};
+
+//**************************USER AREA***************************
+
+/** Start the buffered slave: empty both rings, clear the counts and enable
+ *  the SPI and SS interrupts.
+ */
+void spiSlave_init();
+
+/** Turn the slave and its interrupts off.
+ */
+void spiSlave_stop();
+
+/** @return	Number of received bytes waiting in the receive ring
+ */
+unsigned char spiSlave_available();
+
+/** Take one byte from the receive ring.
+ *  @param data		Receives the byte
+ *  @return			1 if a byte was read, 0 if the ring is empty
+ */
+unsigned char spiSlave_read(unsigned char *data);
+
+/** Queue bytes for the master to clock out.
+ *  @param data		Bytes to send
+ *  @param len		Number of bytes
+ *  @return			Number of bytes queued, less than len if the ring filled up
+ */
+unsigned char spiSlave_write(const unsigned char *data, unsigned char len);
+
+/** Drop every byte still queued for the master.
+ */
+void spiSlave_flushTx();
+
+/** @return	1 while the master holds SS low, 0 else
+ */
+unsigned char spiSlave_selected();
+
+/** @return	Frames (SS low to high) completed since spiSlave_init
+ */
+unsigned short spiSlave_frameCount();
+
+/** @param handler	Called from the interrupt at the end of every frame with
+ *					the bytes received in it, or 0 for none
+ */
+void spiSlave_setFrameHandler(void (*handler)(unsigned short bytes));
+
+/** Copy and optionally clear the error counts.
+ *  @param errors	Receives the counts
+ *  @param clear	1 to reset the counts afterwards
+ */
+void spiSlave_getErrors(struct spi_slave_errors *errors, unsigned char clear);
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned char spiSlave_rx[SPI_SLAVE_RX_SIZE];
+static volatile unsigned char spiSlave_rxHead = 0;
+static volatile unsigned char spiSlave_rxTail = 0;
+static unsigned char spiSlave_tx[SPI_SLAVE_TX_SIZE];
+static volatile unsigned char spiSlave_txHead = 0;
+static volatile unsigned char spiSlave_txTail = 0;
+static volatile unsigned char spiSlave_idleLoaded = 1; // 1 while SPDR holds SPI_SLAVE_IDLE_BYTE, not a queued byte
+static volatile unsigned short spiSlave_frameBytes = 0;
+static volatile unsigned short spiSlave_frames = 0;
+static struct spi_slave_errors spiSlave_errors;
+static void (*spiSlave_frameHandler)(unsigned short bytes) = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the SPI slave
+ * interrupts only and is not intended to be used as a
+ * stand alone library function.  Loads SPDR with the next
+ * byte for the master. */
+void spiSlave_preload() {
+	unsigned char tail = spiSlave_txTail;
+
+	if(tail != spiSlave_txHead) {
+		SPDR = spiSlave_tx[tail];
+		spiSlave_txTail = (tail + 1) & (SPI_SLAVE_TX_SIZE - 1);
+		spiSlave_idleLoaded = 0;
+	}
+	else {
+		SPDR = SPI_SLAVE_IDLE_BYTE;
+		spiSlave_idleLoaded = 1;
+	}
+}
+
+ISR(SPI_STC_vect) {
+	ISR_STATS_BEGIN(ISR_ID_SPI);
+	// WCOL here belongs to the previous preload; reading SPSR then SPDR clears it
+	unsigned char status = SPSR;
+	unsigned char data = SPDR;
+	unsigned char head = spiSlave_rxHead;
+	unsigned char next = (head + 1) & (SPI_SLAVE_RX_SIZE - 1);
+
+	spiSlave_preload();
+	if(status & (1 << WCOL))
+		++spiSlave_errors.collisions;
+
+	if(next != spiSlave_rxTail) {
+		spiSlave_rx[head] = data;
+		spiSlave_rxHead = next;
+	}
+	else
+		++spiSlave_errors.overruns;
+	++spiSlave_frameBytes;
+	ISR_STATS_END(ISR_ID_SPI);
+}
+
+ISR(SPI_SLAVE_SS_VECT) {
+	ISR_STATS_BEGIN(ISR_ID_SPI_SS);
+	unsigned char high = (PINB & SPI_SS) != 0;
+
+#if !defined(PCICR)
+	// Wait for the opposite edge next
+	if(high)
+		MCUCSR &= ~(1 << ISC2);
+	else
+		MCUCSR |= (1 << ISC2);
+	GIFR = (1 << INTF2);
+#endif
+	if(high) {
+		// The bus is idle: swap a preloaded idle byte for a reply queued since
+		if(spiSlave_idleLoaded)
+			spiSlave_preload();
+		++spiSlave_frames;
+		if(spiSlave_frameHandler)
+			spiSlave_frameHandler(spiSlave_frameBytes);
+	}
+	spiSlave_frameBytes = 0;
+	ISR_STATS_END(ISR_ID_SPI_SS);
+}
+
+void spiSlave_init() {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	spiSlave_rxHead = spiSlave_rxTail = 0;
+	spiSlave_txHead = spiSlave_txTail = 0;
+	spiSlave_frameBytes = 0;
+	spiSlave_frames = 0;
+	spiSlave_errors.overruns = 0;
+	spiSlave_errors.collisions = 0;
+
+	initSlaveSPI();
+	*SPI_DIR |= SPI_MISO;
+	SPDR = SPI_SLAVE_IDLE_BYTE;
+	spiSlave_idleLoaded = 1;
+	enableSPIinterrupt(1);
+
+#if defined(PCICR)
+	SPI_SLAVE_SS_PCMSK |= (1 << SPI_SLAVE_SS_PCINT);
+	PCICR |= (1 << SPI_SLAVE_SS_PCIE);
+#else
+	DDRB &= ~(1 << PB2);
+	if(PINB & SPI_SS)
+		MCUCSR &= ~(1 << ISC2); // Next edge is the falling one
+	else
+		MCUCSR |= (1 << ISC2);
+	GIFR = (1 << INTF2);
+	GICR |= (1 << INT2);
+#endif
+	SREG = sreg;
+}
+
+void spiSlave_stop() {
+	enableSPIinterrupt(0);
+	disableSPI();
+#if defined(PCICR)
+	SPI_SLAVE_SS_PCMSK &= ~(1 << SPI_SLAVE_SS_PCINT);
+#else
+	GICR &= ~(1 << INT2);
+#endif
+	*SPI_DIR &= ~SPI_MISO;
+}
+
+unsigned char spiSlave_available() {
+	return (spiSlave_rxHead - spiSlave_rxTail) & (SPI_SLAVE_RX_SIZE - 1);
+}
+
+unsigned char spiSlave_read(unsigned char *data) {
+	unsigned char tail = spiSlave_rxTail;
+
+	if(tail == spiSlave_rxHead)
+		return 0;
+	*data = spiSlave_rx[tail];
+	spiSlave_rxTail = (tail + 1) & (SPI_SLAVE_RX_SIZE - 1);
+	return 1;
+}
+
+unsigned char spiSlave_write(const unsigned char *data, unsigned char len) {
+	unsigned char head = spiSlave_txHead;
+	unsigned char next, count, sreg;
+
+	for(count = 0; count < len; ++count) {
+		next = (head + 1) & (SPI_SLAVE_TX_SIZE - 1);
+		if(next == spiSlave_txTail)
+			break;
+		spiSlave_tx[head] = data[count];
+		head = next;
+	}
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	spiSlave_txHead = head;
+	// Between frames SPDR can be reloaded, so the reply starts with the next frame
+	if(spiSlave_idleLoaded && (PINB & SPI_SS))
+		spiSlave_preload();
+	SREG = sreg;
+	return count;
+}
+
+void spiSlave_flushTx() {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	spiSlave_txTail = spiSlave_txHead;
+	if(!spiSlave_idleLoaded && (PINB & SPI_SS)) {
+		SPDR = SPI_SLAVE_IDLE_BYTE;
+		spiSlave_idleLoaded = 1;
+	}
+	SREG = sreg;
+}
+
+unsigned char spiSlave_selected() {
+	return !(PINB & SPI_SS);
+}
+
+unsigned short spiSlave_frameCount() {
+	unsigned char sreg;
+	unsigned short frames;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	frames = spiSlave_frames;
+	SREG = sreg;
+	return frames;
+}
+
+void spiSlave_setFrameHandler(void (*handler)(unsigned short bytes)) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	spiSlave_frameHandler = handler;
+	SREG = sreg;
+}
+
+void spiSlave_getErrors(struct spi_slave_errors *errors, unsigned char clear) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	*errors = spiSlave_errors;
+	if(clear) {
+		spiSlave_errors.overruns = 0;
+		spiSlave_errors.collisions = 0;
+	}
+	SREG = sreg;
+}
+
+#endif
@@ -29,6 +29,13 @@
  *		"SPIstartTransmit" and "SPIendTransmit" functions.
  * 4.)	Refer to your MCU's data sheet for any
  *		additional functionality.
+ * 5.)	Every byte sent is also a byte received.  Use
+ *		"spi_transfer" and "spi_transfer_buf" when the
+ *		slave's answer matters (ADCs, SD cards, flash).
+ *		At SPI_PRESCALER_HALF a byte takes 16 cycles;
+ *		"spi_transfer_buf" loads the next byte a few
+ *		cycles after SPIF so the gap between bytes stays
+ *		small.
  */
  
 // GLOBAL ENUM VARIABLES TO BE USED AS FORMAL ARGUMENTS TO SPI FUNCTIONS
@@ -145,6 +152,20 @@ void SPImstrWriteString(char str[]);
  * from another source.  Function busy
  * waits for transmission completion. */
 char SPIslvReceive();
+
+/* Transmit a single unsigned char and return
+ * the byte the slave shifted back at the same
+ * time.  Function busy waits for transmission
+ * completion. */
+unsigned char spi_transfer(unsigned char data);
+
+/* Transmit "len" bytes from "tx" while storing
+ * the bytes received into "rx".  Pass a null "tx"
+ * to clock out 0xFF (ie. to read from a slave) and
+ * a null "rx" to discard what comes back.  Function
+ * busy waits for each byte transmission completion
+ * but starts the next byte as soon as SPIF is set. */
+void spi_transfer_buf(const unsigned char *tx, unsigned char *rx, unsigned short len);
  
 //***************************END USER ACCESS AREA******************************
 
@@ -288,4 +309,38 @@ char SPIslvReceive() {
 	return SPDR;
 }
 
+unsigned char spi_transfer(unsigned char data) {
+	SPDR = data;
+	while(!(SPSR & (1 << SPIF)))
+		continue;
+	return SPDR;
+}
+
+void spi_transfer_buf(const unsigned char *tx, unsigned char *rx, unsigned short len) {
+	unsigned short i;
+	unsigned char next, in;
+
+	if(!len)
+		return;
+	SPDR = tx ? tx[0] : 0xFF;
+	for(i = 1; i < len; ++i) {
+		// Fetch the next byte while the current one shifts
+		next = tx ? tx[i] : 0xFF;
+		while(!(SPSR & (1 << SPIF)))
+			continue;
+		/* Start the next byte first: receive is double
+		 * buffered, so SPDR still reads the byte that
+		 * just arrived and storing it overlaps the shift. */
+		SPDR = next;
+		in = SPDR;
+		if(rx)
+			rx[i - 1] = in;
+	}
+	while(!(SPSR & (1 << SPIF)))
+		continue;
+	in = SPDR;
+	if(rx)
+		rx[len - 1] = in;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,174 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef TIMER_PLAN_H
+#define TIMER_PLAN_H
+
+#include <avr/io.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+/* USE NOTES:
+ * 1.)	These macros pick a timer prescaler and compare value for
+ *		a target period at compile time.  Every macro folds to a
+ *		constant, so nothing is computed on the MCU and the
+ *		results can be loaded with plain register stores instead
+ *		of the setTmr#Prescaler switch statements.
+ * 2.)	Describe the target with TMR_PLAN_HZ, TMR_PLAN_MILLIHZ or
+ *		TMR_PLAN_US.  The planned period is the CTC period, ie.
+ *		the time between compare matches when the timer clears
+ *		on match: (TOP + 1) * prescaler / F_CPU.  A pin toggled
+ *		on every match runs at half that frequency.
+ * 3.)	Every prescaler the timer offers is tried and the one
+ *		with the smallest period error wins.  Ties go to the
+ *		smaller prescaler for the finer resolution.
+ * 4.)	The LOAD macros refuse to compile (static assertion) when
+ *		no prescaler gets within the given tolerance, which also
+ *		catches targets that are too fast or too slow for the
+ *		timer.  Tolerances are in parts per million.
+ * 5.)	The LOAD macros only set the compare value and clock
+ *		select bits.  Put the timer into CTC mode with setTmr#Mode
+ *		as usual.
+ *
+ * Example, 1kHz timer0 interrupt within 0.1%:
+ *	setTmr0Mode(TMR02_CTC_MODE, TMR_COMPARE_NORMAL_MODE);
+ *	TMR0_PLAN_LOAD(TMR_PLAN_HZ(1000), 1000);
+ */
+
+//**************************USER AREA***************************
+
+// Target descriptions, a period of num/den seconds
+#define TMR_PLAN_HZ(hz)				1ULL, (unsigned long long)(hz)
+#define TMR_PLAN_MILLIHZ(mhz)		1000ULL, (unsigned long long)(mhz)
+#define TMR_PLAN_US(us)				(unsigned long long)(us), 1000000ULL
+
+// Timer0 (8-bit): chosen division, TCCR0 clock select bits, OCR0 value and error in ppm
+#define TMR0_PLAN_DIV(target)		TMR_PLAN_T0DIV_(target)
+#define TMR0_PLAN_CS(target)		TMR_PLAN_T0CS_(target)
+#define TMR0_PLAN_OCR(target)		TMR_PLAN_T0TOP_(target)
+#define TMR0_PLAN_ERR_PPM(target)	TMR_PLAN_T0ERR_(target)
+
+// Timer1 (16-bit): chosen division, TCCR1B clock select bits, OCR1A/ICR1 value and error in ppm
+#define TMR1_PLAN_DIV(target)		TMR_PLAN_T1DIV_(target)
+#define TMR1_PLAN_CS(target)		TMR_PLAN_T1CS_(target)
+#define TMR1_PLAN_TOP(target)		TMR_PLAN_T1TOP_(target)
+#define TMR1_PLAN_ERR_PPM(target)	TMR_PLAN_T1ERR_(target)
+
+// Timer2 (8-bit, extra /32 and /128 divisions): division, TCCR2 clock select bits, OCR2 value and error in ppm
+#define TMR2_PLAN_DIV(target)		TMR_PLAN_T2DIV_(target)
+#define TMR2_PLAN_CS(target)		TMR_PLAN_T2CS_(target)
+#define TMR2_PLAN_OCR(target)		TMR_PLAN_T2TOP_(target)
+#define TMR2_PLAN_ERR_PPM(target)	TMR_PLAN_T2ERR_(target)
+
+// Check the plan against the tolerance then store the compare value and clock select bits
+#define TMR0_PLAN_LOAD(target, tolPpm)			TMR_PLAN_T0LOAD_(target, tolPpm)
+#define TMR1_PLAN_LOAD_OCR1A(target, tolPpm)	TMR_PLAN_T1LOAD_(OCR1A, target, tolPpm)
+#define TMR1_PLAN_LOAD_ICR1(target, tolPpm)		TMR_PLAN_T1LOAD_(ICR1, target, tolPpm)
+#define TMR2_PLAN_LOAD(target, tolPpm)			TMR_PLAN_T2LOAD_(target, tolPpm)
+
+//****************************END USER AREA**************************************
+
+/* The macros below are designed to be used by the planner
+ * macros above only and are not intended to be used
+ * directly.  They take the target as separate num and den
+ * arguments; the comma in the target macros supplies both. */
+
+// Error reported for a division that cannot produce the target at all
+#define TMR_PLAN_NO_FIT_			0xFFFFFFFFFFFFULL
+
+// Rounded timer count (TOP + 1) for a num/den second period at clock division d
+#define TMR_PLAN_COUNT_(num, den, d) \
+	(((unsigned long long)F_CPU * (num) + (d) * (den) / 2) / ((d) * (den)))
+
+#define TMR_PLAN_FITS_(num, den, d, max) \
+	(TMR_PLAN_COUNT_(num, den, d) >= 1 && TMR_PLAN_COUNT_(num, den, d) <= (max) + 1)
+
+#define TMR_PLAN_ABSDIFF_(a, b)		((a) > (b) ? (a) - (b) : (b) - (a))
+
+// Period error in ppm: |count * d / F_CPU - num / den| / (num / den)
+#define TMR_PLAN_ERR_(num, den, d, max) \
+	(TMR_PLAN_FITS_(num, den, d, max) ? \
+		TMR_PLAN_ABSDIFF_(TMR_PLAN_COUNT_(num, den, d) * (d) * (den), (unsigned long long)F_CPU * (num)) * \
+		1000000ULL / ((unsigned long long)F_CPU * (num)) : TMR_PLAN_NO_FIT_)
+
+#define TMR_PLAN_TOP_(num, den, d)	(TMR_PLAN_COUNT_(num, den, d) - 1)
+
+#define TMR_PLAN_T0DIV_(num, den)	TMR_PLAN_DIV01_(num, den, 255ULL)
+#define TMR_PLAN_T0CS_(num, den)	TMR_PLAN_CS01_(TMR_PLAN_T0DIV_(num, den))
+#define TMR_PLAN_T0TOP_(num, den)	TMR_PLAN_TOP_(num, den, TMR_PLAN_T0DIV_(num, den))
+#define TMR_PLAN_T0ERR_(num, den)	TMR_PLAN_ERR_(num, den, TMR_PLAN_T0DIV_(num, den), 255ULL)
+
+#define TMR_PLAN_T1DIV_(num, den)	TMR_PLAN_DIV01_(num, den, 65535ULL)
+#define TMR_PLAN_T1CS_(num, den)	TMR_PLAN_CS01_(TMR_PLAN_T1DIV_(num, den))
+#define TMR_PLAN_T1TOP_(num, den)	TMR_PLAN_TOP_(num, den, TMR_PLAN_T1DIV_(num, den))
+#define TMR_PLAN_T1ERR_(num, den)	TMR_PLAN_ERR_(num, den, TMR_PLAN_T1DIV_(num, den), 65535ULL)
+
+#define TMR_PLAN_T2DIV_(num, den)	TMR_PLAN_DIV2_(num, den, 255ULL)
+#define TMR_PLAN_T2CS_(num, den)	TMR_PLAN_CS2_(TMR_PLAN_T2DIV_(num, den))
+#define TMR_PLAN_T2TOP_(num, den)	TMR_PLAN_TOP_(num, den, TMR_PLAN_T2DIV_(num, den))
+#define TMR_PLAN_T2ERR_(num, den)	TMR_PLAN_ERR_(num, den, TMR_PLAN_T2DIV_(num, den), 255ULL)
+
+#define TMR_PLAN_T0LOAD_(num, den, tolPpm) do { \
+	_Static_assert(TMR_PLAN_T0ERR_(num, den) <= (tolPpm), "timer0 cannot reach the target period within tolerance"); \
+	OCR0 = TMR_PLAN_T0TOP_(num, den); \
+	TCCR0 = (TCCR0 & ~((1 << CS02) | (1 << CS01) | (1 << CS00))) | TMR_PLAN_T0CS_(num, den); \
+} while(0)
+
+#define TMR_PLAN_T1LOAD_(topReg, num, den, tolPpm) do { \
+	_Static_assert(TMR_PLAN_T1ERR_(num, den) <= (tolPpm), "timer1 cannot reach the target period within tolerance"); \
+	topReg = TMR_PLAN_T1TOP_(num, den); \
+	TCCR1B = (TCCR1B & ~((1 << CS12) | (1 << CS11) | (1 << CS10))) | TMR_PLAN_T1CS_(num, den); \
+} while(0)
+
+#define TMR_PLAN_T2LOAD_(num, den, tolPpm) do { \
+	_Static_assert(TMR_PLAN_T2ERR_(num, den) <= (tolPpm), "timer2 cannot reach the target period within tolerance"); \
+	OCR2 = TMR_PLAN_T2TOP_(num, den); \
+	TCCR2 = (TCCR2 & ~((1 << CS22) | (1 << CS21) | (1 << CS20))) | TMR_PLAN_T2CS_(num, den); \
+} while(0)
+
+// Timer0/1 divisions: 1, 8, 64, 256, 1024
+#define TMR_PLAN_DIV01_(num, den, max) ( \
+	TMR_PLAN_MIN5_(TMR_PLAN_ERR_(num, den, 1ULL, max), TMR_PLAN_ERR_(num, den, 8ULL, max), \
+		TMR_PLAN_ERR_(num, den, 64ULL, max), TMR_PLAN_ERR_(num, den, 256ULL, max), \
+		TMR_PLAN_ERR_(num, den, 1024ULL, max), 1ULL, 8ULL, 64ULL, 256ULL, 1024ULL))
+
+#define TMR_PLAN_CS01_(d) \
+	((d) == 1 ? 1 : (d) == 8 ? 2 : (d) == 64 ? 3 : (d) == 256 ? 4 : 5)
+
+// Timer2 divisions: 1, 8, 32, 64, 128, 256, 1024
+#define TMR_PLAN_DIV2_(num, den, max) ( \
+	TMR_PLAN_ERR_(num, den, 1ULL, max) <= TMR_PLAN_ERR_(num, den, 8ULL, max) && \
+	TMR_PLAN_ERR_(num, den, 1ULL, max) <= TMR_PLAN_ERR_(num, den, 32ULL, max) ? \
+		TMR_PLAN_MIN5_(TMR_PLAN_ERR_(num, den, 1ULL, max), TMR_PLAN_ERR_(num, den, 64ULL, max), \
+			TMR_PLAN_ERR_(num, den, 128ULL, max), TMR_PLAN_ERR_(num, den, 256ULL, max), \
+			TMR_PLAN_ERR_(num, den, 1024ULL, max), 1ULL, 64ULL, 128ULL, 256ULL, 1024ULL) : \
+	TMR_PLAN_ERR_(num, den, 8ULL, max) <= TMR_PLAN_ERR_(num, den, 32ULL, max) ? \
+		TMR_PLAN_MIN5_(TMR_PLAN_ERR_(num, den, 8ULL, max), TMR_PLAN_ERR_(num, den, 64ULL, max), \
+			TMR_PLAN_ERR_(num, den, 128ULL, max), TMR_PLAN_ERR_(num, den, 256ULL, max), \
+			TMR_PLAN_ERR_(num, den, 1024ULL, max), 8ULL, 64ULL, 128ULL, 256ULL, 1024ULL) : \
+		TMR_PLAN_MIN5_(TMR_PLAN_ERR_(num, den, 32ULL, max), TMR_PLAN_ERR_(num, den, 64ULL, max), \
+			TMR_PLAN_ERR_(num, den, 128ULL, max), TMR_PLAN_ERR_(num, den, 256ULL, max), \
+			TMR_PLAN_ERR_(num, den, 1024ULL, max), 32ULL, 64ULL, 128ULL, 256ULL, 1024ULL))
+
+#define TMR_PLAN_CS2_(d) \
+	((d) == 1 ? 1 : (d) == 8 ? 2 : (d) == 32 ? 3 : (d) == 64 ? 4 : (d) == 128 ? 5 : (d) == 256 ? 6 : 7)
+
+// Value paired with the smallest of five errors, earliest wins a tie
+#define TMR_PLAN_MIN5_(e1, e2, e3, e4, e5, v1, v2, v3, v4, v5) \
+	((e1) <= (e2) && (e1) <= (e3) && (e1) <= (e4) && (e1) <= (e5) ? (v1) : \
+	(e2) <= (e3) && (e2) <= (e4) && (e2) <= (e5) ? (v2) : \
+	(e3) <= (e4) && (e3) <= (e5) ? (v3) : \
+	(e4) <= (e5) ? (v4) : (v5))
+
+#endif
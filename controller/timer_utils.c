@@ -30,6 +30,9 @@
 enum TIMER_PRESCALERS { TMR_PRESCALER_OFF, TMR_PRESCALER_8TH, TMR_PRESCALER_64TH,
 	TMR_PRESCALER_256TH, TMR_PRESCALER_1024TH, TMR_PRESCALER_EXT_FALL, TMR_PRESCALER_EXT_RISE };
 
+// Additional clock divisions only available to timer2 (setTmr2Prescaler)
+enum TIMER2_PRESCALERS { TMR2_PRESCALER_32ND = TMR_PRESCALER_EXT_RISE + 1, TMR2_PRESCALER_128TH };
+
 // Use as compareOutMode argument(s) for all setTmrMode functions
 enum TIMER_COMPARE_MODES { TMR_COMPARE_NORMAL_MODE, TMR_COMPARE_TOGGLE_MODE,
 	TMR_COMPARE_CLEAR_MODE, TMR_COMPARE_SET_MODE };
@@ -506,6 +509,20 @@ unsigned short readTmr1() {
 	return temp;
 }
 
+/* Returns the timer1 value latched by the last input
+ * capture event (ICR1). Temporarily disables global interrupts. */
+unsigned short readTmr1Capture() {
+	unsigned char sreg;
+	unsigned short temp;
+	
+	sreg = SREG;
+	SREG &= 0x7F;
+	temp = ICR1;
+	SREG = sreg;
+	
+	return temp;
+}
+
 /* Enable or disable any of the available interrupts
  * for timer1.  Use the enum TIMER1_INTERRUPTS values
  * for the interrupt argument. (0)disable, (1)enable */
@@ -619,13 +636,13 @@ void setTmr2Mode(int timerMode, int compareOutMode) {
 			// Normal Mode
 			break;
 		case TMR02_PHASE_CORRECT_PWM_MODE:
-			TCCR0 |= (1 << WGM20);
+			TCCR2 |= (1 << WGM20);
 			break;
 		case TMR02_CTC_MODE:
-			TCCR0 |= (1 << WGM21);
+			TCCR2 |= (1 << WGM21);
 			break;
 		case TMR02_FAST_PWM_MODE:
-			TCCR0 |= (1 << WGM20) | (1 << WGM21);
+			TCCR2 |= (1 << WGM20) | (1 << WGM21);
 			break;
 		// default normal mode
 	}
@@ -635,47 +652,50 @@ void setTmr2Mode(int timerMode, int compareOutMode) {
 			// Normal Mode
 			break;
 		case TMR_COMPARE_TOGGLE_MODE:
-			TCCR0 |= (1 << COM20);
+			TCCR2 |= (1 << COM20);
 			break;
 		case TMR_COMPARE_CLEAR_MODE:
-			TCCR0 |= (1 << COM21);
+			TCCR2 |= (1 << COM21);
 			break;
 		case TMR_COMPARE_SET_MODE:
-			TCCR0 |= (1 << COM20) | (1 << COM21);
+			TCCR2 |= (1 << COM20) | (1 << COM21);
 			break;
 		// default normal mode
 	}
 }
 
 /* Modifies the timer/counter speed by dividing the system
- * clock speed. Use enum PRESCALERS values for the argument.
+ * clock speed (or the TOSC1 clock in asynchronous mode).
+ * Use enum PRESCALERS or enum TIMER2_PRESCALERS values for
+ * the argument. Timer2 has no external count input so the
+ * EXT values select the default.
  * Timer starts as soon as prescaler is set. */
 void setTmr2Prescaler(int prescaler) {
 	TCCR2 &= ~((1 << CS20) | (1 << CS21) | (1 << CS22));
 	switch(prescaler) {
 		case TMR_PRESCALER_OFF:
-			TCCR0 |= (1 << CS20);
+			TCCR2 |= (1 << CS20);
 			break;
 		case TMR_PRESCALER_8TH:
-			TCCR0 |= (1 << CS21);
+			TCCR2 |= (1 << CS21);
+			break;
+		case TMR2_PRESCALER_32ND:
+			TCCR2 |= (1 << CS21) | (1 << CS20);
 			break;
 		case TMR_PRESCALER_64TH:
-			TCCR0 |= (1 << CS21) | (1 << CS20);
+			TCCR2 |= (1 << CS22);
+			break;
+		case TMR2_PRESCALER_128TH:
+			TCCR2 |= (1 << CS22) | (1 << CS20);
 			break;
 		case TMR_PRESCALER_256TH:
-			TCCR0 |= (1 << CS22);
+			TCCR2 |= (1 << CS22) | (1 << CS21);
 			break;
 		case TMR_PRESCALER_1024TH:
-			TCCR0 |= (1 << CS22) | (1 << CS20);
-			break;
-		case TMR_PRESCALER_EXT_FALL:
-			TCCR0 |= (1 << CS22) | (1 << CS21);
-			break;
-		case TMR_PRESCALER_EXT_RISE:
-			TCCR0 |= (1 << CS22) | (1 << CS21) | (1 << CS20);
+			TCCR2 |= (1 << CS22) | (1 << CS21) | (1 << CS20);
 			break;
 		default:
-			TCCR0 |= (1 << CS20); // Prescaler off
+			TCCR2 |= (1 << CS20); // Prescaler off
 	}
 }
 
@@ -756,4 +776,36 @@ void enableExtClkTmr2(char enable) {
 		ASSR &= ~(1 << AS2);
 }
 
+/* Busy waits until any pending asynchronous write to
+ * TCNT2, OCR2 or TCCR2 has been transferred into the
+ * timer.  Required after each write in asynchronous mode
+ * before writing the same register again or entering
+ * power-save sleep. */
+void waitOnTmr2Busy() {
+	while(ASSR & ((1 << TCN2UB) | (1 << OCR2UB) | (1 << TCR2UB)))
+		continue;
+}
+
+/* Switches timer2 to the 32.768kHz crystal on TOSC1/TOSC2
+ * and starts it from 0 in normal mode, following the
+ * datasheet sequence for asynchronous operation.  TCCR2 is
+ * written in a single store since a second write before
+ * TCR2UB clears can corrupt it.  Leaves the timer2 interrupts
+ * disabled and their flags cleared.  Use enum PRESCALERS or
+ * enum TIMER2_PRESCALERS values for the argument. */
+void startAsyncTmr2(int prescaler) {
+	// CS22:0 bits indexed by the prescaler enum values
+	static const unsigned char CLOCK_SELECT[] = { 1, 2, 4, 6, 7, 1, 1, 3, 5 };
+
+	if(prescaler < TMR_PRESCALER_OFF || prescaler > TMR2_PRESCALER_128TH)
+		prescaler = TMR_PRESCALER_OFF;
+	enableTmr2Interrupts(TMR02_COMPARE_INTERRUPT, 0);
+	enableTmr2Interrupts(TMR02_OVERFLOW_INTERRUPT, 0);
+	enableExtClkTmr2(1);
+	TCNT2 = 0;
+	TCCR2 = CLOCK_SELECT[prescaler] << CS20;
+	waitOnTmr2Busy();
+	TIFR = (1 << OCF2) | (1 << TOV2);
+}
+
 #endif
\ No newline at end of file
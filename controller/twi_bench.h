@@ -0,0 +1,184 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * This code is known to work with the following AVR uCs:
+ * atmega1284
+ *
+ * This code may work with other uCs so check your controller's
+ * datasheet to make sure.
+ *
+ * Throughput benchmark of the TWI register burst calls.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Call twi_init and clock_init first; times are taken with
+ *		clock_ticks.  Use a small clock prescaler for resolution.
+ * 2.)	twiBench_run reads the same registers two ways: the byte
+ *		by byte sequence built from the twi_utils.h primitives
+ *		(register write, STOP, then a separate read transaction),
+ *		and twi_read_regs.  Only reads are timed so the benchmark
+ *		is safe to point at EEPROMs and configured sensors.
+ * 3.)	Both paths are run 'rounds' times and the totals reported,
+ *		so short transfers are not lost in the tick resolution.
+ * 4.)	At the bus clock the wire time dominates; the difference
+ *		shows the per byte CPU overhead and the saved STOP/START.
+ */
+
+#ifndef TWI_BENCH_H
+#define TWI_BENCH_H
+
+#include <avr/io.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include "twi_utils.h"
+#include "clock_utils.h"
+#include "dump_utils.h"
+
+// Outcome of twiBench_run
+struct twi_bench_result {
+	unsigned long bytes; // Bytes moved by each method
+	unsigned long manualTicks; // Clock ticks of the byte by byte sequence
+	unsigned long burstTicks; // Clock ticks of twi_read_regs
+	unsigned long manualRate; // Bytes per second of the byte by byte sequence
+	unsigned long burstRate; // Bytes per second of twi_read_regs
+};
+
+//**************************USER AREA***************************
+
+/** Time reading len registers from a device both ways.
+ *  @param slaveAddress	The unique address of the slave. Values [0, 127]
+ *  @param reg			First register to read
+ *  @param buf			Scratch buffer of at least len bytes
+ *  @param len			Registers per read, at least 2
+ *  @param rounds		Reads per method
+ *  @param result		Destination for the measurement
+ *  @return				1 on success, 0 if a transfer failed
+ */
+unsigned char twiBench_run(unsigned char slaveAddress, unsigned char reg,
+	unsigned char *buf, unsigned char len, unsigned short rounds,
+	struct twi_bench_result *result);
+
+/** Write a result through dump_utils.h: a header line and then one
+ *  tab separated line per method with ticks and bytes per second.
+ *  @param result	Measurement from twiBench_run
+ */
+void twiBench_dump(const struct twi_bench_result *result);
+
+//****************************END USER AREA**************************************
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by twiBench_run
+ * only and is not intended to be used as a stand alone
+ * library function.  The sequence the USE NOTES of
+ * twi_utils.h describe, one call per step. */
+unsigned char twiBench_manualRead(unsigned char slaveAddress, unsigned char reg,
+	unsigned char *buf, unsigned char len) {
+	unsigned char i;
+
+	twi_sendStart();
+	twi_waitOnBusy();
+	if(!twi_confirmStatus(TWI_MSTR_STAT_START_TRANSMITTED))
+		return 0;
+	twi_addressSlave(slaveAddress, TWI_WRITE);
+	twi_waitOnBusy();
+	if(!twi_confirmStatus(TWI_MSTR_STAT_SLA_W_ACK)) {
+		twi_sendStop();
+		return 0;
+	}
+	twi_transmitUchar(reg);
+	twi_waitOnBusy();
+	if(!twi_confirmStatus(TWI_MSTR_STAT_DATA_SEND_ACK)) {
+		twi_sendStop();
+		return 0;
+	}
+	twi_sendStop();
+
+	twi_sendStart();
+	twi_waitOnBusy();
+	if(!twi_confirmStatus(TWI_MSTR_STAT_START_TRANSMITTED))
+		return 0;
+	twi_addressSlave(slaveAddress, TWI_READ);
+	twi_waitOnBusy();
+	if(!twi_confirmStatus(TWI_MSTR_STAT_SLA_R_ACK)) {
+		twi_sendStop();
+		return 0;
+	}
+	for(i = 0; i < len; ++i) {
+		TWCR = (i + 1 < len) ? ((1 << TWINT) | (1 << TWEA) | (1 << TWEN)) : ((1 << TWINT) | (1 << TWEN));
+		twi_waitOnBusy();
+		if(!twi_confirmStatus(i + 1 < len ? TWI_MSTR_STAT_DATA_RECEIVE_ACK : TWI_MSTR_STAT_DATA_RECEIVE_NACK)) {
+			twi_sendStop();
+			return 0;
+		}
+		buf[i] = TWDR;
+	}
+	twi_sendStop();
+	return 1;
+}
+
+/* This function is designed to be used by the benchmark
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned long twiBench_rate(unsigned long bytes, unsigned long ticks) {
+	if(!ticks)
+		return 0;
+	return (unsigned long long)bytes * F_CPU / ((unsigned long long)ticks * clock_getDivider());
+}
+
+unsigned char twiBench_run(unsigned char slaveAddress, unsigned char reg,
+	unsigned char *buf, unsigned char len, unsigned short rounds,
+	struct twi_bench_result *result) {
+	unsigned long start;
+	unsigned short i;
+
+	if(len < 2 || !rounds)
+		return 0;
+	result->bytes = (unsigned long)len * rounds;
+
+	start = clock_ticks();
+	for(i = 0; i < rounds; ++i) {
+		if(!twiBench_manualRead(slaveAddress, reg, buf, len))
+			return 0;
+	}
+	result->manualTicks = clock_ticks() - start;
+
+	start = clock_ticks();
+	for(i = 0; i < rounds; ++i) {
+		if(!twi_read_regs(slaveAddress, reg, buf, len))
+			return 0;
+	}
+	result->burstTicks = clock_ticks() - start;
+
+	result->manualRate = twiBench_rate(result->bytes, result->manualTicks);
+	result->burstRate = twiBench_rate(result->bytes, result->burstTicks);
+	return 1;
+}
+
+void twiBench_dump(const struct twi_bench_result *result) {
+	dump_string("method\tbytes\tticks\tB/s");
+	dump_newline();
+	dump_string("manual\t");
+	dump_ulong(result->bytes);
+	dump_char('\t');
+	dump_ulong(result->manualTicks);
+	dump_char('\t');
+	dump_ulong(result->manualRate);
+	dump_newline();
+	dump_string("burst\t");
+	dump_ulong(result->bytes);
+	dump_char('\t');
+	dump_ulong(result->burstTicks);
+	dump_char('\t');
+	dump_ulong(result->burstRate);
+	dump_newline();
+}
+
+#endif
@@ -0,0 +1,250 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * This code is known to work with the following AVR uCs:
+ * atmega1284
+ *
+ * This code may work with other uCs so check your controller's
+ * datasheet to make sure.
+ *
+ * TWI bus scanner and device registry with per-device bit rates.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	twi_scan probes every usable 7-bit address (0x08 to 0x77,
+ *		the others are reserved) with START, SLA+W and STOP, and
+ *		reports which ones acknowledge.  At 100kHz the whole scan
+ *		takes about 15ms.
+ * 2.)	Describe every device once with twi_deviceInit: its address,
+ *		the fastest SCL it handles and how often a failed transfer
+ *		is retried.  The bit rate registers are worked out then,
+ *		with the same solver as TWI_INIT_SCL in twi_rate.h, so
+ *		switching speed later costs two register stores.
+ * 3.)	The twi_device transfer calls set the device's bit rate
+ *		before the transfer, but only if it differs from the rate
+ *		the TWI is running at, so back to back transfers to
+ *		devices of the same speed never touch TWBR.
+ * 4.)	Slow devices see the fast traffic to other devices on the
+ *		same bus.  Most parts ignore traffic they cannot follow,
+ *		but check the datasheets; if in doubt run the whole bus at
+ *		the slowest rate (TWI_INIT_BUS in twi_rate.h).
+ * 5.)	A failed transfer is repeated up to retries times if its
+ *		error (twi_getError) is in the device's retryOn mask.  The
+ *		default mask retries lost arbitration, timeouts, bus
+ *		errors and an address NACK (ie. an EEPROM still busy).
+ */
+
+#ifndef TWI_BUS_H
+#define TWI_BUS_H
+
+#include <avr/io.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include "twi_utils.h"
+#include "twi_rate.h"
+
+// Bit of an enum TWI_ERRORS value in a retryOn mask
+#define TWI_RETRY_ON(error)		(1 << (error))
+#define TWI_RETRY_DEFAULT		(TWI_RETRY_ON(TWI_ERR_ADDR_NACK) | TWI_RETRY_ON(TWI_ERR_ARBITRATION) | \
+	TWI_RETRY_ON(TWI_ERR_TIMEOUT) | TWI_RETRY_ON(TWI_ERR_BUS))
+
+// A device on the bus, filled in by twi_deviceInit
+struct twi_device {
+	unsigned char address; // 7-bit slave address
+	unsigned char twbr; // Bit rate register value for the device's SCL
+	unsigned char twps; // Prescaler bits for the device's SCL
+	unsigned char retries; // Extra attempts after a failure
+	unsigned char retryOn; // TWI_RETRY_ON mask of the errors worth retrying
+};
+
+//**************************USER AREA***************************
+
+/** Probe one address.
+ *  @param address	7-bit slave address [0, 127]
+ *  @return			1 if a device acknowledged the address, 0 else
+ */
+unsigned char twi_probe(unsigned char address);
+
+/** Probe every address from 0x08 to 0x77.
+ *  @param found	Receives the addresses that acknowledged, in ascending order
+ *  @param max		Size of found
+ *  @return			Number of devices found, may be more than max
+ */
+unsigned char twi_scan(unsigned char *found, unsigned char max);
+
+/** Work out the bit rate register values for an SCL rate.  The rate is
+ *  rounded down to the nearest one the TWI can make with TWBR at least
+ *  10, as the master mode requires (no faster than F_CPU / 36).
+ *  @param hz		Target SCL rate in Hz
+ *  @param twps		Receives the prescaler bits
+ *  @param twbr		Receives the bit rate register value
+ *  @return			SCL rate in Hz the values give, 0 if the target is out of
+ *					reach at this F_CPU
+ */
+unsigned long twi_solveRate(unsigned long hz, unsigned char *twps, unsigned char *twbr);
+
+/** Describe a device.
+ *  @param dev		Descriptor to fill in
+ *  @param address	7-bit slave address [0, 127]
+ *  @param maxScl	Fastest SCL the device handles in Hz, rounded down as
+ *					twi_solveRate does
+ *  @param retries	Extra attempts after a failed transfer
+ *  @return			1 on success, 0 if maxScl cannot be reached
+ */
+unsigned char twi_deviceInit(struct twi_device *dev, unsigned char address,
+	unsigned long maxScl, unsigned char retries);
+
+/** Switch the TWI to the device's bit rate if it is not running at it already.
+ *  @param dev	Device descriptor
+ */
+void twi_deviceSelect(const struct twi_device *dev);
+
+/** @return	1 if the device acknowledges its address at its own rate, 0 else
+ */
+unsigned char twi_deviceProbe(const struct twi_device *dev);
+
+/** twi_read_regs at the device's rate and with its retry policy.
+ */
+unsigned char twi_deviceRead(const struct twi_device *dev, unsigned char reg,
+	unsigned char *buf, unsigned short len);
+
+/** twi_write_regs at the device's rate and with its retry policy.
+ */
+unsigned char twi_deviceWrite(const struct twi_device *dev, unsigned char reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize);
+
+/** twi_writeRead at the device's rate and with its retry policy.
+ */
+unsigned char twi_deviceWriteRead(const struct twi_device *dev, const unsigned char *writeBuf,
+	unsigned char writeLen, unsigned char *readBuf, unsigned char readLen);
+
+//****************************END USER AREA**************************************
+
+// Lowest and highest addresses that are not reserved
+#define TWI_FIRST_ADDRESS 0x08
+#define TWI_LAST_ADDRESS 0x77
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+unsigned char twi_probe(unsigned char address) {
+	twi_sendStart();
+	if(!twi_awaitStart())
+		return 0;
+	twi_addressSlave(address, TWI_WRITE);
+	if(!twi_waitOnBusy())
+		return 0;
+	if(twi_confirmStatus(TWI_MSTR_STAT_SLA_W_ACK) || twi_confirmStatus(TWI_MSTR_STAT_SLA_W_NACK)) {
+		// An empty address is an answer, not an error
+		twi_sendStop();
+		return twi_confirmStatus(TWI_MSTR_STAT_SLA_W_ACK);
+	}
+	twi_fail(TWSR & TWI_STAT_MASK);
+	return 0;
+}
+
+unsigned char twi_scan(unsigned char *found, unsigned char max) {
+	unsigned char address, count = 0;
+
+	for(address = TWI_FIRST_ADDRESS; address <= TWI_LAST_ADDRESS; ++address) {
+		if(!twi_probe(address))
+			continue;
+		if(count < max)
+			found[count] = address;
+		++count;
+	}
+	return count;
+}
+
+unsigned long twi_solveRate(unsigned long hz, unsigned char *twps, unsigned char *twbr) {
+	unsigned long bitRate;
+	unsigned char ps;
+
+	if(!hz || hz > F_CPU / 16)
+		return 0;
+	for(ps = 0; ps < 4; ++ps) {
+		// The TWI_RATE_ formula of twi_rate.h, in unsigned long
+		bitRate = TWI_RATE_TWBR_(hz, TWI_RATE_DIV_(ps));
+		if(bitRate <= 255) {
+			*twps = ps;
+			*twbr = bitRate;
+			return F_CPU / (16 + 2 * bitRate * TWI_RATE_DIV_(ps));
+		}
+	}
+	return 0;
+}
+
+unsigned char twi_deviceInit(struct twi_device *dev, unsigned char address,
+	unsigned long maxScl, unsigned char retries) {
+	dev->address = address;
+	dev->retries = retries;
+	dev->retryOn = TWI_RETRY_DEFAULT;
+	return twi_solveRate(maxScl, &dev->twps, &dev->twbr) != 0;
+}
+
+void twi_deviceSelect(const struct twi_device *dev) {
+	if(TWBR != dev->twbr)
+		TWBR = dev->twbr;
+	if((TWSR & 0x03) != dev->twps)
+		TWSR = dev->twps;
+}
+
+/* This function is designed to be used by the device
+ * transfer functions only and is not intended to be used
+ * as a stand alone library function.
+ * @return	1 if a failed transfer should be tried again */
+unsigned char twi_deviceRetry(const struct twi_device *dev, unsigned char *attempts) {
+	if(*attempts >= dev->retries || !(dev->retryOn & TWI_RETRY_ON(twi_getError())))
+		return 0;
+	++*attempts;
+	return 1;
+}
+
+unsigned char twi_deviceProbe(const struct twi_device *dev) {
+	twi_deviceSelect(dev);
+	return twi_probe(dev->address);
+}
+
+unsigned char twi_deviceRead(const struct twi_device *dev, unsigned char reg,
+	unsigned char *buf, unsigned short len) {
+	unsigned char attempts = 0;
+
+	twi_deviceSelect(dev);
+	while(!twi_read_regs(dev->address, reg, buf, len)) {
+		if(!twi_deviceRetry(dev, &attempts))
+			return 0;
+	}
+	return 1;
+}
+
+unsigned char twi_deviceWrite(const struct twi_device *dev, unsigned char reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize) {
+	unsigned char attempts = 0;
+
+	twi_deviceSelect(dev);
+	while(!twi_write_regs(dev->address, reg, buf, len, pageSize)) {
+		if(!twi_deviceRetry(dev, &attempts))
+			return 0;
+	}
+	return 1;
+}
+
+unsigned char twi_deviceWriteRead(const struct twi_device *dev, const unsigned char *writeBuf,
+	unsigned char writeLen, unsigned char *readBuf, unsigned char readLen) {
+	unsigned char attempts = 0;
+
+	twi_deviceSelect(dev);
+	while(!twi_writeRead(dev->address, writeBuf, writeLen, readBuf, readLen)) {
+		if(!twi_deviceRetry(dev, &attempts))
+			return 0;
+	}
+	return 1;
+}
+
+#endif
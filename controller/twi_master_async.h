@@ -0,0 +1,270 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * This code is known to work with the following AVR uCs:
+ * atmega1284
+ *
+ * This code may work with other uCs so check your controller's
+ * datasheet to make sure.
+ *
+ * Interrupt driven TWI master that runs a queue of transactions.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Set the bit rate with twi_init from twi_utils.h first, then
+ *		call twiAsync_init.  The library takes ownership of the TWI
+ *		interrupt (TWI_vect); do not mix the blocking twi_utils.h
+ *		calls with queued transactions.
+ * 2.)	Fill in a struct twi_transaction with twiAsync_prepare and
+ *		pass it to twiAsync_submit.  The descriptor and its buffers
+ *		belong to the library until its status leaves
+ *		TWI_TRANS_QUEUED/TWI_TRANS_BUSY, so keep them in static or
+ *		otherwise long lived memory.
+ * 3.)	A transaction writes writeLen bytes and/or reads readLen
+ *		bytes from one slave.  With both, the write goes first and
+ *		the read follows after a repeated START, so the pair is one
+ *		bus transaction (ie. register pointer then register data).
+ *		With neither, only the address is sent, which probes
+ *		whether the slave answers.
+ * 4.)	Queued transactions run back to back: the STOP of one and
+ *		the START of the next go out in the same interrupt.
+ * 5.)	The callback, if any, runs in interrupt context as soon as
+ *		the transaction ends.  Keep it short.  It may submit the
+ *		same or another descriptor.
+ */
+
+#ifndef TWI_MASTER_ASYNC_H
+#define TWI_MASTER_ASYNC_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "twi_utils.h"
+#include "isr_stats.h"
+
+// Status of a struct twi_transaction
+enum TWI_TRANSACTION_STATUS { TWI_TRANS_IDLE, TWI_TRANS_QUEUED, TWI_TRANS_BUSY,
+	TWI_TRANS_DONE, TWI_TRANS_ADDR_NACK, TWI_TRANS_DATA_NACK, TWI_TRANS_BUS_ERROR };
+
+// One queued bus transaction.  Set up with twiAsync_prepare.
+struct twi_transaction {
+	unsigned char address; // 7-bit slave address
+	const unsigned char *writeBuf;
+	unsigned char writeLen;
+	unsigned char *readBuf;
+	unsigned char readLen;
+	volatile unsigned char status; // enum TWI_TRANSACTION_STATUS value
+	void (*callback)(struct twi_transaction *transaction); // May be 0
+	struct twi_transaction *next; // Library use only
+};
+
+//**************************USER AREA***************************
+
+/** Enable the TWI interrupt driven master.  Call after twi_init.
+ */
+void twiAsync_init();
+
+/** Fill in a transaction descriptor.
+ *  @param t		Descriptor to fill in
+ *  @param address	7-bit slave address [0, 127]
+ *  @param writeBuf	Bytes to write, may be 0 if writeLen is 0
+ *  @param writeLen	Number of bytes to write
+ *  @param readBuf	Destination for the bytes read, may be 0 if readLen is 0
+ *  @param readLen	Number of bytes to read
+ *  @param callback	Called from the interrupt when the transaction ends, may be 0
+ */
+void twiAsync_prepare(struct twi_transaction *t, unsigned char address,
+	const unsigned char *writeBuf, unsigned char writeLen,
+	unsigned char *readBuf, unsigned char readLen,
+	void (*callback)(struct twi_transaction *transaction));
+
+/** Append a transaction to the queue.  The bus starts right away if it is idle.
+ *  @param t	Prepared descriptor
+ *  @return		1 if queued, 0 if the descriptor is already queued or running
+ */
+unsigned char twiAsync_submit(struct twi_transaction *t);
+
+/** @param t	Submitted descriptor
+ *  @return		1 once the transaction has ended (successfully or not), 0 else
+ */
+unsigned char twiAsync_isDone(const struct twi_transaction *t);
+
+/** @return	1 if no transaction is queued or running, 0 else
+ */
+unsigned char twiAsync_isIdle();
+
+//****************************END USER AREA**************************************
+
+// TWCR values used by the state machine
+#define TWI_ASYNC_GO		((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+#define TWI_ASYNC_GO_ACK	(TWI_ASYNC_GO | (1 << TWEA))
+#define TWI_ASYNC_START		(TWI_ASYNC_GO | (1 << TWSTA))
+#define TWI_ASYNC_STOP		((1 << TWINT) | (1 << TWEN) | (1 << TWSTO))
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static struct twi_transaction *volatile twiAsync_head = 0;
+static struct twi_transaction *twiAsync_tail = 0;
+static volatile unsigned char twiAsync_active = 0; // 1 while the bus is ours
+static unsigned char twiAsync_index = 0; // Byte position within the current phase
+static unsigned char twiAsync_reading = 0; // 1 once the write phase is over
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the TWI
+ * interrupt only and is not intended to be used as a
+ * stand alone library function.  Ends the head transaction
+ * and starts the next one or releases the bus. */
+void twiAsync_finish(unsigned char status) {
+	struct twi_transaction *t = twiAsync_head;
+
+	twiAsync_head = t->next;
+	if(!twiAsync_head)
+		twiAsync_tail = 0;
+	t->next = 0;
+	t->status = status;
+	if(t->callback)
+		t->callback(t);
+
+	twiAsync_index = 0;
+	twiAsync_reading = 0;
+	TWI_TRACE(TWI_TRACE_STOP, 0);
+	if(twiAsync_head) {
+		TWCR = TWI_ASYNC_START | (1 << TWSTO); // STOP followed by START
+	}
+	else {
+		twiAsync_active = 0;
+		TWCR = TWI_ASYNC_STOP;
+	}
+}
+
+/* This function is designed to be used by the TWI
+ * interrupt only and is not intended to be used as a
+ * stand alone library function.  Sends SLA+R with the
+ * right acknowledge setting for the first byte. */
+void twiAsync_beginRead(struct twi_transaction *t) {
+	twiAsync_reading = 1;
+	twiAsync_index = 0;
+	TWDR = (t->address << 1) | 0x01;
+	TWCR = TWI_ASYNC_GO;
+}
+
+ISR(TWI_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TWI);
+	struct twi_transaction *t = twiAsync_head;
+	unsigned char status = TWSR & TWI_STAT_MASK;
+
+	TWI_TRACE(status, TWDR);
+	if(status == TWI_MSTR_STAT_START_TRANSMITTED || status == TWI_MSTR_STAT_RESTART_TRANSMITTED) {
+		t->status = TWI_TRANS_BUSY;
+		if(twiAsync_reading || (!t->writeLen && t->readLen)) {
+			twiAsync_beginRead(t);
+		}
+		else {
+			TWDR = t->address << 1;
+			TWCR = TWI_ASYNC_GO;
+		}
+	}
+	else if(status == TWI_MSTR_STAT_SLA_W_ACK || status == TWI_MSTR_STAT_DATA_SEND_ACK) {
+		if(twiAsync_index < t->writeLen) {
+			TWDR = t->writeBuf[twiAsync_index++];
+			TWCR = TWI_ASYNC_GO;
+		}
+		else if(t->readLen) {
+			// Repeated START: keep the bus for the read half
+			twiAsync_reading = 1;
+			TWCR = TWI_ASYNC_START;
+		}
+		else
+			twiAsync_finish(TWI_TRANS_DONE);
+	}
+	else if(status == TWI_MSTR_STAT_SLA_R_ACK) {
+		TWCR = t->readLen > 1 ? TWI_ASYNC_GO_ACK : TWI_ASYNC_GO;
+	}
+	else if(status == TWI_MSTR_STAT_DATA_RECEIVE_ACK) {
+		t->readBuf[twiAsync_index++] = TWDR;
+		// NACK the last byte so the slave lets go of the bus
+		TWCR = twiAsync_index + 1 < t->readLen ? TWI_ASYNC_GO_ACK : TWI_ASYNC_GO;
+	}
+	else if(status == TWI_MSTR_STAT_DATA_RECEIVE_NACK) {
+		t->readBuf[twiAsync_index++] = TWDR;
+		twiAsync_finish(TWI_TRANS_DONE);
+	}
+	else if(status == TWI_MSTR_STAT_SLA_W_NACK || status == TWI_MSTR_STAT_SLA_R_NACK) {
+		twiAsync_finish(TWI_TRANS_ADDR_NACK);
+	}
+	else if(status == TWI_MSTR_STAT_DATA_SEND_NACK) {
+		twiAsync_finish(TWI_TRANS_DATA_NACK);
+	}
+	else if(status == TWI_MSTR_STAT_ARBITRATION_LOST) {
+		// Another master won; start over once the bus is free
+		twiAsync_index = 0;
+		twiAsync_reading = 0;
+		TWCR = TWI_ASYNC_START;
+	}
+	else {
+		twiAsync_finish(TWI_TRANS_BUS_ERROR);
+	}
+	ISR_STATS_END(ISR_ID_TWI);
+}
+
+void twiAsync_init() {
+	twiAsync_head = 0;
+	twiAsync_tail = 0;
+	twiAsync_active = 0;
+	TWCR = (1 << TWEN);
+}
+
+void twiAsync_prepare(struct twi_transaction *t, unsigned char address,
+	const unsigned char *writeBuf, unsigned char writeLen,
+	unsigned char *readBuf, unsigned char readLen,
+	void (*callback)(struct twi_transaction *transaction)) {
+	t->address = address;
+	t->writeBuf = writeBuf;
+	t->writeLen = writeLen;
+	t->readBuf = readBuf;
+	t->readLen = readLen;
+	t->callback = callback;
+	t->status = TWI_TRANS_IDLE;
+	t->next = 0;
+}
+
+unsigned char twiAsync_submit(struct twi_transaction *t) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	if(t->status == TWI_TRANS_QUEUED || t->status == TWI_TRANS_BUSY) {
+		SREG = sreg;
+		return 0;
+	}
+	t->status = TWI_TRANS_QUEUED;
+	t->next = 0;
+	if(twiAsync_tail)
+		twiAsync_tail->next = t;
+	else
+		twiAsync_head = t;
+	twiAsync_tail = t;
+
+	if(!twiAsync_active) {
+		twiAsync_active = 1;
+		twiAsync_index = 0;
+		twiAsync_reading = 0;
+		TWCR = TWI_ASYNC_START;
+	}
+	SREG = sreg;
+	return 1;
+}
+
+unsigned char twiAsync_isDone(const struct twi_transaction *t) {
+	unsigned char status = t->status;
+	return status != TWI_TRANS_QUEUED && status != TWI_TRANS_BUSY;
+}
+
+unsigned char twiAsync_isIdle() {
+	return !twiAsync_active;
+}
+
+#endif
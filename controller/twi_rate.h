@@ -0,0 +1,121 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * This code is known to work with the following AVR uCs:
+ * atmega1284
+ *
+ * This code may work with other uCs so check your controller's
+ * datasheet to make sure.
+ *
+ * Compile time TWI bit rate solver.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	SCL = F_CPU / (16 + 2 * TWBR * 4^TWPS).  TWI_RATE_TWPS and
+ *		TWI_RATE_TWBR solve this for a target SCL at compile time:
+ *		the smallest prescaler that fits is used for the finest
+ *		steps, and TWBR is rounded up so the bus never runs faster
+ *		than the target.  TWI_RATE_SCL gives the rate you get.
+ * 2.)	In master mode TWBR must be at least 10 or the TWI may put
+ *		wrong levels on SDA and SCL, so the fastest SCL is
+ *		F_CPU / 36: a faster target gets that rate (ie. 222kHz at
+ *		8MHz, 444kHz at 16MHz).  TWI_INIT_SCL refuses to compile
+ *		(static assertion) when F_CPU cannot reach the target at
+ *		all: faster than F_CPU / 16, or slower than TWBR 255 with
+ *		the /64 prescaler allows.
+ * 3.)	Every device driver declares the fastest SCL it handles by
+ *		lowering TWI_BUS_SCL, see TWI_BUS_SCL below:
+ *			#if TWI_BUS_SCL > MY_DEVICE_MAX_SCL
+ *			#undef TWI_BUS_SCL
+ *			#define TWI_BUS_SCL MY_DEVICE_MAX_SCL
+ *			#endif
+ *		After all driver headers are included TWI_BUS_SCL is the
+ *		fastest rate every attached device tolerates.  Call
+ *		TWI_INIT_BUS() in your own code after those includes.
+ * 4.)	TWI_BUS_SCL starts at 400kHz, the fastest rate of the
+ *		standard TWI.  Define it before including any library file
+ *		to start lower, or higher (ie. 1MHz) on parts and buses
+ *		that support it.
+ */
+
+#ifndef TWI_RATE_H
+#define TWI_RATE_H
+
+#include <avr/io.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include "twi_utils.h"
+
+//**************************USER AREA***************************
+
+// Common SCL rates in Hz
+#define TWI_SCL_STANDARD	100000UL
+#define TWI_SCL_FAST		400000UL
+#define TWI_SCL_FAST_PLUS	1000000UL
+
+// Fastest SCL all devices on the bus handle, lowered by each driver header
+#ifndef TWI_BUS_SCL
+#define TWI_BUS_SCL TWI_SCL_FAST
+#endif
+
+// Smallest TWBR allowed in master mode
+#define TWI_RATE_MIN_TWBR	10
+
+// TWPS prescaler bits (also a TWI_PRESCALERS value), TWBR value and resulting SCL for a target in Hz
+#define TWI_RATE_TWPS(hz)	TWI_RATE_TWPS_((unsigned long long)(hz))
+#define TWI_RATE_TWBR(hz)	TWI_RATE_TWBR_((unsigned long long)(hz), TWI_RATE_DIV_(TWI_RATE_TWPS(hz)))
+#define TWI_RATE_SCL(hz)	(F_CPU / (16 + 2ULL * TWI_RATE_TWBR(hz) * TWI_RATE_DIV_(TWI_RATE_TWPS(hz))))
+
+/* As TWI_RATE_TWBR, with the checks of TWI_INIT_SCL for use inside an
+ * expression, where _Static_assert cannot go.  A target out of reach
+ * fails to compile with a negative array size. */
+#define TWI_RATE_TWBR_CHECKED(hz)	(TWI_RATE_TWBR(hz) + \
+	TWI_RATE_ASSERT_(F_CPU >= 16ULL * (hz)) + \
+	TWI_RATE_ASSERT_(TWI_RATE_FITS_((unsigned long long)(hz), 64)))
+
+// Check the target then load TWSR and TWBR for it
+#define TWI_INIT_SCL(hz) do { \
+	_Static_assert(F_CPU >= 16ULL * (hz), "TWI SCL target is faster than F_CPU / 16"); \
+	_Static_assert(TWI_RATE_FITS_((unsigned long long)(hz), 64), "TWI SCL target is too slow for F_CPU"); \
+	_Static_assert(TWI_RATE_TWBR(hz) >= TWI_RATE_MIN_TWBR, "TWBR is below the master mode minimum of 10"); \
+	TWSR = TWI_RATE_TWPS(hz); \
+	TWBR = TWI_RATE_TWBR(hz); \
+} while(0)
+
+// Run the bus at the fastest rate all included device drivers tolerate
+#define TWI_INIT_BUS()		TWI_INIT_SCL(TWI_BUS_SCL)
+
+//****************************END USER AREA**************************************
+
+/* The macros below are designed to be used by the solver
+ * macros above and twi_solveRate in twi_bus.h only and are
+ * not intended to be used directly.  They work in the type of
+ * hz: unsigned long long at compile time, unsigned long when
+ * twi_solveRate runs them. */
+
+// TWBR rounded up for prescaler division p, so SCL stays at or below hz
+#define TWI_RATE_RAW_(hz, p) \
+	(F_CPU >= 16 * (hz) ? (F_CPU - 16 * (hz) + 2 * (p) * (hz) - 1) / (2 * (p) * (hz)) : 0)
+
+// As TWI_RATE_RAW_, raised to the master mode minimum
+#define TWI_RATE_TWBR_(hz, p) \
+	(TWI_RATE_RAW_(hz, p) < TWI_RATE_MIN_TWBR ? TWI_RATE_MIN_TWBR : TWI_RATE_RAW_(hz, p))
+
+#define TWI_RATE_FITS_(hz, p)	(TWI_RATE_TWBR_(hz, p) <= 255)
+
+#define TWI_RATE_TWPS_(hz) \
+	(TWI_RATE_FITS_(hz, 1) ? 0 : TWI_RATE_FITS_(hz, 4) ? 1 : TWI_RATE_FITS_(hz, 16) ? 2 : 3)
+
+#define TWI_RATE_DIV_(twps)		(1UL << (2 * (twps)))
+
+// 0, or a compile error (negative array size) if cond is false
+#define TWI_RATE_ASSERT_(cond)	(0 * sizeof(char[(cond) ? 1 : -1]))
+
+#endif
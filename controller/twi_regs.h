@@ -0,0 +1,170 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * Register burst, EEPROM page and acknowledge polling logic shared by
+ * the TWI (twi_utils.h) and the bit banged bus (soft_twi.h).
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Not a library of its own: twi_utils.h and soft_twi.h include
+ *		it once each, so there is no include guard.  Before the
+ *		include, TWI_REGS_(name) must paste the bus prefix onto
+ *		name (ie. twi_##name) and TWI_REGS_BEGIN() must reset the
+ *		bus's error state at the start of a call.  Both are undefined
+ *		again at the end of this file.
+ * 2.)	The bus provides, under its prefix: sendStart, awaitStart,
+ *		addressSlave, waitOnBusy, confirmStatus, await, transmitUchar,
+ *		receiveStart, receivedData and sendStop, with the meanings of
+ *		the twi_utils.h calls.  await and awaitStart release the bus
+ *		themselves when the status is wrong.
+ * 3.)	Defines <prefix>_addressPoll, _startRegs, _writeRegsN and
+ *		_readRegsN for the bus, and the public _write_regs,
+ *		_read_regs, _write_regs16 and _read_regs16 built on them.
+ *		A fix made here reaches both buses.
+ */
+
+#if !defined(TWI_REGS_) || !defined(TWI_REGS_BEGIN)
+#error "define TWI_REGS_ and TWI_REGS_BEGIN before including twi_regs.h"
+#endif
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  Sends START and SLA+W and
+ * leaves the bus owned once the slave ACKs.  With poll set an
+ * address NACK is retried while the slave finishes an earlier
+ * page write. */
+unsigned char TWI_REGS_(addressPoll)(unsigned char slaveAddress, unsigned char poll) {
+	unsigned short tries = poll ? TWI_ACK_POLL_LIMIT : 1;
+
+	for(;;) {
+		TWI_REGS_(sendStart)();
+		if(!TWI_REGS_(awaitStart)())
+			return 0;
+		TWI_REGS_(addressSlave)(slaveAddress, TWI_WRITE);
+		if(!TWI_REGS_(waitOnBusy)())
+			return 0;
+		// A busy EEPROM NACKs its address, that is not an error until we give up
+		if(!--tries || !TWI_REGS_(confirmStatus)(TWI_MSTR_STAT_SLA_W_NACK))
+			return TWI_REGS_(await)(TWI_MSTR_STAT_SLA_W_ACK);
+	}
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  Sends START, SLA+W and the
+ * register address, acknowledge polling if poll is set. */
+unsigned char TWI_REGS_(startRegs)(unsigned char slaveAddress, unsigned short reg,
+	unsigned char regBytes, unsigned char poll) {
+	if(!TWI_REGS_(addressPoll)(slaveAddress, poll))
+		return 0;
+
+	if(regBytes == 2) {
+		TWI_REGS_(transmitUchar)(reg >> 8);
+		if(!TWI_REGS_(await)(TWI_MSTR_STAT_DATA_SEND_ACK))
+			return 0;
+	}
+	TWI_REGS_(transmitUchar)(reg);
+	return TWI_REGS_(await)(TWI_MSTR_STAT_DATA_SEND_ACK);
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned char TWI_REGS_(writeRegsN)(unsigned char slaveAddress, unsigned short reg, unsigned char regBytes,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize) {
+	unsigned short chunk, room;
+	unsigned char poll = 0;
+
+	TWI_REGS_BEGIN();
+	while(len) {
+		chunk = len;
+		if(pageSize) {
+			room = pageSize - (reg & (pageSize - 1));
+			if(chunk > room)
+				chunk = room;
+		}
+		if(!TWI_REGS_(startRegs)(slaveAddress, reg, regBytes, poll))
+			return 0;
+		reg += chunk;
+		len -= chunk;
+		do {
+			TWI_REGS_(transmitUchar)(*buf++);
+			if(!TWI_REGS_(await)(TWI_MSTR_STAT_DATA_SEND_ACK))
+				return 0;
+		} while(--chunk);
+		TWI_REGS_(sendStop)();
+		poll = pageSize != 0;
+	}
+
+	// Wait out the last page too, so the next access to the device is not NACKed
+	if(poll) {
+		if(!TWI_REGS_(addressPoll)(slaveAddress, 1))
+			return 0;
+		TWI_REGS_(sendStop)();
+	}
+	return 1;
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned char TWI_REGS_(readRegsN)(unsigned char slaveAddress, unsigned short reg, unsigned char regBytes,
+	unsigned char *buf, unsigned short len) {
+	TWI_REGS_BEGIN();
+	if(!len || !TWI_REGS_(startRegs)(slaveAddress, reg, regBytes, 0))
+		return 0;
+
+	TWI_REGS_(sendStart)(); // Repeated START, we still own the bus
+	if(!TWI_REGS_(await)(TWI_MSTR_STAT_RESTART_TRANSMITTED))
+		return 0;
+	TWI_REGS_(addressSlave)(slaveAddress, TWI_READ);
+	if(!TWI_REGS_(await)(TWI_MSTR_STAT_SLA_R_ACK))
+		return 0;
+
+	// ACK every byte but the last so the slave releases the bus after it
+	while(--len) {
+		TWI_REGS_(receiveStart)(1);
+		if(!TWI_REGS_(await)(TWI_MSTR_STAT_DATA_RECEIVE_ACK))
+			return 0;
+		*buf++ = TWI_REGS_(receivedData)();
+	}
+	TWI_REGS_(receiveStart)(0);
+	if(!TWI_REGS_(await)(TWI_MSTR_STAT_DATA_RECEIVE_NACK))
+		return 0;
+	*buf = TWI_REGS_(receivedData)();
+
+	TWI_REGS_(sendStop)();
+	return 1;
+}
+
+unsigned char TWI_REGS_(write_regs)(unsigned char slaveAddress, unsigned char reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize) {
+	return TWI_REGS_(writeRegsN)(slaveAddress, reg, 1, buf, len, pageSize);
+}
+
+unsigned char TWI_REGS_(read_regs)(unsigned char slaveAddress, unsigned char reg,
+	unsigned char *buf, unsigned short len) {
+	return TWI_REGS_(readRegsN)(slaveAddress, reg, 1, buf, len);
+}
+
+unsigned char TWI_REGS_(write_regs16)(unsigned char slaveAddress, unsigned short reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize) {
+	return TWI_REGS_(writeRegsN)(slaveAddress, reg, 2, buf, len, pageSize);
+}
+
+unsigned char TWI_REGS_(read_regs16)(unsigned char slaveAddress, unsigned short reg,
+	unsigned char *buf, unsigned short len) {
+	return TWI_REGS_(readRegsN)(slaveAddress, reg, 2, buf, len);
+}
+
+#undef TWI_REGS_
+#undef TWI_REGS_BEGIN
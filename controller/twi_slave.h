@@ -0,0 +1,380 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * This code is known to work with the following AVR uCs:
+ * atmega1284
+ *
+ * This code may work with other uCs so check your controller's
+ * datasheet to make sure.
+ *
+ * Interrupt driven TWI slave that exposes a register map, for
+ * using the uC as an I2C coprocessor.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	The slave takes ownership of the TWI interrupt (TWI_vect).
+ *		It cannot be used together with twi_master_async.h.  The
+ *		blocking master calls of twi_utils.h must not be used
+ *		while the slave is enabled.
+ * 2.)	The master talks to the map like to any register mapped
+ *		device: the first byte of a write sets the register
+ *		pointer, following bytes are stored from there on.  A read
+ *		returns bytes from the pointer on.  The pointer increments
+ *		after every byte and wraps at the end of the map.  Use a
+ *		repeated START between the pointer write and the read (ie.
+ *		twi_read_regs on the master).
+ * 3.)	writeMask holds one byte per register: only the bits set
+ *		there can be changed by the master.  A 0 entry makes the
+ *		register read-only.  Pass 0 for the array to make every
+ *		register fully writable.
+ * 4.)	Multi-byte values (ie. a 16-bit sample) can be declared with
+ *		twiSlave_addLatch.  When the master reads the first byte of
+ *		such a value, the whole value is copied and the remaining
+ *		bytes come from the copy, so the master never sees a value
+ *		that changed half way.  Writes from the master to the value
+ *		are collected and stored all at once after its last byte;
+ *		an incomplete write is dropped.  The application must
+ *		update and read latched values with twiSlave_setRegs and
+ *		twiSlave_getRegs, which are atomic.
+ * 5.)	The slave answers to every address that matches under the
+ *		address mask (set bits are "don't care"), twiSlave_lastAddress
+ *		tells which one the master used.  With a general call handler
+ *		set, the slave also answers to address 0 and passes every
+ *		general call data byte to the handler.
+ * 6.)	The handlers run in interrupt context.  Keep them short.
+ */
+
+#ifndef TWI_SLAVE_H
+#define TWI_SLAVE_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "twi_utils.h"
+#include "isr_stats.h"
+
+// Most multi-byte values that can be declared with twiSlave_addLatch
+#ifndef TWI_SLAVE_MAX_LATCHES
+#define TWI_SLAVE_MAX_LATCHES 8
+#endif
+
+// Longest multi-byte value in bytes
+#ifndef TWI_SLAVE_LATCH_SIZE
+#define TWI_SLAVE_LATCH_SIZE 4
+#endif
+
+//**************************USER AREA***************************
+
+/** Start answering as a slave.
+ *  @param address		This controller's slave address. Values [1, 127]
+ *  @param addressMask	Address bits to ignore when matching, 0 for a single address
+ *  @param regs			The register map
+ *  @param writeMask	Writable bits per register, may be 0 (see USE NOTES)
+ *  @param size			Number of registers in the map [1, 255]
+ */
+void twiSlave_init(unsigned char address, unsigned char addressMask, unsigned char *regs,
+	const unsigned char *writeMask, unsigned char size);
+
+/** Stop answering as a slave.
+ */
+void twiSlave_stop();
+
+/** Declare a multi-byte value that is read and written as a whole.
+ *  Ranges must not overlap.
+ *  @param reg	First register of the value
+ *  @param len	Length in bytes [2, TWI_SLAVE_LATCH_SIZE]
+ *  @return		1 on success, 0 if invalid or there are no free latches
+ */
+unsigned char twiSlave_addLatch(unsigned char reg, unsigned char len);
+
+/** Update registers from the application without interference from the master.
+ *  @param reg	First register
+ *  @param src	New register values
+ *  @param len	Number of registers
+ */
+void twiSlave_setRegs(unsigned char reg, const unsigned char *src, unsigned char len);
+
+/** Read registers without interference from the master.
+ *  @param reg	First register
+ *  @param dst	Destination for the register values
+ *  @param len	Number of registers
+ */
+void twiSlave_getRegs(unsigned char reg, unsigned char *dst, unsigned char len);
+
+/** @param handler	Called after a master write with the first register and
+ *					the number of bytes stored, may be 0
+ */
+void twiSlave_setWriteHandler(void (*handler)(unsigned char reg, unsigned char len));
+
+/** @param handler	Called with every general call data byte, 0 to ignore general calls
+ */
+void twiSlave_setGeneralCallHandler(void (*handler)(unsigned char data));
+
+/** @return	The 7-bit address the master used in the last transaction
+ */
+unsigned char twiSlave_lastAddress();
+
+//****************************END USER AREA**************************************
+
+// TWCR value that keeps the slave listening and acknowledging
+#define TWI_SLAVE_ACK ((1 << TWINT) | (1 << TWEA) | (1 << TWEN) | (1 << TWIE))
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned char *twiSlave_regs = 0;
+static const unsigned char *twiSlave_writeMask = 0;
+static unsigned char twiSlave_size = 0;
+static unsigned char twiSlave_ptr = 0; // Register pointer
+static unsigned char twiSlave_first = 0; // 1 until the pointer byte of a write arrived
+static volatile unsigned char twiSlave_address = 0;
+static unsigned char twiSlave_writeStart = 0;
+static unsigned char twiSlave_writeCount = 0;
+static void (*twiSlave_writeHandler)(unsigned char reg, unsigned char len) = 0;
+static void (*twiSlave_gcHandler)(unsigned char data) = 0;
+
+static unsigned char twiSlave_latchStart[TWI_SLAVE_MAX_LATCHES];
+static unsigned char twiSlave_latchLen[TWI_SLAVE_MAX_LATCHES];
+static unsigned char twiSlave_latchCount = 0;
+static unsigned char twiSlave_latch[TWI_SLAVE_LATCH_SIZE]; // Copy being read or collected
+static unsigned char twiSlave_latchIndex = 0; // Next byte within twiSlave_latch
+static unsigned char twiSlave_latchLeft = 0; // Bytes of the copy still to go, 0 == no copy active
+static unsigned char twiSlave_latchReg = 0; // First register of the active copy
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the slave
+ * interrupt only and is not intended to be used as a
+ * stand alone library function.  Returns the length of
+ * the latched value starting at reg, 0 if there is none. */
+static inline unsigned char twiSlave_latchAt(unsigned char reg) {
+	unsigned char i;
+
+	for(i = 0; i < twiSlave_latchCount; ++i) {
+		if(twiSlave_latchStart[i] == reg)
+			return twiSlave_latchLen[i];
+	}
+	return 0;
+}
+
+/* This function is designed to be used by the slave
+ * interrupt only and is not intended to be used as a
+ * stand alone library function. */
+static inline void twiSlave_advance() {
+	if(++twiSlave_ptr >= twiSlave_size)
+		twiSlave_ptr = 0;
+}
+
+/* This function is designed to be used by the slave
+ * interrupt only and is not intended to be used as a
+ * stand alone library function.  Returns the byte at the
+ * pointer, from the copy of a latched value if one is
+ * being read. */
+static inline unsigned char twiSlave_nextByte() {
+	unsigned char data, len, i;
+
+	if(!twiSlave_latchLeft) {
+		len = twiSlave_latchAt(twiSlave_ptr);
+		if(len) {
+			for(i = 0; i < len; ++i)
+				twiSlave_latch[i] = twiSlave_regs[(twiSlave_ptr + i) % twiSlave_size];
+			twiSlave_latchIndex = 0;
+			twiSlave_latchLeft = len;
+		}
+	}
+	if(twiSlave_latchLeft) {
+		data = twiSlave_latch[twiSlave_latchIndex++];
+		--twiSlave_latchLeft;
+	}
+	else
+		data = twiSlave_regs[twiSlave_ptr];
+	twiSlave_advance();
+	return data;
+}
+
+/* This function is designed to be used by the slave
+ * interrupt only and is not intended to be used as a
+ * stand alone library function. */
+static inline void twiSlave_store(unsigned char reg, unsigned char data) {
+	unsigned char mask = twiSlave_writeMask ? twiSlave_writeMask[reg] : 0xFF;
+
+	twiSlave_regs[reg] = (twiSlave_regs[reg] & ~mask) | (data & mask);
+}
+
+/* This function is designed to be used by the slave
+ * interrupt only and is not intended to be used as a
+ * stand alone library function.  Stores a byte from the
+ * master, collecting latched values until complete. */
+static inline void twiSlave_receive(unsigned char data) {
+	unsigned char i, len;
+
+	if(!twiSlave_latchLeft) {
+		len = twiSlave_latchAt(twiSlave_ptr);
+		if(len) {
+			twiSlave_latchReg = twiSlave_ptr;
+			twiSlave_latchIndex = 0;
+			twiSlave_latchLeft = len;
+		}
+	}
+	if(twiSlave_latchLeft) {
+		twiSlave_latch[twiSlave_latchIndex++] = data;
+		if(!--twiSlave_latchLeft) {
+			for(i = 0; i < twiSlave_latchIndex; ++i)
+				twiSlave_store((twiSlave_latchReg + i) % twiSlave_size, twiSlave_latch[i]);
+		}
+	}
+	else
+		twiSlave_store(twiSlave_ptr, data);
+	++twiSlave_writeCount;
+	twiSlave_advance();
+}
+
+/* This function is designed to be used by the slave
+ * interrupt only and is not intended to be used as a
+ * stand alone library function.  Ends a transaction. */
+static inline void twiSlave_end() {
+	twiSlave_latchLeft = 0; // An incomplete latched write is dropped
+	if(twiSlave_writeCount && twiSlave_writeHandler)
+		twiSlave_writeHandler(twiSlave_writeStart, twiSlave_writeCount);
+	twiSlave_writeCount = 0;
+}
+
+ISR(TWI_vect) {
+	ISR_STATS_BEGIN(ISR_ID_TWI);
+	unsigned char status = TWSR & TWI_STAT_MASK;
+
+	TWI_TRACE(status, TWDR);
+	if(status == TWI_SLV_STAT_SLA_W_ACK || status == TWI_SLV_STAT_ARBITRATION_LOST_SLA_W_ACK) {
+		twiSlave_address = TWDR >> 1;
+		twiSlave_first = 1;
+		twiSlave_latchLeft = 0;
+	}
+	else if(status == TWI_SLV_STAT_GENERAL_CALL_ACK || status == TWI_SLV_STAT_ARBITRATION_LOST_GEN_CALL_ACK) {
+		twiSlave_address = 0;
+	}
+	else if(status == TWI_SLV_STAT_SLA_W_DATA_RECEIVE_ACK) {
+		if(twiSlave_first) {
+			twiSlave_first = 0;
+			twiSlave_ptr = TWDR % twiSlave_size;
+			twiSlave_writeStart = twiSlave_ptr;
+		}
+		else
+			twiSlave_receive(TWDR);
+	}
+	else if(status == TWI_SLV_STAT_GEN_CALL_DATA_RECEIVE_ACK) {
+		if(twiSlave_gcHandler)
+			twiSlave_gcHandler(TWDR);
+	}
+	else if(status == TWI_SLV_STAT_SLA_R_ACK || status == TWI_SLV_STAT_ARBITRATION_LOST_SLA_R_ACK) {
+		twiSlave_address = TWDR >> 1;
+		twiSlave_end(); // A repeated START ends the write half without a STOP status
+		TWDR = twiSlave_nextByte();
+	}
+	else if(status == TWI_SLV_STAT_DATA_SEND_ACK) {
+		TWDR = twiSlave_nextByte();
+	}
+	else if(status == TWI_SLV_STAT_STOP_RECEIVED || status == TWI_SLV_STAT_DATA_SEND_NACK ||
+		status == TWI_SLV_STAT_DATA_RECEIPT_ACK) {
+		twiSlave_end();
+	}
+	else if(status == TWI_STAT_BUS_ERR) {
+		twiSlave_end();
+		TWCR = TWI_SLAVE_ACK | (1 << TWSTO); // Release the lines and reset the interface
+		ISR_STATS_END(ISR_ID_TWI);
+		return;
+	}
+	// SLA_W/GEN_CALL_DATA_RECEIVE_NACK need nothing but acknowledging again
+	TWCR = TWI_SLAVE_ACK;
+	ISR_STATS_END(ISR_ID_TWI);
+}
+
+void twiSlave_init(unsigned char address, unsigned char addressMask, unsigned char *regs,
+	const unsigned char *writeMask, unsigned char size) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	twiSlave_regs = regs;
+	twiSlave_writeMask = writeMask;
+	twiSlave_size = size;
+	twiSlave_ptr = 0;
+	twiSlave_latchLeft = 0;
+	twiSlave_writeCount = 0;
+	twi_set_myAddress(address, twiSlave_gcHandler != 0);
+	twi_maskMyAddress(addressMask);
+	TWCR = TWI_SLAVE_ACK & ~(1 << TWINT);
+	SREG = sreg;
+}
+
+void twiSlave_stop() {
+	TWCR = 0;
+}
+
+unsigned char twiSlave_addLatch(unsigned char reg, unsigned char len) {
+	unsigned char sreg;
+
+	if(len < 2 || len > TWI_SLAVE_LATCH_SIZE || twiSlave_latchCount >= TWI_SLAVE_MAX_LATCHES)
+		return 0;
+	sreg = SREG;
+	SREG &= 0x7F;
+	twiSlave_latchStart[twiSlave_latchCount] = reg;
+	twiSlave_latchLen[twiSlave_latchCount] = len;
+	++twiSlave_latchCount;
+	SREG = sreg;
+	return 1;
+}
+
+void twiSlave_setRegs(unsigned char reg, const unsigned char *src, unsigned char len) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	while(len--) {
+		twiSlave_regs[reg] = *src++;
+		if(++reg >= twiSlave_size)
+			reg = 0;
+	}
+	SREG = sreg;
+}
+
+void twiSlave_getRegs(unsigned char reg, unsigned char *dst, unsigned char len) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	while(len--) {
+		*dst++ = twiSlave_regs[reg];
+		if(++reg >= twiSlave_size)
+			reg = 0;
+	}
+	SREG = sreg;
+}
+
+void twiSlave_setWriteHandler(void (*handler)(unsigned char reg, unsigned char len)) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	twiSlave_writeHandler = handler;
+	SREG = sreg;
+}
+
+void twiSlave_setGeneralCallHandler(void (*handler)(unsigned char data)) {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	twiSlave_gcHandler = handler;
+	if(handler)
+		TWAR |= (1 << TWGCE);
+	else
+		TWAR &= ~(1 << TWGCE);
+	SREG = sreg;
+}
+
+unsigned char twiSlave_lastAddress() {
+	return twiSlave_address;
+}
+
+#endif
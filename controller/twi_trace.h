@@ -0,0 +1,170 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * This code is known to work with the following AVR uCs:
+ * atmega1284
+ *
+ * This code may work with other uCs so check your controller's
+ * datasheet to make sure.
+ *
+ * TWI transaction tracer: status codes, data and timestamps of
+ * every bus step.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef TWI_TRACE_H
+#define TWI_TRACE_H
+
+/* USE NOTES:
+ * 1.)	Define TWI_TRACE_ENABLE before including any library file
+ *		to record the bus steps of twi_utils.h, twi_master_async.h
+ *		and twi_slave.h.  Without it the TWI_TRACE macros expand to
+ *		nothing and the tracer takes no code or RAM.
+ * 2.)	Every completed step is stored with its TWSR status code,
+ *		the TWDR byte (the address or data that went over the bus)
+ *		and a clock_ticks timestamp, so clock_init must be called
+ *		first.  STOP, timeouts and bus recoveries are stored with
+ *		the TWI_TRACE_ pseudo status codes below.
+ * 3.)	The buffer keeps the last TWI_TRACE_SIZE steps (a power of
+ *		two, default 64), so after a failure it holds the steps
+ *		that led to it.  Each step takes 6 bytes of RAM.
+ * 4.)	twiTrace_dump writes the buffer through dump_utils.h, one
+ *		tab separated line per step after a header line with the
+ *		tick length.  Feed the output to host/twi_trace_decode for
+ *		an annotated timeline.
+ */
+
+// Pseudo status codes for events TWSR does not report; real codes are multiples of 8
+#define TWI_TRACE_STOP		0x01 // STOP sent
+#define TWI_TRACE_TIMEOUT	0x02 // twi_waitOnBusy gave up, data is the TWSR value
+#define TWI_TRACE_RECOVER	0x03 // twi_recover ran, data is 1 if the bus came free
+
+#ifndef TWI_TRACE_SIZE
+#define TWI_TRACE_SIZE 64
+#endif
+
+#ifdef TWI_TRACE_ENABLE
+
+#include <avr/io.h>
+
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include "clock_utils.h"
+#include "dump_utils.h"
+
+#if TWI_TRACE_SIZE & (TWI_TRACE_SIZE - 1)
+#error "TWI_TRACE_SIZE must be a power of two"
+#endif
+
+// One recorded bus step
+struct twi_trace_entry {
+	unsigned long stamp; // clock_ticks when the step completed
+	unsigned char status; // TWSR status code or TWI_TRACE_ pseudo code
+	unsigned char data; // TWDR at that point
+};
+
+//**************************USER AREA***************************
+
+// Record a step
+#define TWI_TRACE(status, data)		twiTrace_record(status, data)
+
+/** Empty the trace buffer.
+ */
+void twiTrace_clear();
+
+/** @return	Steps recorded since the last clear, including those overwritten
+ */
+unsigned long twiTrace_count();
+
+/** Write the buffered steps, oldest first, through dump_utils.h.
+ *  A "#twi" header line with F_CPU and the clock divider is followed by
+ *  one line per step: sequence number, ticks, status and data in hex.
+ */
+void twiTrace_dump();
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static struct twi_trace_entry twiTrace_buf[TWI_TRACE_SIZE];
+static unsigned long twiTrace_total = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the TWI_TRACE
+ * macro only and is not intended to be used as a stand
+ * alone library function.  Safe from interrupts. */
+void twiTrace_record(unsigned char status, unsigned char data) {
+	struct twi_trace_entry *entry;
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	entry = &twiTrace_buf[twiTrace_total & (TWI_TRACE_SIZE - 1)];
+	entry->stamp = clock_ticks();
+	entry->status = status;
+	entry->data = data;
+	++twiTrace_total;
+	SREG = sreg;
+}
+
+void twiTrace_clear() {
+	unsigned char sreg;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	twiTrace_total = 0;
+	SREG = sreg;
+}
+
+unsigned long twiTrace_count() {
+	unsigned char sreg;
+	unsigned long total;
+
+	sreg = SREG;
+	SREG &= 0x7F;
+	total = twiTrace_total;
+	SREG = sreg;
+	return total;
+}
+
+void twiTrace_dump() {
+	struct twi_trace_entry entry;
+	unsigned long total, seq;
+	unsigned char sreg;
+
+	total = twiTrace_count();
+	seq = total > TWI_TRACE_SIZE ? total - TWI_TRACE_SIZE : 0;
+
+	dump_string("#twi\t");
+	dump_ulong(F_CPU);
+	dump_char('\t');
+	dump_ulong(clock_getDivider());
+	dump_newline();
+	for(; seq < total; ++seq) {
+		sreg = SREG;
+		SREG &= 0x7F;
+		entry = twiTrace_buf[seq & (TWI_TRACE_SIZE - 1)];
+		SREG = sreg;
+		dump_ulong(seq);
+		dump_char('\t');
+		dump_ulong(entry.stamp);
+		dump_char('\t');
+		dump_hex(entry.status, 2);
+		dump_char('\t');
+		dump_hex(entry.data, 2);
+		dump_newline();
+	}
+}
+
+#else
+
+#define TWI_TRACE(status, data)		((void)0)
+
+#endif
+
+#endif
@@ -19,6 +19,34 @@
  * 2.)	In some cases, the hardware that you want to communicate
  *		with may have internal pull-up resistors.  This does not
  *		guarantee that additional resistors are not needed.
+ *
+ * 3.)	For register mapped devices (sensors, RTCs, EEPROMs) use the
+ *		twi_read_regs/twi_write_regs burst calls, or the 16 suffixed
+ *		versions for two byte addresses.  They send the register
+ *		once and then stream the data, relying on the device to
+ *		auto-increment its register pointer.  For EEPROMs pass the
+ *		page size: a page write wraps inside the page, so the calls
+ *		split the data at page boundaries and acknowledge poll the
+ *		device while it programs, the last page included, so the
+ *		device answers the next call.  twi_bench.h measures the gain
+ *		over the byte by byte sequence.  The code lives in
+ *		twi_regs.h and is shared with soft_twi.h.
+ *
+ * 4.)	Define TWI_TIMEOUT_US (ie. 25000) before including this file
+ *		to bound every wait on the bus.  The timeout is measured
+ *		with clock_utils.h, so clock_init must be called first.
+ *		Without it twi_waitOnBusy waits forever as it always has.
+ *
+ * 5.)	The high level calls (twi_writeRead and the register burst
+ *		calls) return 0 on failure; twi_getError then tells why and
+ *		twi_getErrorCount counts each kind of failure.  After a
+ *		timeout or bus error the interface is reset with
+ *		twi_recover, which also frees a slave stuck holding SDA low
+ *		by clocking SCL by hand.  After lost arbitration the bus
+ *		belongs to the other master; simply try again later.
+ *
+ * 6.)	Define TWI_TRACE_ENABLE to record every step in a ring
+ *		buffer, see twi_trace.h.
  */
 
 /* Typical Master Transmit sequence:
@@ -34,6 +62,14 @@
  *	10.) twi_send_stop();
 */
 
+/* Typical combined write-then-read sequence (twi_writeRead does this for you):
+ *	1.)	twi_sendStart(); twi_addressSlave(<slave_address>, TWI_WRITE); write the data as above
+ *	2.)	twi_sendStart(); without a STOP first.  The bus is still ours so this is a
+ *		repeated START: confirm TWI_MSTR_STAT_RESTART_TRANSMITTED
+ *	3.)	twi_addressSlave(<slave_address>, TWI_READ) and receive as below
+ *	4.)	twi_sendStop();
+*/
+
 /* Typical Master Receive sequence:
  *	1.)	twi_send_start();
  *	2.)	twi_wait_on_busy();	OR check twi_is_busy(); periodically until not busy
@@ -52,6 +88,28 @@
 
 #include <avr/io.h>
 
+// set F_CPU to your chip clock frequency. Default: 8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include <util/delay.h>
+
+#ifdef TWI_TIMEOUT_US
+#include "clock_utils.h"
+#endif
+
+#include "twi_trace.h"
+
+// Port and pins of SCL and SDA, used to clock a stuck bus free
+#ifndef TWI_PORT
+#define TWI_PORT	PORTC
+#define TWI_DDR		DDRC
+#define TWI_PIN		PINC
+#define TWI_SCL		PC0
+#define TWI_SDA		PC1
+#endif
+
 //**************************USER AREA***************************
 
 // Status flags for Master transmitter and receiver
@@ -94,6 +152,10 @@ enum TWI_PRESCALERS { TWI_PRESCALER_ONE, TWI_PRESCALER_4TH, TWI_PRESCALER_16TH,
 	
 enum TWI_READ_WRITE { TWI_WRITE, TWI_READ };
 
+// Reason for the last failure, see twi_getError
+enum TWI_ERRORS { TWI_OK, TWI_ERR_TIMEOUT, TWI_ERR_ADDR_NACK, TWI_ERR_DATA_NACK,
+	TWI_ERR_ARBITRATION, TWI_ERR_BUS, TWI_ERR_STATUS, TWI_ERR_COUNT };
+
 /** Set this uC's slave address and set wether or not it should
  *  respond to a "general" call.
  *  @param address					This controller's unique address. Value [0, 127]
@@ -109,18 +171,22 @@ void twi_maskMyAddress(unsigned char mask);
  */
 unsigned char twi_isBusy();
 
-/** Performs a busy wait until the line is free
+/** Performs a busy wait until the line is free.  With TWI_TIMEOUT_US
+ *  defined the wait gives up after that long, records TWI_ERR_TIMEOUT
+ *  and resets the bus with twi_recover.
+ *  @return	1 when the operation finished, 0 on timeout
  */
-void twi_waitOnBusy();
+unsigned char twi_waitOnBusy();
 
 /** Checks against the status register.
  *  @return 1 == status confirmed, 0 == not confirmed
  */
 unsigned char twi_confirmStatus(unsigned char statCode);
 
-/** XXX
+/** Set the bit rate, SCL = F_CPU / (16 + 2 * bitRate * 4^prescaler).
+ *  TWI_INIT_SCL in twi_rate.h works the values out from a target SCL.
  *  @param prescaler	One of the TWI_PRESCALERS enum values
- *  @param bitRate		xxx
+ *  @param bitRate		TWBR value [0, 255]
  */
 void twi_init(int prescaler, unsigned char bitRate);
 
@@ -158,10 +224,91 @@ unsigned char twi_receiveAck();
  */
 unsigned char twi_receiveNack();
 
+/** Write bytes to a slave then read bytes back in one bus transaction,
+ *  joined by a repeated START so no other master can take the bus in
+ *  between.  Blocks until done and always ends with a STOP.
+ *  @param slaveAddress	The unique address of the slave. Values [0, 127]
+ *  @param writeBuf		Bytes to write first (ie. a register pointer), may be 0 if writeLen is 0
+ *  @param writeLen		Number of bytes to write, 0 for a plain read
+ *  @param readBuf		Destination for the bytes read, may be 0 if readLen is 0
+ *  @param readLen		Number of bytes to read, 0 for a plain write
+ *  @return				1 if every step was acknowledged, 0 else
+ */
+unsigned char twi_writeRead(unsigned char slaveAddress, const unsigned char *writeBuf,
+	unsigned char writeLen, unsigned char *readBuf, unsigned char readLen);
+
+/** Burst write to consecutive registers of a device with an 8-bit register
+ *  address that auto-increments.  With a page size the write is split at
+ *  page boundaries and the device is acknowledge polled while it programs
+ *  each page, as EEPROMs need.  The call returns once the last page has
+ *  been programmed.
+ *  @param slaveAddress	The unique address of the slave. Values [0, 127]
+ *  @param reg			First register (or memory address)
+ *  @param buf			Bytes to write
+ *  @param len			Number of bytes to write
+ *  @param pageSize		EEPROM page size in bytes (power of two), 0 for devices without pages
+ *  @return				1 if every byte was acknowledged, 0 else
+ */
+unsigned char twi_write_regs(unsigned char slaveAddress, unsigned char reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize);
+
+/** Burst read from consecutive registers of a device with an 8-bit register
+ *  address.  The register write and the read are joined by a repeated START
+ *  and the last byte is NACKed.
+ *  @param slaveAddress	The unique address of the slave. Values [0, 127]
+ *  @param reg			First register (or memory address)
+ *  @param buf			Destination for the bytes read
+ *  @param len			Number of bytes to read, at least 1
+ *  @return				1 on success, 0 else
+ */
+unsigned char twi_read_regs(unsigned char slaveAddress, unsigned char reg,
+	unsigned char *buf, unsigned short len);
+
+/** As twi_write_regs for devices with a 16-bit register address (sent high byte first).
+ */
+unsigned char twi_write_regs16(unsigned char slaveAddress, unsigned short reg,
+	const unsigned char *buf, unsigned short len, unsigned short pageSize);
+
+/** As twi_read_regs for devices with a 16-bit register address (sent high byte first).
+ */
+unsigned char twi_read_regs16(unsigned char slaveAddress, unsigned short reg,
+	unsigned char *buf, unsigned short len);
+
+/** @return	Why the last high level call failed, one of the TWI_ERRORS enum values
+ */
+unsigned char twi_getError();
+
+/** @param error	One of the TWI_ERRORS enum values
+ *  @return			Number of failures of that kind, stops at 65535
+ */
+unsigned short twi_getErrorCount(unsigned char error);
+
+/** Clear the failure counters.
+ */
+void twi_clearErrorCounts();
+
+/** Free a stuck bus.  Disables the TWI, clocks SCL until the slave
+ *  holding SDA low lets go (at most 9 times), sends a STOP by hand
+ *  and enables the TWI again.  Each clock waits for a slave that
+ *  stretches it.  The bit rate, TWIE and TWEA (slave address
+ *  recognition, twi_slave.h) are kept.
+ *  @return	1 if both lines are high afterwards, 0 if the bus is still stuck
+ */
+unsigned char twi_recover();
+
 //****************************END USER AREA**************************************
 
 const unsigned char TWI_STAT_MASK = 0xF8;
 
+// Half SCL period of the hand clocked recovery, about 100kHz
+#define TWI_RECOVER_HALF_US 5
+
+// Longest a slave may stretch a hand clocked SCL pulse before recovery gives up
+#define TWI_RECOVER_STRETCH_US 1000
+
+// Address attempts while an EEPROM is busy programming a page (about 100us each at 100kHz)
+const unsigned short TWI_ACK_POLL_LIMIT = 200;
+
 // Status flags for Master transmitter and receiver
 const unsigned char TWI_MSTR_STAT_START_TRANSMITTED = 0x08;
 const unsigned char TWI_MSTR_STAT_RESTART_TRANSMITTED = 0x10;
@@ -197,6 +344,15 @@ const unsigned char TWI_SLV_STAT_DATA_RECEIPT_ACK = 0xC8;
 const unsigned char TWI_STAT_NO_INFO_AVAIL = 0xF8;
 const unsigned char TWI_STAT_BUS_ERR = 0x00;
 
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned char twi_error = TWI_OK;
+static unsigned short twi_errorCounts[TWI_ERR_COUNT];
+#ifdef TWI_TIMEOUT_US
+// TWI_TIMEOUT_US in clock_ticks, worked out for the clock divider it was computed for
+static unsigned long twi_timeoutTicks = 0;
+static unsigned short twi_timeoutDivider = 0;
+#endif
+
 //-----------------FUNCTION DEFINITIONS---------------------
 
 void twi_set_myAddress(unsigned char address, unsigned char acknowledgeGeneralCall) {
@@ -213,9 +369,42 @@ unsigned char twi_isBusy() {
 	return !(TWCR & (1 << TWINT));
 }
 
-void twi_waitOnBusy() {
+/* This function is designed to be used by the TWI
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+void twi_setError(unsigned char error) {
+	twi_error = error;
+	if(twi_errorCounts[error] != 0xFFFF)
+		++twi_errorCounts[error];
+}
+
+unsigned char twi_waitOnBusy() {
+#ifdef TWI_TIMEOUT_US
+	unsigned long start;
+
+	if(!twi_isBusy())
+		return 1;
+	start = clock_ticks();
+	// Scale the timeout once, the poll loop only does a 32-bit subtraction
+	if(twi_timeoutDivider != clock_getDivider()) {
+		twi_timeoutDivider = clock_getDivider();
+		twi_timeoutTicks = (unsigned long)((unsigned long long)F_CPU * TWI_TIMEOUT_US / 1000000UL) /
+			twi_timeoutDivider;
+	}
+	while(twi_isBusy()) {
+		if(clock_ticks() - start > twi_timeoutTicks) {
+			TWI_TRACE(TWI_TRACE_TIMEOUT, TWSR);
+			twi_setError(TWI_ERR_TIMEOUT);
+			twi_recover();
+			return 0;
+		}
+	}
+#else
 	while(twi_isBusy())
 		continue;
+#endif
+	TWI_TRACE(TWSR & TWI_STAT_MASK, TWDR);
+	return 1;
 }
 
 unsigned char twi_confirmStatus(unsigned char statCode) {
@@ -237,6 +426,7 @@ void twi_init(int prescaler, unsigned char bitRate) {
 		case TWI_PRESCALER_ONE:
 		default:
 			// no prescaler
+			break;
 	}
 
 	TWBR = bitRate;
@@ -252,6 +442,7 @@ void twi_sendStart() {
 
 void twi_sendStop() {
 	TWCR = (1 << TWSTO) | (1 << TWINT) | (1 << TWEN);
+	TWI_TRACE(TWI_TRACE_STOP, 0);
 }
 
 void twi_addressSlave(unsigned char slaveAddress, unsigned char read) {
@@ -283,4 +474,201 @@ unsigned char twi_receiveNack() {
 	return data;
 }
 
+/* This function is designed to be used by the TWI
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Records why the bus
+ * returned status instead of the expected one and leaves
+ * the interface ready for the next transaction. */
+void twi_fail(unsigned char status) {
+	if(status == TWI_MSTR_STAT_ARBITRATION_LOST) {
+		// Not our bus any more: let go without a STOP
+		twi_setError(TWI_ERR_ARBITRATION);
+		TWCR = (1 << TWINT) | (1 << TWEN);
+	}
+	else if(status == TWI_STAT_BUS_ERR) {
+		twi_setError(TWI_ERR_BUS);
+		twi_recover();
+	}
+	else {
+		if(status == TWI_MSTR_STAT_SLA_W_NACK || status == TWI_MSTR_STAT_SLA_R_NACK)
+			twi_setError(TWI_ERR_ADDR_NACK);
+		else if(status == TWI_MSTR_STAT_DATA_SEND_NACK)
+			twi_setError(TWI_ERR_DATA_NACK);
+		else
+			twi_setError(TWI_ERR_STATUS);
+		twi_sendStop();
+	}
+}
+
+/* This function is designed to be used by the TWI
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Waits for the operation
+ * in progress and checks its status.  On failure the error
+ * is recorded and the bus released. */
+unsigned char twi_await(unsigned char statCode) {
+	unsigned char status;
+
+	if(!twi_waitOnBusy())
+		return 0;
+	status = TWSR & TWI_STAT_MASK;
+	if(status == statCode)
+		return 1;
+	twi_fail(status);
+	return 0;
+}
+
+/* This function is designed to be used by the TWI
+ * functions only and is not intended to be used as a
+ * stand alone library function.  As twi_await for a START,
+ * which may be a repeated START. */
+unsigned char twi_awaitStart() {
+	unsigned char status;
+
+	if(!twi_waitOnBusy())
+		return 0;
+	status = TWSR & TWI_STAT_MASK;
+	if(status == TWI_MSTR_STAT_START_TRANSMITTED || status == TWI_MSTR_STAT_RESTART_TRANSMITTED)
+		return 1;
+	twi_fail(status);
+	return 0;
+}
+
+unsigned char twi_writeRead(unsigned char slaveAddress, const unsigned char *writeBuf,
+	unsigned char writeLen, unsigned char *readBuf, unsigned char readLen) {
+	unsigned char i;
+
+	twi_error = TWI_OK;
+	twi_sendStart();
+	if(!twi_awaitStart())
+		return 0;
+
+	if(writeLen || !readLen) {
+		twi_addressSlave(slaveAddress, TWI_WRITE);
+		if(!twi_await(TWI_MSTR_STAT_SLA_W_ACK))
+			return 0;
+		for(i = 0; i < writeLen; ++i) {
+			twi_transmitUchar(writeBuf[i]);
+			if(!twi_await(TWI_MSTR_STAT_DATA_SEND_ACK))
+				return 0;
+		}
+		if(readLen) {
+			twi_sendStart(); // Repeated START, we still own the bus
+			if(!twi_await(TWI_MSTR_STAT_RESTART_TRANSMITTED))
+				return 0;
+		}
+	}
+
+	if(readLen) {
+		twi_addressSlave(slaveAddress, TWI_READ);
+		if(!twi_await(TWI_MSTR_STAT_SLA_R_ACK))
+			return 0;
+		for(i = 0; i < readLen; ++i) {
+			// ACK every byte but the last so the slave releases the bus after it
+			if(i + 1 < readLen) {
+				TWCR = (1 << TWINT) | (1 << TWEA) | (1 << TWEN);
+				if(!twi_await(TWI_MSTR_STAT_DATA_RECEIVE_ACK))
+					return 0;
+			}
+			else {
+				TWCR = (1 << TWINT) | (1 << TWEN);
+				if(!twi_await(TWI_MSTR_STAT_DATA_RECEIVE_NACK))
+					return 0;
+			}
+			readBuf[i] = TWDR;
+		}
+	}
+
+	twi_sendStop();
+	return 1;
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  Clocks in the next byte
+ * and answers it with ACK if ack is set, NACK else. */
+void twi_receiveStart(unsigned char ack) {
+	TWCR = (1 << TWINT) | (ack ? (1 << TWEA) : 0) | (1 << TWEN);
+}
+
+/* This function is designed to be used by the register
+ * burst functions only and is not intended to be used as a
+ * stand alone library function.  The byte twi_receiveStart
+ * clocked in. */
+unsigned char twi_receivedData() {
+	return TWDR;
+}
+
+// Register burst functions, shared with soft_twi.h
+#define TWI_REGS_(name)		twi_##name
+#define TWI_REGS_BEGIN()	(twi_error = TWI_OK)
+#include "twi_regs.h"
+
+unsigned char twi_getError() {
+	return twi_error;
+}
+
+unsigned short twi_getErrorCount(unsigned char error) {
+	return error < TWI_ERR_COUNT ? twi_errorCounts[error] : 0;
+}
+
+void twi_clearErrorCounts() {
+	unsigned char i;
+
+	for(i = 0; i < TWI_ERR_COUNT; ++i)
+		twi_errorCounts[i] = 0;
+}
+
+/* This function is designed to be used by twi_recover only
+ * and is not intended to be used as a stand alone library
+ * function.  Releases SCL and waits for it to go high while a
+ * slave stretches the clock.  Returns 0 if SCL stays low. */
+unsigned char twi_releaseScl() {
+	unsigned short us;
+
+	TWI_DDR &= ~(1 << TWI_SCL);
+	for(us = 0; !(TWI_PIN & (1 << TWI_SCL)); ++us) {
+		if(us >= TWI_RECOVER_STRETCH_US)
+			return 0;
+		_delay_us(1);
+	}
+	return 1;
+}
+
+unsigned char twi_recover() {
+	unsigned char i, twcr = TWCR;
+
+	// Hand the pins back to the port.  Lines are driven open drain:
+	// output low to pull down, input to let the pull-up raise them.
+	TWCR = 0;
+	TWI_PORT &= ~((1 << TWI_SCL) | (1 << TWI_SDA));
+	TWI_DDR &= ~((1 << TWI_SCL) | (1 << TWI_SDA));
+	_delay_us(TWI_RECOVER_HALF_US);
+
+	// Each clock lets a slave that is mid byte shift out one more bit
+	for(i = 0; i < 9 && !(TWI_PIN & (1 << TWI_SDA)); ++i) {
+		TWI_DDR |= (1 << TWI_SCL);
+		_delay_us(TWI_RECOVER_HALF_US);
+		if(!twi_releaseScl())
+			break;
+		_delay_us(TWI_RECOVER_HALF_US);
+	}
+
+	// STOP: SDA rises while SCL is high
+	if(TWI_PIN & (1 << TWI_SCL)) {
+		TWI_DDR |= (1 << TWI_SCL);
+		_delay_us(TWI_RECOVER_HALF_US);
+		TWI_DDR |= (1 << TWI_SDA);
+		_delay_us(TWI_RECOVER_HALF_US);
+		twi_releaseScl();
+		_delay_us(TWI_RECOVER_HALF_US);
+		TWI_DDR &= ~(1 << TWI_SDA);
+		_delay_us(TWI_RECOVER_HALF_US);
+	}
+
+	TWCR = (twcr & ((1 << TWIE) | (1 << TWEA))) | (1 << TWEN);
+	i = (TWI_PIN & (1 << TWI_SCL)) && (TWI_PIN & (1 << TWI_SDA));
+	TWI_TRACE(TWI_TRACE_RECOVER, i);
+	return i;
+}
+
 #endif
\ No newline at end of file
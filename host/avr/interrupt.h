@@ -0,0 +1,21 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host stand-in for <avr/interrupt.h>.  An ISR is a plain function
+ * the simulator calls when its flag and enable bit are set and
+ * global interrupts are on (see host/timer_sim.h).
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector)	void vector()
+#define sei()		(SREG |= 0x80)
+#define cli()		(SREG &= 0x7F)
+
+#endif
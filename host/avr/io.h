@@ -0,0 +1,216 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host stand-in for <avr/io.h> used by the TWI simulator
+ * (host/twi_sim.h), the SD card emulator (host/sd_sim.h) and the
+ * timer simulator (host/timer_sim.h).  The TWI and SPI registers,
+ * TCNT1 and TIFR are proxies that run the simulation on every
+ * access; the port and other timer registers are plain variables.
+ * A program only links the simulator whose registers it uses.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#ifndef __cplusplus
+#error "The host simulations are built as C++, see host/twi_sim.h"
+#endif
+
+#include <stdint.h>
+
+// C11 spelling used by the compile time checks
+#ifndef _Static_assert
+#define _Static_assert static_assert
+#endif
+
+// Registers the simulator backs, see twiSim_readReg/twiSim_writeReg
+enum TWI_SIM_REGS { TWI_SIM_TWCR, TWI_SIM_TWSR, TWI_SIM_TWDR, TWI_SIM_TWBR, TWI_SIM_TWAR,
+	TWI_SIM_TWAMR, TWI_SIM_REG_COUNT };
+
+unsigned char twiSim_readReg(unsigned char reg);
+void twiSim_writeReg(unsigned char reg, unsigned char value);
+
+// Stands in for one TWI register: reads and writes go through the simulator
+struct twi_sim_reg {
+	unsigned char reg;
+
+	operator unsigned char() const { return twiSim_readReg(reg); }
+	twi_sim_reg &operator=(unsigned char value) { twiSim_writeReg(reg, value); return *this; }
+	twi_sim_reg &operator=(const twi_sim_reg &other) { return *this = (unsigned char)other; }
+	twi_sim_reg &operator|=(int value) { return *this = (unsigned char)(*this | value); }
+	twi_sim_reg &operator&=(int value) { return *this = (unsigned char)(*this & value); }
+};
+
+inline twi_sim_reg TWCR = { TWI_SIM_TWCR };
+inline twi_sim_reg TWSR = { TWI_SIM_TWSR };
+inline twi_sim_reg TWDR = { TWI_SIM_TWDR };
+inline twi_sim_reg TWBR = { TWI_SIM_TWBR };
+inline twi_sim_reg TWAR = { TWI_SIM_TWAR };
+inline twi_sim_reg TWAMR = { TWI_SIM_TWAMR };
+
+// Registers the SD card emulator backs, see spiSim_readReg/spiSim_writeReg
+enum SPI_SIM_REGS { SPI_SIM_SPCR, SPI_SIM_SPSR, SPI_SIM_SPDR, SPI_SIM_REG_COUNT };
+
+unsigned char spiSim_readReg(unsigned char reg);
+void spiSim_writeReg(unsigned char reg, unsigned char value);
+
+// Stands in for one SPI register: reads and writes go through the emulator
+struct spi_sim_reg {
+	unsigned char reg;
+
+	operator unsigned char() const { return spiSim_readReg(reg); }
+	spi_sim_reg &operator=(unsigned char value) { spiSim_writeReg(reg, value); return *this; }
+	spi_sim_reg &operator=(const spi_sim_reg &other) { return *this = (unsigned char)other; }
+	spi_sim_reg &operator|=(int value) { return *this = (unsigned char)(*this | value); }
+	spi_sim_reg &operator&=(int value) { return *this = (unsigned char)(*this & value); }
+};
+
+inline spi_sim_reg SPCR = { SPI_SIM_SPCR };
+inline spi_sim_reg SPSR = { SPI_SIM_SPSR };
+inline spi_sim_reg SPDR = { SPI_SIM_SPDR };
+
+unsigned short timerSim_readTcnt1();
+void timerSim_writeTcnt1(unsigned short value);
+unsigned char timerSim_readTifr();
+void timerSim_clearTifr(unsigned char flags);
+
+// Stands in for TCNT1: every read costs a timer1 tick, see host/timer_sim.h
+struct timer_sim_count {
+	operator unsigned short() const { return timerSim_readTcnt1(); }
+	timer_sim_count &operator=(unsigned short value) { timerSim_writeTcnt1(value); return *this; }
+};
+
+// Stands in for TIFR: writing a one clears the flag, as on the MCU
+struct timer_sim_flags {
+	operator unsigned char() const { return timerSim_readTifr(); }
+	timer_sim_flags &operator=(unsigned char flags) { timerSim_clearTifr(flags); return *this; }
+};
+
+inline timer_sim_count TCNT1;
+inline timer_sim_flags TIFR;
+inline volatile uint16_t OCR1A = 0, OCR1B = 0, ICR1 = 0;
+inline volatile uint8_t TCCR1A = 0, TCCR1B = 0, TIMSK = 0, SFIOR = 0;
+inline volatile uint8_t TCCR0 = 0, TCNT0 = 0, OCR0 = 0;
+inline volatile uint8_t TCCR2 = 0, TCNT2 = 0, OCR2 = 0, ASSR = 0;
+
+/* Lines read high (released) unless a test says otherwise.  Not
+ * volatile so the libraries can keep plain pointers to them. */
+inline uint8_t PORTB = 0, DDRB = 0, PINB = 0xFF;
+inline uint8_t PORTC = 0, DDRC = 0, PINC = 0xFF;
+inline uint8_t PORTD = 0, DDRD = 0, PIND = 0xFF;
+inline volatile uint8_t SREG = 0x80;
+
+// TWCR
+#define TWINT	7
+#define TWEA	6
+#define TWSTA	5
+#define TWSTO	4
+#define TWWC	3
+#define TWEN	2
+#define TWIE	0
+
+// TWSR
+#define TWPS1	1
+#define TWPS0	0
+
+// TWAR
+#define TWGCE	0
+
+// SPCR
+#define SPIE	7
+#define SPE		6
+#define DORD	5
+#define MSTR	4
+#define CPOL	3
+#define CPHA	2
+#define SPR1	1
+#define SPR0	0
+
+// SPSR
+#define SPIF	7
+#define WCOL	6
+#define SPI2X	0
+
+// TCCR0
+#define FOC0	7
+#define WGM00	6
+#define COM01	5
+#define COM00	4
+#define WGM01	3
+#define CS02	2
+#define CS01	1
+#define CS00	0
+
+// TCCR1A
+#define COM1A1	7
+#define COM1A0	6
+#define COM1B1	5
+#define COM1B0	4
+#define FOC1A	3
+#define FOC1B	2
+#define WGM11	1
+#define WGM10	0
+
+// TCCR1B
+#define ICNC1	7
+#define ICES1	6
+#define WGM13	4
+#define WGM12	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+
+// TCCR2
+#define FOC2	7
+#define WGM20	6
+#define COM21	5
+#define COM20	4
+#define WGM21	3
+#define CS22	2
+#define CS21	1
+#define CS20	0
+
+// ASSR
+#define AS2		3
+#define TCN2UB	2
+#define OCR2UB	1
+#define TCR2UB	0
+
+// TIMSK and TIFR
+#define OCIE2	7
+#define TOIE2	6
+#define TICIE1	5
+#define OCIE1A	4
+#define OCIE1B	3
+#define TOIE1	2
+#define OCIE0	1
+#define TOIE0	0
+#define OCF2	7
+#define TOV2	6
+#define ICF1	5
+#define OCF1A	4
+#define OCF1B	3
+#define TOV1	2
+#define OCF0	1
+#define TOV0	0
+
+// SFIOR
+#define PSR2	1
+#define PSR10	0
+
+#define PB0		0
+#define PB1		1
+#define PB3		3
+#define PC0		0
+#define PC1		1
+#define PC6		6
+#define PC7		7
+#define PD4		4
+#define PD5		5
+#define PD6		6
+#define PD7		7
+
+#endif
@@ -0,0 +1,16 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host stand-in for <avr/iom32.h>.  The register definitions all
+ * live in the host <avr/io.h>.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef HOST_AVR_IOM32_H
+#define HOST_AVR_IOM32_H
+
+#include <avr/io.h>
+
+#endif
@@ -0,0 +1,27 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host stand-in for <avr/sleep.h>: sleep_cpu runs the simulated
+ * timers until an interrupt wakes the MCU (see host/timer_sim.h).
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+enum HOST_SLEEP_MODES { SLEEP_MODE_IDLE, SLEEP_MODE_ADC, SLEEP_MODE_PWR_DOWN,
+	SLEEP_MODE_PWR_SAVE, SLEEP_MODE_STANDBY, SLEEP_MODE_EXT_STANDBY };
+
+void timerSim_sleep();
+
+inline unsigned char timerSim_sleepMode = SLEEP_MODE_IDLE;
+inline unsigned char timerSim_sleepEnabled = 0;
+
+#define set_sleep_mode(mode)	(timerSim_sleepMode = (mode))
+#define sleep_enable()			(timerSim_sleepEnabled = 1)
+#define sleep_disable()			(timerSim_sleepEnabled = 0)
+#define sleep_cpu()				timerSim_sleep()
+
+#endif
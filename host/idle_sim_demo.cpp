@@ -0,0 +1,74 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Runs the tickless idle of idle_utils.h on the simulated timer1 of
+ * host/timer_sim.h and checks that every deadline sleep wakes on
+ * time, including after the clock was moved on with clock_advance
+ * as it is after a power-save sleep.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build and run from the repository root:
+ *			g++ -DF_CPU=8000000UL -Ihost -Icontroller \
+ *				-o idle_sim_demo host/idle_sim_demo.cpp
+ *			./idle_sim_demo
+ *		The exit code is the number of failed checks.
+ */
+
+#include "timer_sim.h"
+#include "idle_utils.h"
+
+// A deadline sleep may end this many ticks late for the loop around it
+#define LATE_TICKS	16
+
+static int failures = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+void check(int ok, const char *what) {
+	printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok)
+		++failures;
+}
+
+/* Sleep for delay ticks from now and check the wakeup. */
+void sleepFor(unsigned long delay, const char *what) {
+	unsigned long deadline, late;
+	unsigned char reached;
+	char line[100];
+
+	deadline = clock_ticks() + delay;
+	reached = idle_sleepUntil(deadline);
+	late = clock_ticks() - deadline;
+	snprintf(line, sizeof(line), "%s (%lu ticks late)", what, late);
+	check(reached && late <= LATE_TICKS, line);
+}
+
+int main() {
+	struct idle_stats stats;
+
+	clock_init(TMR_PRESCALER_8TH);
+	idle_init(0);
+	sei();
+
+	sleepFor(5000, "deadline sleep");
+	sleepFor(70000, "deadline sleep across two timer1 overflows");
+	timerSim_run(1234);
+	sleepFor(20, "short deadline sleep");
+	idle_getStats(&stats);
+	check(stats.sleeps[IDLE_MODE_IDLE] >= 3 && !stats.earlyWakes, "idle sleeps were counted");
+	check(idle_getResidency() > 900, "  residency above 90%");
+
+	// The clock now runs ahead of TCNT1, as after a power-save sleep
+	clock_advance(40000);
+	sleepFor(5000, "deadline sleep after clock_advance");
+	clock_advance(123457);
+	sleepFor(300, "short deadline sleep after clock_advance");
+	sleepFor(70000, "deadline sleep across overflows after clock_advance");
+
+	printf("%d check(s) failed\n", failures);
+	return failures;
+}
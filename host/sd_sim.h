@@ -0,0 +1,507 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host side SD card emulator.  Runs storage/sd_card.h and the SPI
+ * code under it on a PC against a card whose blocks live in an
+ * image file.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build the program that includes this file as C++17 with the
+ *		host directory first on the include path, so the stand-in
+ *		<avr/io.h> replaces the real one:
+ *			g++ -DF_CPU=8000000UL -Ihost -Icontroller -Istorage \
+ *				-o sd_sim_demo host/sd_sim_demo.cpp
+ *		Include sd_sim.h before any library file.
+ * 2.)	SPCR, SPSR and SPDR are backed by a model of the SPI
+ *		master.  A byte written to SPDR is exchanged with the card
+ *		while its chip select (the pin given to sdSim_open) is low;
+ *		the byte received shows up in SPDR once SPSR has been
+ *		polled, as the receive buffer of the real SPI does.  The
+ *		SPI interrupt is not simulated.
+ * 3.)	sdSim_open backs the card with an image file of the given
+ *		number of blocks, created or grown as needed.  The card
+ *		type decides the init sequence it answers: SDHC (block
+ *		addresses), SD version 2, SD version 1 or MMC (byte
+ *		addresses).  Commands, data tokens, CRC7/CRC16 (when
+ *		turned on with CMD59) and busy signalling follow the SPI
+ *		mode of the SD specification.
+ * 4.)	Bus time is counted from the SPI prescaler: 8 SCK periods
+ *		per byte.  After each written block and each stop the card
+ *		stays busy for the bus time set with sdSim_setBusyUs, so a
+ *		driver that polls for ready pays for it in bus traffic and
+ *		one that yields can do other work.  Like real cards, blocks
+ *		of a CMD25 stream program faster than single blocks.
+ *		sdSim_busNs is the total.
+ * 5.)	sdSim_corruptNextRead flips a bit of the next block sent,
+ *		so its CRC16 no longer matches; sdSim_rejectNextWrite makes
+ *		the card answer the next data block with a write error.
+ * 6.)	sdSim_setVerbose(1) prints every command.
+ */
+
+#ifndef SD_SIM_H
+#define SD_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#define SD_SIM_BLOCK 512
+
+// Card types, see sdSim_open
+enum SD_SIM_TYPES { SD_SIM_SDHC, SD_SIM_SD2, SD_SIM_SD1, SD_SIM_MMC };
+
+// What the card does with the bytes it receives
+enum SD_SIM_STATES { SD_SIM_COMMAND, SD_SIM_READ_MULTI, SD_SIM_WRITE_TOKEN, SD_SIM_WRITE_DATA };
+
+//**************************USER AREA***************************
+
+/** Insert a card backed by an image file.
+ *  @param path		Image file, created if missing
+ *  @param blocks	Card size in blocks
+ *  @param type		enum SD_SIM_TYPES value
+ *  @param csPort	Port the chip select pin is on, ie. &PORTB
+ *  @param csMask	Chip select pin mask
+ *  @return			1 on success, 0 if the file cannot be opened
+ */
+unsigned char sdSim_open(const char *path, unsigned long blocks, unsigned char type,
+	uint8_t *csPort, unsigned char csMask);
+
+/** Remove the card and close its image.
+ */
+void sdSim_close();
+
+/** @param singleUs	Bus time the card stays busy after a CMD24 block
+ *  @param multiUs	Bus time the card stays busy after a CMD25 block or the stop token
+ */
+void sdSim_setBusyUs(double singleUs, double multiUs);
+
+/** Flip a bit of the next block the card sends.
+ */
+void sdSim_corruptNextRead();
+
+/** Answer the next data block with a write error.
+ */
+void sdSim_rejectNextWrite();
+
+/** @param verbose	1 to print every command
+ */
+void sdSim_setVerbose(unsigned char verbose);
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+double sdSim_busNs = 0; // Simulated SPI bus time so far
+unsigned long sdSim_bytes = 0; // Bytes clocked with the card selected
+unsigned long sdSim_blocksRead = 0;
+unsigned long sdSim_blocksWritten = 0;
+unsigned long sdSim_commands = 0;
+
+static unsigned char spiSim_regs[SPI_SIM_REG_COUNT];
+static unsigned char spiSim_pending = 0; // Byte shifting in, shown once SPSR is polled
+static unsigned char spiSim_shifting = 0;
+
+static FILE *sdSim_image = 0;
+static unsigned long sdSim_blocks = 0;
+static unsigned char sdSim_type = SD_SIM_SDHC;
+static uint8_t *sdSim_csPort = 0;
+static unsigned char sdSim_csMask = 0;
+static unsigned char sdSim_state = SD_SIM_COMMAND;
+static unsigned char sdSim_cmd[6];
+static unsigned char sdSim_cmdLen = 0;
+static unsigned char sdSim_out[SD_SIM_BLOCK + 8]; // Bytes the card sends next
+static unsigned short sdSim_outHead = 0;
+static unsigned short sdSim_outLen = 0;
+static unsigned char sdSim_data[SD_SIM_BLOCK + 2]; // Block being written, with CRC
+static unsigned short sdSim_dataLen = 0;
+static unsigned long sdSim_block = 0; // Next block to read or write
+static unsigned char sdSim_multi = 0; // 1 inside CMD25
+static unsigned char sdSim_idle = 1;
+static unsigned char sdSim_app = 0; // 1 after CMD55
+static unsigned char sdSim_crcOn = 0;
+static unsigned char sdSim_initPolls = 0;
+static double sdSim_busyUntil = 0;
+static double sdSim_singleBusyNs = 1000000.0;
+static double sdSim_multiBusyNs = 250000.0;
+static unsigned char sdSim_corrupt = 0;
+static unsigned char sdSim_reject = 0;
+static unsigned char sdSim_verbose = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* The functions below are designed to be used by the
+ * emulator only and are not intended to be used as stand
+ * alone library functions. */
+
+unsigned char sdSim_crc7(const unsigned char *data, unsigned char len) {
+	unsigned char crc = 0, i, bit, d;
+
+	for(i = 0; i < len; ++i) {
+		d = data[i];
+		for(bit = 0; bit < 8; ++bit) {
+			crc <<= 1;
+			if((d ^ crc) & 0x80)
+				crc ^= 0x09;
+			d <<= 1;
+		}
+	}
+	return crc & 0x7F;
+}
+
+unsigned short sdSim_crc16(const unsigned char *data, unsigned short len) {
+	unsigned short crc = 0, i;
+	unsigned char bit;
+
+	// Bit at a time, independent of the driver's byte at a time version
+	for(i = 0; i < len; ++i) {
+		crc ^= data[i] << 8;
+		for(bit = 0; bit < 8; ++bit)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+// One SCK period in ns at the current SPCR/SPSR settings
+double sdSim_sckNs() {
+	static const unsigned char DIV[] = { 4, 16, 64, 128 };
+	double div = DIV[spiSim_regs[SPI_SIM_SPCR] & 0x03];
+
+	if(spiSim_regs[SPI_SIM_SPSR] & (1 << SPI2X))
+		div /= 2;
+	return 1e9 * div / F_CPU;
+}
+
+void sdSim_queue(unsigned char data) {
+	if(sdSim_outHead + sdSim_outLen < sizeof(sdSim_out))
+		sdSim_out[sdSim_outHead + sdSim_outLen++] = data;
+}
+
+void sdSim_flushOut() {
+	sdSim_outHead = 0;
+	sdSim_outLen = 0;
+}
+
+// Appends the gap, token, data and CRC of a read block
+void sdSim_queueBlock() {
+	unsigned char block[SD_SIM_BLOCK];
+	unsigned short crc, i;
+
+	memset(block, 0, sizeof(block));
+	if(fseek(sdSim_image, (long)(sdSim_block * SD_SIM_BLOCK), SEEK_SET) == 0)
+		(void)!fread(block, 1, sizeof(block), sdSim_image);
+	crc = sdSim_crc16(block, sizeof(block));
+	if(sdSim_corrupt) {
+		sdSim_corrupt = 0;
+		block[17] ^= 0x10;
+	}
+	sdSim_queue(0xFF);
+	sdSim_queue(0xFE);
+	for(i = 0; i < SD_SIM_BLOCK; ++i)
+		sdSim_queue(block[i]);
+	sdSim_queue(crc >> 8);
+	sdSim_queue(crc);
+	++sdSim_block;
+	++sdSim_blocksRead;
+}
+
+// Checks the address argument of a data command
+unsigned char sdSim_address(unsigned long arg) {
+	if(sdSim_type == SD_SIM_SDHC)
+		sdSim_block = arg;
+	else {
+		if(arg % SD_SIM_BLOCK)
+			return 0x20; // Address error
+		sdSim_block = arg / SD_SIM_BLOCK;
+	}
+	return sdSim_block < sdSim_blocks ? 0 : 0x40; // Parameter error
+}
+
+void sdSim_command() {
+	unsigned char cmd = sdSim_cmd[0] & 0x3F;
+	unsigned long arg = ((unsigned long)sdSim_cmd[1] << 24) | ((unsigned long)sdSim_cmd[2] << 16) |
+		(sdSim_cmd[3] << 8) | sdSim_cmd[4];
+	unsigned char r1 = sdSim_idle ? 0x01 : 0x00;
+	unsigned char app = sdSim_app;
+
+	++sdSim_commands;
+	sdSim_app = 0;
+	if(sdSim_verbose)
+		printf("  [sd %10.1f us] %sCMD%u 0x%08lX\n", sdSim_busNs / 1000.0, app ? "A" : "", cmd, arg);
+	if(cmd == 12 && sdSim_state == SD_SIM_READ_MULTI) {
+		sdSim_flushOut();
+		sdSim_state = SD_SIM_COMMAND;
+	}
+	// CMD0 and CMD8 always carry a valid CRC, the rest once CMD59 turned checking on
+	if((sdSim_crcOn || cmd == 0 || cmd == 8) && (sdSim_crc7(sdSim_cmd, 5) << 1 | 1) != sdSim_cmd[5]) {
+		sdSim_queue(r1 | 0x08);
+		return;
+	}
+	if(cmd == 12)
+		sdSim_queue(0xFF); // Stuff byte
+
+	if(app) {
+		if(cmd == 41) {
+			// Comes out of idle after a few polls, SDHC only if the host supports it
+			if(sdSim_initPolls < 3)
+				++sdSim_initPolls;
+			else if(sdSim_type != SD_SIM_SDHC || arg & 0x40000000UL)
+				sdSim_idle = 0;
+			sdSim_queue(sdSim_idle);
+		}
+		else if(cmd == 23)
+			sdSim_queue(r1);
+		else
+			sdSim_queue(r1 | 0x04);
+		return;
+	}
+
+	switch(cmd) {
+		case 0:
+			sdSim_idle = 1;
+			sdSim_crcOn = 0;
+			sdSim_initPolls = 0;
+			sdSim_multi = 0;
+			sdSim_state = SD_SIM_COMMAND;
+			sdSim_queue(0x01);
+			break;
+		case 1:
+			if(sdSim_type != SD_SIM_MMC) {
+				sdSim_queue(r1 | 0x04);
+				break;
+			}
+			if(sdSim_initPolls < 3)
+				++sdSim_initPolls;
+			else
+				sdSim_idle = 0;
+			sdSim_queue(sdSim_idle);
+			break;
+		case 8:
+			if(sdSim_type == SD_SIM_SD1 || sdSim_type == SD_SIM_MMC) {
+				sdSim_queue(r1 | 0x04);
+				break;
+			}
+			sdSim_queue(r1);
+			sdSim_queue(0x00);
+			sdSim_queue(0x00);
+			sdSim_queue(sdSim_cmd[3] & 0x0F);
+			sdSim_queue(sdSim_cmd[4]);
+			break;
+		case 12:
+			sdSim_queue(r1);
+			break;
+		case 13:
+			sdSim_queue(r1);
+			sdSim_queue(0x00);
+			break;
+		case 16:
+			sdSim_queue(arg == SD_SIM_BLOCK ? r1 : r1 | 0x40);
+			break;
+		case 17:
+		case 18:
+		case 24:
+		case 25:
+			if(sdSim_idle) {
+				sdSim_queue(r1 | 0x04);
+				break;
+			}
+			r1 = sdSim_address(arg);
+			sdSim_queue(r1);
+			if(r1)
+				break;
+			if(cmd == 17 || cmd == 18) {
+				// The data follows the R1 after a gap
+				sdSim_state = cmd == 18 ? SD_SIM_READ_MULTI : SD_SIM_COMMAND;
+				sdSim_queueBlock();
+			}
+			else {
+				sdSim_multi = cmd == 25;
+				sdSim_state = SD_SIM_WRITE_TOKEN;
+			}
+			break;
+		case 55:
+			if(sdSim_type == SD_SIM_MMC) {
+				sdSim_queue(r1 | 0x04);
+				break;
+			}
+			sdSim_app = 1;
+			sdSim_queue(r1);
+			break;
+		case 58:
+			sdSim_queue(r1);
+			sdSim_queue(0x80 | (sdSim_type == SD_SIM_SDHC && !sdSim_idle ? 0x40 : 0));
+			sdSim_queue(0xFF);
+			sdSim_queue(0x80);
+			sdSim_queue(0x00);
+			break;
+		case 59:
+			sdSim_crcOn = arg & 0x01;
+			sdSim_queue(r1);
+			break;
+		default:
+			sdSim_queue(r1 | 0x04);
+			break;
+	}
+}
+
+// Stores a received data block and answers with the data response
+void sdSim_writeBlock() {
+	unsigned short crc = (sdSim_data[SD_SIM_BLOCK] << 8) | sdSim_data[SD_SIM_BLOCK + 1];
+
+	if(sdSim_crcOn && crc != sdSim_crc16(sdSim_data, SD_SIM_BLOCK)) {
+		sdSim_queue(0xEB);
+	}
+	else if(sdSim_reject || sdSim_block >= sdSim_blocks) {
+		sdSim_reject = 0;
+		sdSim_queue(0xED);
+	}
+	else {
+		fseek(sdSim_image, (long)(sdSim_block * SD_SIM_BLOCK), SEEK_SET);
+		fwrite(sdSim_data, 1, SD_SIM_BLOCK, sdSim_image);
+		++sdSim_block;
+		++sdSim_blocksWritten;
+		sdSim_queue(0xE5);
+	}
+	sdSim_busyUntil = sdSim_busNs + (sdSim_multi ? sdSim_multiBusyNs : sdSim_singleBusyNs);
+	sdSim_state = sdSim_multi ? SD_SIM_WRITE_TOKEN : SD_SIM_COMMAND;
+}
+
+// One byte each way between the SPI master and a selected card
+unsigned char sdSim_exchange(unsigned char in) {
+	unsigned char out;
+
+	if(sdSim_outLen) {
+		out = sdSim_out[sdSim_outHead++];
+		if(!--sdSim_outLen)
+			sdSim_outHead = 0;
+	}
+	else
+		out = sdSim_busNs < sdSim_busyUntil ? 0x00 : 0xFF;
+	if(sdSim_state == SD_SIM_READ_MULTI && !sdSim_outLen) {
+		if(sdSim_block < sdSim_blocks)
+			sdSim_queueBlock();
+	}
+
+	if(sdSim_state == SD_SIM_WRITE_DATA) {
+		sdSim_data[sdSim_dataLen++] = in;
+		if(sdSim_dataLen == sizeof(sdSim_data))
+			sdSim_writeBlock();
+	}
+	else if(sdSim_state == SD_SIM_WRITE_TOKEN) {
+		if(sdSim_busNs < sdSim_busyUntil)
+			return out; // Nothing is taken in while programming
+		if(in == (sdSim_multi ? 0xFC : 0xFE)) {
+			sdSim_state = SD_SIM_WRITE_DATA;
+			sdSim_dataLen = 0;
+		}
+		else if(sdSim_multi && in == 0xFD) {
+			if(sdSim_verbose)
+				printf("  [sd %10.1f us] stop token\n", sdSim_busNs / 1000.0);
+			sdSim_multi = 0;
+			sdSim_state = SD_SIM_COMMAND;
+			sdSim_queue(0xFF);
+			sdSim_busyUntil = sdSim_busNs + sdSim_multiBusyNs;
+		}
+	}
+	else if(sdSim_cmdLen || (in & 0xC0) == 0x40) {
+		sdSim_cmd[sdSim_cmdLen++] = in;
+		if(sdSim_cmdLen == sizeof(sdSim_cmd)) {
+			sdSim_cmdLen = 0;
+			sdSim_command();
+		}
+	}
+	return out;
+}
+
+unsigned char spiSim_readReg(unsigned char reg) {
+	if(reg == SPI_SIM_SPSR && spiSim_shifting) {
+		// The transfer finishes while the master polls
+		spiSim_shifting = 0;
+		spiSim_regs[SPI_SIM_SPDR] = spiSim_pending;
+		spiSim_regs[SPI_SIM_SPSR] |= (1 << SPIF);
+	}
+	else if(reg == SPI_SIM_SPDR)
+		spiSim_regs[SPI_SIM_SPSR] &= ~((1 << SPIF) | (1 << WCOL));
+	return spiSim_regs[reg];
+}
+
+void spiSim_writeReg(unsigned char reg, unsigned char value) {
+	if(reg == SPI_SIM_SPSR) {
+		// Only SPI2X can be written
+		spiSim_regs[reg] = (spiSim_regs[reg] & ~(1 << SPI2X)) | (value & (1 << SPI2X));
+	}
+	else if(reg == SPI_SIM_SPDR) {
+		if(spiSim_shifting) {
+			spiSim_regs[SPI_SIM_SPSR] |= (1 << WCOL);
+			return;
+		}
+		spiSim_regs[SPI_SIM_SPSR] &= ~((1 << SPIF) | (1 << WCOL));
+		sdSim_busNs += 8 * sdSim_sckNs();
+		if(sdSim_image && !(*sdSim_csPort & sdSim_csMask)) {
+			++sdSim_bytes;
+			spiSim_pending = sdSim_exchange(value);
+		}
+		else
+			spiSim_pending = 0xFF; // Nobody drives MISO
+		spiSim_shifting = 1;
+	}
+	else
+		spiSim_regs[reg] = value;
+}
+
+unsigned char sdSim_open(const char *path, unsigned long blocks, unsigned char type,
+	uint8_t *csPort, unsigned char csMask) {
+	sdSim_close();
+	sdSim_image = fopen(path, "r+b");
+	if(!sdSim_image)
+		sdSim_image = fopen(path, "w+b");
+	if(!sdSim_image)
+		return 0;
+	sdSim_blocks = blocks;
+	sdSim_type = type;
+	sdSim_csPort = csPort;
+	sdSim_csMask = csMask;
+	sdSim_state = SD_SIM_COMMAND;
+	sdSim_cmdLen = 0;
+	sdSim_flushOut();
+	sdSim_idle = 1;
+	sdSim_app = 0;
+	sdSim_crcOn = 0;
+	sdSim_initPolls = 0;
+	sdSim_multi = 0;
+	sdSim_busyUntil = 0;
+	return 1;
+}
+
+void sdSim_close() {
+	if(sdSim_image)
+		fclose(sdSim_image);
+	sdSim_image = 0;
+}
+
+void sdSim_setBusyUs(double singleUs, double multiUs) {
+	sdSim_singleBusyNs = singleUs * 1000.0;
+	sdSim_multiBusyNs = multiUs * 1000.0;
+}
+
+void sdSim_corruptNextRead() {
+	sdSim_corrupt = 1;
+}
+
+void sdSim_rejectNextWrite() {
+	sdSim_reject = 1;
+}
+
+void sdSim_setVerbose(unsigned char verbose) {
+	sdSim_verbose = verbose;
+}
+
+#endif
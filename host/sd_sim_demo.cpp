@@ -0,0 +1,172 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Runs the SD card driver against the emulated card of
+ * host/sd_sim.h: init of every card type, block reads and writes,
+ * the error paths and double buffered logging, with the bus time
+ * each way of writing takes.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build and run from the repository root:
+ *			g++ -DF_CPU=8000000UL -Ihost -Icontroller -Istorage \
+ *				-o sd_sim_demo host/sd_sim_demo.cpp
+ *			./sd_sim_demo [image] [-v]
+ *		The card image defaults to sd_sim.img in the current
+ *		directory.  -v prints every command.  The exit code is the
+ *		number of failed checks.
+ */
+
+#include "sd_sim.h"
+#include "sd_card.h"
+
+#define DEMO_CS		(1 << 4)
+#define DEMO_BLOCKS	4096UL
+#define LOG_BLOCKS	32
+#define LOG_RATE	200000.0 // Bytes per second
+
+static int failures = 0;
+static unsigned long yields = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+void check(int ok, const char *what) {
+	printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok)
+		++failures;
+}
+
+void countYield() {
+	++yields;
+}
+
+// Byte i of the test data
+unsigned char pattern(unsigned long i) {
+	return (unsigned char)(i * 7 + (i >> 9));
+}
+
+void fill(unsigned char *buf, unsigned long first, unsigned short len) {
+	unsigned short i;
+
+	for(i = 0; i < len; ++i)
+		buf[i] = pattern(first + i);
+}
+
+unsigned char matches(const unsigned char *buf, unsigned long first, unsigned short len) {
+	unsigned short i;
+
+	for(i = 0; i < len; ++i) {
+		if(buf[i] != pattern(first + i))
+			return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	static const char *const TYPES[] = { "SDHC", "SD version 2", "SD version 1", "MMC" };
+	static const unsigned char DRIVER_TYPES[] = { SD_TYPE_SDHC, SD_TYPE_SD2, SD_TYPE_SD1, SD_TYPE_MMC };
+	const char *path = "sd_sim.img";
+	unsigned char block[SD_BLOCK_SIZE], blocks[3 * SD_BLOCK_SIZE], chunk[32];
+	struct sd_card card;
+	struct sd_log log;
+	unsigned long i, produced;
+	unsigned char type, ok;
+	double start, singleNs, streamNs;
+	char what[80];
+
+	for(i = 1; i < (unsigned long)argc; ++i) {
+		if(!strcmp(argv[i], "-v"))
+			sdSim_setVerbose(1);
+		else
+			path = argv[i];
+	}
+	initMasterSPI(0, SPI_PRESCALER_HALF);
+
+	for(type = SD_SIM_SDHC; type <= SD_SIM_MMC; ++type) {
+		if(!sdSim_open(path, DEMO_BLOCKS, type, &PORTB, DEMO_CS)) {
+			printf("cannot open %s\n", path);
+			return 1;
+		}
+		snprintf(what, sizeof(what), "%s card initializes", TYPES[type]);
+		check(sd_init(&card, &PORTB, &DDRB, DEMO_CS, SPI_PRESCALER_HALF) &&
+			card.type == DRIVER_TYPES[type], what);
+		fill(block, 5UL * SD_BLOCK_SIZE, SD_BLOCK_SIZE);
+		memset(blocks, 0, sizeof(blocks));
+		snprintf(what, sizeof(what), "  %s block write and read back", TYPES[type]);
+		check(sd_writeBlock(&card, 5, block) && sd_readBlock(&card, 5, blocks) &&
+			matches(blocks, 5UL * SD_BLOCK_SIZE, SD_BLOCK_SIZE), what);
+	}
+
+	// Errors, on the MMC card still inserted
+#if SD_CRC
+	sdSim_corruptNextRead();
+	check(!sd_readBlock(&card, 5, block) && sd_getError(&card) == SD_ERR_CRC, "corrupted block fails its CRC16");
+#endif
+	sdSim_rejectNextWrite();
+	check(!sd_writeBlock(&card, 5, block) && sd_getError(&card) == SD_ERR_WRITE, "rejected write is reported");
+	check(!sd_readBlock(&card, DEMO_BLOCKS, block) && sd_getError(&card) == SD_ERR_CMD,
+		"read past the end is refused");
+
+	// Single blocks against a stream, on an SDHC card
+	sdSim_open(path, DEMO_BLOCKS, SD_SIM_SDHC, &PORTB, DEMO_CS);
+	sd_init(&card, &PORTB, &DDRB, DEMO_CS, SPI_PRESCALER_HALF);
+	sd_setYield(countYield);
+
+	start = sdSim_busNs;
+	ok = 1;
+	for(i = 0; i < LOG_BLOCKS && ok; ++i) {
+		fill(block, i * SD_BLOCK_SIZE, SD_BLOCK_SIZE);
+		ok = sd_writeBlock(&card, 200 + i, block);
+	}
+	ok = ok && sd_waitReady(&card);
+	singleNs = sdSim_busNs - start;
+	check(ok, "single block writes");
+
+	start = sdSim_busNs;
+	ok = sd_writeStart(&card, 300, LOG_BLOCKS);
+	for(i = 0; i < LOG_BLOCKS && ok; ++i) {
+		fill(block, i * SD_BLOCK_SIZE, SD_BLOCK_SIZE);
+		ok = sd_writeNext(&card, block);
+	}
+	ok = ok && sd_writeStop(&card) && sd_waitReady(&card);
+	streamNs = sdSim_busNs - start;
+	check(ok, "streamed writes");
+	printf("      %d blocks at %lu kHz SCK: single writes %.1f ms (%.0f KB/s), stream %.1f ms (%.0f KB/s)\n",
+		LOG_BLOCKS, (unsigned long)(F_CPU / 2000), singleNs / 1e6, LOG_BLOCKS * 0.5 / (singleNs / 1e9),
+		streamNs / 1e6, LOG_BLOCKS * 0.5 / (streamNs / 1e9));
+	check(streamNs < singleNs, "streaming takes less bus time");
+
+	/* The data arrives at LOG_RATE, as from an ADC interrupt, while the
+	 * main loop services the log between 20us of other work. */
+	start = sdSim_busNs;
+	produced = 0;
+	ok = sd_logBegin(&log, &card, 100, LOG_BLOCKS);
+	while(ok && produced < LOG_BLOCKS * SD_BLOCK_SIZE) {
+		if(produced < (sdSim_busNs - start) * LOG_RATE / 1e9) {
+			fill(chunk, produced, sizeof(chunk));
+			sd_logPut(&log, chunk, sizeof(chunk));
+			produced += sizeof(chunk);
+		}
+		sd_logService(&log);
+		sdSim_busNs += 20000;
+	}
+	ok = ok && sd_logEnd(&log) && sd_waitReady(&card);
+	check(ok && log.blocks == LOG_BLOCKS, "double buffered log");
+	snprintf(what, sizeof(what), "  nothing dropped at %.0f KB/s", LOG_RATE / 1000);
+	check(log.dropped == 0, what);
+	check(yields > 0, "  busy waits yielded");
+
+	ok = 1;
+	for(i = 0; i < LOG_BLOCKS && ok; i += 3) {
+		ok = sd_readBlocks(&card, 100 + i, blocks, 3) &&
+			matches(blocks, i * SD_BLOCK_SIZE, i + 3 <= LOG_BLOCKS ? sizeof(blocks) : (LOG_BLOCKS - i) * SD_BLOCK_SIZE);
+	}
+	check(ok, "multi-block read returns the logged data");
+
+	sdSim_close();
+	printf("%d check(s) failed\n", failures);
+	return failures;
+}
@@ -0,0 +1,164 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host side timer1 simulator.  Runs clock_utils.h and the libraries
+ * built on it (ie. idle_utils.h) on a PC.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build the program that includes this file as C++ with the
+ *		host directory first on the include path, so the stand-in
+ *		<avr/io.h>, <avr/interrupt.h> and <avr/sleep.h> replace the
+ *		real ones:
+ *			g++ -DF_CPU=8000000UL -Ihost -Icontroller \
+ *				-o idle_sim_demo host/idle_sim_demo.cpp
+ *		Include timer_sim.h before any library file.
+ * 2.)	Timer1 counts in normal mode whenever TCCR1B selects a
+ *		clock.  Time is kept in timer1 ticks, not CPU cycles: every
+ *		read of TCNT1 costs one tick, so a loop that polls the
+ *		clock still moves forward, and timerSim_run stands in for
+ *		other work.  Timers 0 and 2 are plain registers.
+ * 3.)	Compare matches and overflows set their TIFR flags and call
+ *		TIMER1_COMPA_vect, TIMER1_COMPB_vect or TIMER1_OVF_vect
+ *		when the interrupt and global interrupts are enabled, in
+ *		the MCU's priority order.  Vectors a program does not
+ *		define are skipped.
+ * 4.)	sleep_cpu in idle mode runs timer1 until an interrupt wakes
+ *		the MCU.  Sleep modes that halt timer1 are not simulated;
+ *		account for them with clock_advance as the MCU would.  A
+ *		sleep that no interrupt ends within TIMER_SIM_SLEEP_LIMIT
+ *		ticks stops the program with a message instead of hanging.
+ */
+
+#ifndef TIMER_SIM_H
+#define TIMER_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+// Ticks a sleep may last before the program counts as hung
+#ifndef TIMER_SIM_SLEEP_LIMIT
+#define TIMER_SIM_SLEEP_LIMIT 0x1000000UL
+#endif
+
+// Defined by the libraries under test, if at all
+void TIMER1_COMPA_vect() __attribute__((weak));
+void TIMER1_COMPB_vect() __attribute__((weak));
+void TIMER1_OVF_vect() __attribute__((weak));
+
+//**************************USER AREA***************************
+
+/** Let timer1 run, as if the CPU did other work.
+ *  @param ticks	Timer1 ticks to run for
+ */
+void timerSim_run(unsigned long ticks);
+
+/** @return	Timer1 ticks simulated so far
+ */
+unsigned long long timerSim_getTicks();
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static unsigned short timerSim_tcnt1 = 0;
+static unsigned char timerSim_tifr = 0;
+static unsigned long long timerSim_ticks = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function.  Runs the highest priority pending
+ * interrupt, if any.  Returns 1 if one ran. */
+unsigned char timerSim_dispatch() {
+	static const unsigned char FLAGS[] = { (1 << OCF1A), (1 << OCF1B), (1 << TOV1) };
+	static const unsigned char ENABLES[] = { (1 << OCIE1A), (1 << OCIE1B), (1 << TOIE1) };
+	void (*const vectors[])() = { TIMER1_COMPA_vect, TIMER1_COMPB_vect, TIMER1_OVF_vect };
+	unsigned char i;
+
+	if(!(SREG & 0x80))
+		return 0;
+	for(i = 0; i < 3; ++i) {
+		if((timerSim_tifr & FLAGS[i]) && (TIMSK & ENABLES[i]) && vectors[i]) {
+			timerSim_tifr &= ~FLAGS[i];
+			SREG &= 0x7F;
+			vectors[i]();
+			SREG |= 0x80;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function.  One timer1 tick.  Returns 1 if an
+ * interrupt ran. */
+unsigned char timerSim_step() {
+	++timerSim_ticks;
+	if(TCCR1B & ((1 << CS12) | (1 << CS11) | (1 << CS10))) {
+		if(!++timerSim_tcnt1)
+			timerSim_tifr |= (1 << TOV1);
+		if(timerSim_tcnt1 == OCR1A)
+			timerSim_tifr |= (1 << OCF1A);
+		if(timerSim_tcnt1 == OCR1B)
+			timerSim_tifr |= (1 << OCF1B);
+	}
+	return timerSim_dispatch();
+}
+
+unsigned short timerSim_readTcnt1() {
+	unsigned short count = timerSim_tcnt1;
+
+	timerSim_step();
+	return count;
+}
+
+void timerSim_writeTcnt1(unsigned short value) {
+	timerSim_tcnt1 = value;
+}
+
+unsigned char timerSim_readTifr() {
+	return timerSim_tifr;
+}
+
+void timerSim_clearTifr(unsigned char flags) {
+	timerSim_tifr &= ~flags;
+}
+
+void timerSim_sleep() {
+	unsigned long ticks;
+
+	if(!timerSim_sleepEnabled)
+		return;
+	if(timerSim_sleepMode != SLEEP_MODE_IDLE) {
+		printf("timer_sim: only idle sleep is simulated\n");
+		exit(1);
+	}
+	if(timerSim_dispatch())
+		return;
+	for(ticks = 0; ticks < TIMER_SIM_SLEEP_LIMIT; ++ticks) {
+		if(timerSim_step())
+			return;
+	}
+	printf("timer_sim: no interrupt woke the MCU after %lu ticks\n", (unsigned long)TIMER_SIM_SLEEP_LIMIT);
+	exit(1);
+}
+
+void timerSim_run(unsigned long ticks) {
+	while(ticks--)
+		timerSim_step();
+}
+
+unsigned long long timerSim_getTicks() {
+	return timerSim_ticks;
+}
+
+#endif
@@ -0,0 +1,525 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host side TWI bus simulator.  Runs twi_utils.h and the drivers
+ * built on it on a PC against simulated slave devices.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build the program that includes this file as C++ with the
+ *		host directory first on the include path, so the stand-in
+ *		<avr/io.h> and <util/delay.h> replace the real ones:
+ *			g++ -DF_CPU=8000000UL -Ihost -Icontroller -Isensors \
+ *				-o twi_sim_demo host/twi_sim_demo.cpp
+ *		Include twi_sim.h before any library file.
+ * 2.)	TWCR, TWSR, TWDR, TWBR, TWAR and TWAMR are backed by a model
+ *		of the TWI master: writing TWCR with TWINT set runs the bus
+ *		operation at once and sets TWINT with the status code the
+ *		hardware would report.  Slave mode and the TWI interrupt
+ *		are not simulated.
+ * 3.)	Slaves are struct twi_sim_slave models attached with
+ *		twiSim_attach.  twiSim_memoryInit gives a register mapped
+ *		device with an auto-incrementing pointer (ie. a sensor or a
+ *		small EEPROM; set its writeCycleNs and it NACKs its address
+ *		while it programs after a write, as an EEPROM does);
+ *		twiSim_nunchuckInit a Wii nunchuck that
+ *		follows both the encrypted (0x40 = 0x00) and unencrypted
+ *		(0xF0 = 0x55, 0xFB = 0x00) init sequences.
+ * 4.)	Bus time is counted from the bit rate registers: 9 SCL
+ *		periods per byte, one per START and STOP, plus any clock
+ *		stretching of the slave and _delay_us calls.  twiSim_busNs
+ *		is the running total and twiSim_lastTransactionNs the time
+ *		from the last START to its STOP, so driver strategies can
+ *		be compared by the bus time they take.
+ * 5.)	twiSim_nackNextAddress, twiSim_nackNextData and
+ *		twiSim_busErrorAfter inject failures.  A driver that polls
+ *		TWCR for an operation that will never finish is stopped
+ *		with a message after TWI_SIM_POLL_LIMIT polls instead of
+ *		hanging the test.
+ * 6.)	twiSim_setVerbose(1) prints every bus step.
+ */
+
+#ifndef TWI_SIM_H
+#define TWI_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <util/delay.h>
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#ifndef TWI_SIM_MAX_SLAVES
+#define TWI_SIM_MAX_SLAVES 8
+#endif
+
+// Reads of TWCR without TWINT before the driver counts as hung
+#ifndef TWI_SIM_POLL_LIMIT
+#define TWI_SIM_POLL_LIMIT 1000000UL
+#endif
+
+// A simulated slave.  The callbacks get the model pointer back.
+struct twi_sim_slave {
+	unsigned char address; // 7-bit address
+	void *model;
+	unsigned char (*start)(void *model, unsigned char read); // Addressed, return 1 to ACK
+	unsigned char (*write)(void *model, unsigned char data); // Byte from the master, return 1 to ACK
+	unsigned char (*read)(void *model); // Byte for the master
+	void (*stop)(void *model); // STOP on the bus, may be 0
+	double stretchNs; // Clock stretching per byte
+};
+
+// Register mapped device: first written byte sets the pointer
+struct twi_sim_memory {
+	unsigned char data[256];
+	unsigned char ptr;
+	unsigned char first; // 1 until the pointer byte of a write arrived
+	unsigned char writes; // Data bytes stored by the master
+	unsigned char written; // Data bytes stored in this transaction
+	double writeCycleNs; // Programming time after a write, 0 == none
+	double busyUntilNs; // Bus time the programming ends
+};
+
+// Wii nunchuck
+struct twi_sim_nunchuck {
+	unsigned char sample[6]; // Live sensor values in the 6 byte report format
+	unsigned char report[6]; // Report latched by the last 0x00 conversion request
+	unsigned char ptr;
+	unsigned char reg; // Register of the write in progress
+	unsigned char count; // Bytes of the write in progress
+	unsigned char initialized;
+	unsigned char encrypted;
+	unsigned char unlock; // 1 after 0xF0 = 0x55, waiting for 0xFB = 0x00
+};
+
+//**************************USER AREA***************************
+
+/** Reset the bus, registers, injections and time and detach all slaves.
+ */
+void twiSim_reset();
+
+/** @param slave	Slave model to put on the bus, must stay valid
+ *  @return			1 on success, 0 if the bus is full
+ */
+unsigned char twiSim_attach(struct twi_sim_slave *slave);
+
+/** Fill in a slave for a register mapped memory model.
+ */
+void twiSim_memoryInit(struct twi_sim_slave *slave, struct twi_sim_memory *memory, unsigned char address);
+
+/** Fill in a slave for a nunchuck model at address 0x52.
+ */
+void twiSim_nunchuckInit(struct twi_sim_slave *slave, struct twi_sim_nunchuck *nunchuck);
+
+/** Set the nunchuck's sensor values, as a real one would measure them.
+ *  @param joyX, joyY		Joystick [0, 255]
+ *  @param accelX/Y/Z		Accelerometer [0, 1023]
+ *  @param btnC, btnZ		1 == pressed
+ */
+void twiSim_nunchuckSet(struct twi_sim_nunchuck *nunchuck, unsigned char joyX, unsigned char joyY,
+	unsigned short accelX, unsigned short accelY, unsigned short accelZ,
+	unsigned char btnC, unsigned char btnZ);
+
+/** NACK the next count address phases for an address.
+ */
+void twiSim_nackNextAddress(unsigned char address, unsigned char count);
+
+/** NACK the next count data bytes written by the master.
+ */
+void twiSim_nackNextData(unsigned char count);
+
+/** Report a bus error (status 0x00) instead of the result of the steps-th bus operation from now.
+ */
+void twiSim_busErrorAfter(unsigned short steps);
+
+/** @param verbose	1 to print every bus step
+ */
+void twiSim_setVerbose(unsigned char verbose);
+
+/** Add time to the bus clock (used by the _delay_ stand-ins).
+ */
+void twiSim_advanceNs(double ns);
+
+//****************************END USER AREA**************************************
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+double twiSim_busNs = 0; // Simulated bus time so far
+double twiSim_lastTransactionNs = 0; // START to STOP of the last finished transaction
+unsigned long twiSim_transactions = 0; // Finished transactions
+
+static unsigned char twiSim_regs[TWI_SIM_REG_COUNT];
+static struct twi_sim_slave *twiSim_slaves[TWI_SIM_MAX_SLAVES];
+static unsigned char twiSim_slaveCount = 0;
+static struct twi_sim_slave *twiSim_current = 0; // Slave addressed in this transaction
+static unsigned char twiSim_owner = 0; // 1 between START and STOP
+static unsigned char twiSim_expectAddress = 0; // 1 right after a (repeated) START
+static unsigned char twiSim_reading = 0;
+static double twiSim_startNs = 0;
+static unsigned char twiSim_nackAddress = 0;
+static unsigned char twiSim_nackAddressCount = 0;
+static unsigned char twiSim_nackDataCount = 0;
+static unsigned short twiSim_busErrorSteps = 0;
+static unsigned long twiSim_polls = 0;
+static unsigned char twiSim_verbose = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+void twiSim_advanceNs(double ns) {
+	twiSim_busNs += ns;
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function.  One SCL period at the current rate. */
+double twiSim_sclNs() {
+	unsigned char twps = twiSim_regs[TWI_SIM_TWSR] & 0x03;
+
+	return 1e9 * (16.0 + 2.0 * twiSim_regs[TWI_SIM_TWBR] * (1 << (2 * twps))) / F_CPU;
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function. */
+void twiSim_log(const char *what, unsigned char data) {
+	if(twiSim_verbose)
+		printf("  [twi %10.1f us] %-12s 0x%02X -> status 0x%02X\n", twiSim_busNs / 1000.0, what, data,
+			twiSim_regs[TWI_SIM_TWSR] & 0xF8);
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function.  Finishes a bus operation with status. */
+void twiSim_complete(unsigned char status) {
+	twiSim_regs[TWI_SIM_TWSR] = (twiSim_regs[TWI_SIM_TWSR] & 0x03) | status;
+	twiSim_regs[TWI_SIM_TWCR] |= (1 << TWINT);
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function. */
+struct twi_sim_slave *twiSim_find(unsigned char address) {
+	unsigned char i;
+
+	for(i = 0; i < twiSim_slaveCount; ++i) {
+		if(twiSim_slaves[i]->address == address)
+			return twiSim_slaves[i];
+	}
+	return 0;
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function. */
+void twiSim_stop() {
+	twiSim_busNs += twiSim_sclNs();
+	if(twiSim_current && twiSim_current->stop)
+		twiSim_current->stop(twiSim_current->model);
+	twiSim_current = 0;
+	twiSim_owner = 0;
+	twiSim_lastTransactionNs = twiSim_busNs - twiSim_startNs;
+	++twiSim_transactions;
+	if(twiSim_verbose)
+		printf("  [twi %10.1f us] STOP         transaction took %.1f us\n", twiSim_busNs / 1000.0,
+			twiSim_lastTransactionNs / 1000.0);
+}
+
+/* This function is designed to be used by the simulator
+ * only and is not intended to be used as a stand alone
+ * library function.  Runs the operation requested by a
+ * TWCR write with TWINT set. */
+void twiSim_operate(unsigned char twcr) {
+	unsigned char data = twiSim_regs[TWI_SIM_TWDR];
+	unsigned char ack, address;
+
+	if(twiSim_busErrorSteps && !--twiSim_busErrorSteps) {
+		twiSim_current = 0;
+		twiSim_owner = 0;
+		twiSim_complete(0x00);
+		twiSim_log("BUS ERROR", 0);
+		return;
+	}
+
+	if(twcr & (1 << TWSTO)) {
+		if(twiSim_owner)
+			twiSim_stop();
+		twiSim_regs[TWI_SIM_TWSR] = (twiSim_regs[TWI_SIM_TWSR] & 0x03) | 0xF8;
+		twiSim_regs[TWI_SIM_TWCR] &= ~(1 << TWSTO);
+		if(!(twcr & (1 << TWSTA)))
+			return; // STOP alone does not set TWINT
+	}
+
+	if(twcr & (1 << TWSTA)) {
+		if(!twiSim_owner)
+			twiSim_startNs = twiSim_busNs;
+		twiSim_busNs += twiSim_sclNs();
+		twiSim_complete(twiSim_owner ? 0x10 : 0x08);
+		twiSim_log(twiSim_owner ? "RESTART" : "START", 0);
+		twiSim_owner = 1;
+		twiSim_expectAddress = 1;
+		return;
+	}
+
+	if(!twiSim_owner) {
+		// Slave mode is not simulated: nothing will ever happen
+		twiSim_regs[TWI_SIM_TWSR] = (twiSim_regs[TWI_SIM_TWSR] & 0x03) | 0xF8;
+		return;
+	}
+
+	twiSim_busNs += 9 * twiSim_sclNs();
+	if(twiSim_expectAddress) {
+		twiSim_expectAddress = 0;
+		address = data >> 1;
+		twiSim_reading = data & 0x01;
+		twiSim_current = twiSim_find(address);
+		if(twiSim_current && twiSim_nackAddressCount && twiSim_nackAddress == address) {
+			--twiSim_nackAddressCount;
+			twiSim_current = 0;
+		}
+		if(twiSim_current && !twiSim_current->start(twiSim_current->model, twiSim_reading))
+			twiSim_current = 0;
+		if(twiSim_current)
+			twiSim_busNs += twiSim_current->stretchNs;
+		if(twiSim_reading)
+			twiSim_complete(twiSim_current ? 0x40 : 0x48);
+		else
+			twiSim_complete(twiSim_current ? 0x18 : 0x20);
+		twiSim_log(twiSim_reading ? "SLA+R" : "SLA+W", data);
+	}
+	else if(!twiSim_reading) {
+		ack = twiSim_current && twiSim_current->write(twiSim_current->model, data);
+		if(twiSim_nackDataCount) {
+			--twiSim_nackDataCount;
+			ack = 0;
+		}
+		if(twiSim_current)
+			twiSim_busNs += twiSim_current->stretchNs;
+		twiSim_complete(ack ? 0x28 : 0x30);
+		twiSim_log("write", data);
+	}
+	else {
+		// Nobody drives SDA for a slave that went away, so the master reads 0xFF
+		twiSim_regs[TWI_SIM_TWDR] = twiSim_current ? twiSim_current->read(twiSim_current->model) : 0xFF;
+		if(twiSim_current)
+			twiSim_busNs += twiSim_current->stretchNs;
+		twiSim_complete((twcr & (1 << TWEA)) ? 0x50 : 0x58);
+		twiSim_log("read", twiSim_regs[TWI_SIM_TWDR]);
+	}
+}
+
+unsigned char twiSim_readReg(unsigned char reg) {
+	if(reg == TWI_SIM_TWCR && !(twiSim_regs[TWI_SIM_TWCR] & (1 << TWINT))) {
+		if(++twiSim_polls > TWI_SIM_POLL_LIMIT) {
+			fprintf(stderr, "twi_sim: driver waits for TWINT but no operation is running (status 0x%02X)\n",
+				twiSim_regs[TWI_SIM_TWSR] & 0xF8);
+			exit(2);
+		}
+	}
+	else
+		twiSim_polls = 0;
+	return twiSim_regs[reg];
+}
+
+void twiSim_writeReg(unsigned char reg, unsigned char value) {
+	if(reg == TWI_SIM_TWSR) {
+		// Only the prescaler bits can be written
+		twiSim_regs[reg] = (twiSim_regs[reg] & 0xF8) | (value & 0x03);
+	}
+	else if(reg == TWI_SIM_TWDR) {
+		if(twiSim_regs[TWI_SIM_TWCR] & (1 << TWINT))
+			twiSim_regs[reg] = value;
+		else
+			twiSim_regs[TWI_SIM_TWCR] |= (1 << TWWC);
+	}
+	else if(reg == TWI_SIM_TWCR) {
+		twiSim_polls = 0;
+		if(!(value & (1 << TWEN))) {
+			twiSim_regs[reg] = value & ~(1 << TWINT);
+			twiSim_current = 0;
+			twiSim_owner = 0;
+			return;
+		}
+		// Writing TWINT clears it and starts the operation; TWWC is read-only
+		twiSim_regs[reg] = (twiSim_regs[reg] & (1 << TWINT)) | (value & ~((1 << TWINT) | (1 << TWWC)));
+		if(value & (1 << TWINT)) {
+			twiSim_regs[reg] &= ~((1 << TWINT) | (1 << TWWC));
+			twiSim_operate(value);
+		}
+	}
+	else
+		twiSim_regs[reg] = value;
+}
+
+void twiSim_reset() {
+	memset(twiSim_regs, 0, sizeof(twiSim_regs));
+	twiSim_regs[TWI_SIM_TWSR] = 0xF8;
+	twiSim_regs[TWI_SIM_TWDR] = 0xFF;
+	twiSim_slaveCount = 0;
+	twiSim_current = 0;
+	twiSim_owner = 0;
+	twiSim_expectAddress = 0;
+	twiSim_nackAddressCount = 0;
+	twiSim_nackDataCount = 0;
+	twiSim_busErrorSteps = 0;
+	twiSim_polls = 0;
+	twiSim_busNs = 0;
+	twiSim_lastTransactionNs = 0;
+	twiSim_transactions = 0;
+}
+
+unsigned char twiSim_attach(struct twi_sim_slave *slave) {
+	if(twiSim_slaveCount >= TWI_SIM_MAX_SLAVES)
+		return 0;
+	twiSim_slaves[twiSim_slaveCount++] = slave;
+	return 1;
+}
+
+void twiSim_nackNextAddress(unsigned char address, unsigned char count) {
+	twiSim_nackAddress = address;
+	twiSim_nackAddressCount = count;
+}
+
+void twiSim_nackNextData(unsigned char count) {
+	twiSim_nackDataCount = count;
+}
+
+void twiSim_busErrorAfter(unsigned short steps) {
+	twiSim_busErrorSteps = steps;
+}
+
+void twiSim_setVerbose(unsigned char verbose) {
+	twiSim_verbose = verbose;
+}
+
+/* The functions below implement the slave models and are
+ * not intended to be called directly. */
+
+unsigned char twiSim_memoryStart(void *model, unsigned char read) {
+	struct twi_sim_memory *memory = (struct twi_sim_memory *)model;
+
+	if(twiSim_busNs < memory->busyUntilNs)
+		return 0; // Programming, the address is NACKed
+	if(!read)
+		memory->first = 1;
+	return 1;
+}
+
+unsigned char twiSim_memoryWrite(void *model, unsigned char data) {
+	struct twi_sim_memory *memory = (struct twi_sim_memory *)model;
+
+	if(memory->first) {
+		memory->first = 0;
+		memory->ptr = data;
+	}
+	else {
+		memory->data[memory->ptr++] = data;
+		++memory->writes;
+		memory->written = 1;
+	}
+	return 1;
+}
+
+unsigned char twiSim_memoryRead(void *model) {
+	struct twi_sim_memory *memory = (struct twi_sim_memory *)model;
+
+	return memory->data[memory->ptr++];
+}
+
+void twiSim_memoryStop(void *model) {
+	struct twi_sim_memory *memory = (struct twi_sim_memory *)model;
+
+	if(memory->written)
+		memory->busyUntilNs = twiSim_busNs + memory->writeCycleNs;
+	memory->written = 0;
+}
+
+void twiSim_memoryInit(struct twi_sim_slave *slave, struct twi_sim_memory *memory, unsigned char address) {
+	memset(memory, 0, sizeof(*memory));
+	memset(slave, 0, sizeof(*slave));
+	slave->address = address;
+	slave->model = memory;
+	slave->start = twiSim_memoryStart;
+	slave->write = twiSim_memoryWrite;
+	slave->read = twiSim_memoryRead;
+	slave->stop = twiSim_memoryStop;
+}
+
+unsigned char twiSim_nunchuckStart(void *model, unsigned char read) {
+	struct twi_sim_nunchuck *nunchuck = (struct twi_sim_nunchuck *)model;
+
+	if(!read)
+		nunchuck->count = 0;
+	return 1;
+}
+
+unsigned char twiSim_nunchuckWrite(void *model, unsigned char data) {
+	struct twi_sim_nunchuck *nunchuck = (struct twi_sim_nunchuck *)model;
+
+	if(nunchuck->count++ == 0) {
+		nunchuck->reg = data;
+		nunchuck->ptr = data;
+		if(data == 0x00 && nunchuck->initialized) // Conversion request
+			memcpy(nunchuck->report, nunchuck->sample, sizeof(nunchuck->report));
+		return 1;
+	}
+
+	if(nunchuck->reg == 0x40 && data == 0x00) {
+		nunchuck->initialized = 1;
+		nunchuck->encrypted = 1;
+	}
+	else if(nunchuck->reg == 0xF0 && data == 0x55) {
+		nunchuck->unlock = 1;
+	}
+	else if(nunchuck->reg == 0xFB && data == 0x00 && nunchuck->unlock) {
+		nunchuck->initialized = 1;
+		nunchuck->encrypted = 0;
+		nunchuck->unlock = 0;
+	}
+	++nunchuck->reg;
+	return 1;
+}
+
+unsigned char twiSim_nunchuckRead(void *model) {
+	struct twi_sim_nunchuck *nunchuck = (struct twi_sim_nunchuck *)model;
+	unsigned char data;
+
+	if(!nunchuck->initialized || nunchuck->ptr >= sizeof(nunchuck->report)) {
+		++nunchuck->ptr;
+		return 0xFF;
+	}
+	data = nunchuck->report[nunchuck->ptr++];
+	// The wii decrypts with (x ^ 0x17) + 0x17
+	return nunchuck->encrypted ? (unsigned char)((data - 0x17) ^ 0x17) : data;
+}
+
+void twiSim_nunchuckInit(struct twi_sim_slave *slave, struct twi_sim_nunchuck *nunchuck) {
+	memset(nunchuck, 0, sizeof(*nunchuck));
+	memset(slave, 0, sizeof(*slave));
+	slave->address = 0x52;
+	slave->model = nunchuck;
+	slave->start = twiSim_nunchuckStart;
+	slave->write = twiSim_nunchuckWrite;
+	slave->read = twiSim_nunchuckRead;
+	twiSim_nunchuckSet(nunchuck, 128, 128, 512, 512, 512, 0, 0);
+}
+
+void twiSim_nunchuckSet(struct twi_sim_nunchuck *nunchuck, unsigned char joyX, unsigned char joyY,
+	unsigned short accelX, unsigned short accelY, unsigned short accelZ,
+	unsigned char btnC, unsigned char btnZ) {
+	nunchuck->sample[0] = joyX;
+	nunchuck->sample[1] = joyY;
+	nunchuck->sample[2] = accelX >> 2;
+	nunchuck->sample[3] = accelY >> 2;
+	nunchuck->sample[4] = accelZ >> 2;
+	// Buttons read 0 when pressed
+	nunchuck->sample[5] = ((accelZ & 0x03) << 6) | ((accelY & 0x03) << 4) | ((accelX & 0x03) << 2) |
+		(btnC ? 0 : 0x02) | (btnZ ? 0 : 0x01);
+}
+
+#endif
@@ -0,0 +1,166 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Runs the Wii nunchuck driver against the simulated nunchuck of
+ * host/twi_sim.h: both init sequences, the two ways of reading a
+ * sample with their bus time, and the error paths.  Also writes
+ * and reads back a simulated EEPROM with the register burst calls.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build and run from the repository root:
+ *			g++ -DF_CPU=8000000UL -Ihost -Icontroller -Isensors \
+ *				-o twi_sim_demo host/twi_sim_demo.cpp
+ *			./twi_sim_demo [-v]
+ *		-v prints every bus step.  The exit code is the number of
+ *		failed checks.
+ */
+
+#include "twi_sim.h"
+#include "wii_nunchuck.h"
+#include "twi_bus.h"
+
+// A 100kHz device on the same bus, declared after the nunchuck as its header would
+#define SLOW_DEVICE_MAX_SCL	TWI_SCL_STANDARD
+#if TWI_BUS_SCL > SLOW_DEVICE_MAX_SCL
+#undef TWI_BUS_SCL
+#define TWI_BUS_SCL SLOW_DEVICE_MAX_SCL
+#endif
+
+// The nunchuck init wants F_CPU named, and the wrong one to refuse
+#if F_CPU == 16000000UL
+#define DEMO_CLOCK	_16MHz
+#define OTHER_CLOCK	_8MHz
+#elif F_CPU == 20000000UL
+#define DEMO_CLOCK	_20MHz
+#define OTHER_CLOCK	_8MHz
+#else
+#define DEMO_CLOCK	_8MHz
+#define OTHER_CLOCK	_16MHz
+#endif
+
+#define EEPROM_ADDRESS	0x50
+
+static int failures = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+void check(int ok, const char *what) {
+	printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok)
+		++failures;
+}
+
+/* twi_solveRate against the twi_rate.h macros for one target. */
+unsigned char checkSolveRate(unsigned long hz) {
+	unsigned char twps, twbr;
+	unsigned long scl;
+
+	scl = twi_solveRate(hz, &twps, &twbr);
+	return scl == TWI_RATE_SCL(hz) && twps == TWI_RATE_TWPS(hz) && twbr == TWI_RATE_TWBR(hz);
+}
+
+/* Put a fresh nunchuck on a fresh bus and bring it up. */
+void setup(struct twi_sim_slave *slave, struct twi_sim_nunchuck *nunchuck, unsigned char nintendo) {
+	twiSim_reset();
+	twiSim_nunchuckInit(slave, nunchuck);
+	twiSim_attach(slave);
+	check(!wii_nunchuck_init_twi(OTHER_CLOCK, WII_NUNCHUCK_5V), "init refuses a clock that is not F_CPU");
+	check(wii_nunchuck_init_twi(DEMO_CLOCK, WII_NUNCHUCK_5V) &&
+		TWBR == TWI_RATE_TWBR(SLOW_DEVICE_MAX_SCL) && (TWSR & 0x03) == TWI_RATE_TWPS(SLOW_DEVICE_MAX_SCL),
+		"bus runs at the rate of the slowest device");
+	check(wii_nunchuck_init(nintendo), nintendo ? "encrypted init (0x40 = 0x00)" :
+		"unencrypted init (0xF0 = 0x55, 0xFB = 0x00)");
+	check(nunchuck->initialized && nunchuck->encrypted == nintendo, "  nunchuck is in the expected mode");
+}
+
+/* Zero the driver on a centred nunchuck, then move it and check the decoded values. */
+void checkSample(struct twi_sim_nunchuck *nunchuck, unsigned char (*read)(), const char *name) {
+	char what[80];
+
+	twiSim_nunchuckSet(nunchuck, 128, 128, 512, 512, 512, 0, 0);
+	read();
+	// calibrate reads without a conversion request, so ask for one first
+	wii_nunchuck_start_read();
+	wii_nunchuck_calibrate();
+	twiSim_nunchuckSet(nunchuck, 200, 50, 700, 301, 902, 1, 0);
+	snprintf(what, sizeof(what), "%s decodes the sample", name);
+	check(read() && wii_nunchuck_get_joyX() == 72 && wii_nunchuck_get_joyY() == -78 &&
+		wii_nunchuck_get_accelX() == 188 && wii_nunchuck_get_accelY() == -211 &&
+		wii_nunchuck_get_accelZ() == 390 && wii_nunchuck_get_btnC() && !wii_nunchuck_get_btnZ(), what);
+}
+
+unsigned char splitRead() {
+	return wii_nunchuck_start_read() && wii_nunchuck_update();
+}
+
+int main(int argc, char **argv) {
+	struct twi_sim_slave slave;
+	struct twi_sim_nunchuck nunchuck;
+	struct twi_sim_slave eepromSlave;
+	struct twi_sim_memory eeprom;
+	unsigned char page[40], readBack[40], i;
+	double splitNs, combinedNs;
+
+	twiSim_setVerbose(argc > 1 && !strcmp(argv[1], "-v"));
+	check(TWI_RATE_TWBR(TWI_SCL_FAST) >= TWI_RATE_MIN_TWBR && TWI_RATE_SCL(TWI_SCL_FAST) <= TWI_SCL_FAST,
+		"fast mode target keeps TWBR at the master mode minimum");
+	check(checkSolveRate(TWI_SCL_FAST) && checkSolveRate(TWI_SCL_STANDARD) && checkSolveRate(1000),
+		"twi_solveRate matches the compile time solver");
+
+	setup(&slave, &nunchuck, 1);
+	checkSample(&nunchuck, splitRead, "start_read + update");
+	checkSample(&nunchuck, wii_nunchuck_read, "wii_nunchuck_read");
+
+	setup(&slave, &nunchuck, 0);
+	checkSample(&nunchuck, splitRead, "unencrypted start_read + update");
+	checkSample(&nunchuck, wii_nunchuck_read, "unencrypted wii_nunchuck_read");
+
+	// Bus time of one sample each way
+	twiSim_busNs = 0;
+	splitRead();
+	splitNs = twiSim_busNs;
+	twiSim_busNs = 0;
+	wii_nunchuck_read();
+	combinedNs = twiSim_busNs;
+	printf("      bus time per sample at %lu Hz: start_read + update %.1f us, wii_nunchuck_read %.1f us\n",
+		(unsigned long)TWI_RATE_SCL(TWI_BUS_SCL), splitNs / 1000.0, combinedNs / 1000.0);
+	check(combinedNs < splitNs, "wii_nunchuck_read takes less bus time");
+
+	// Error injection
+	twiSim_nackNextAddress(WII_NUNCHUCK_ADDRESS, 1);
+	check(!wii_nunchuck_read() && twi_getError() == TWI_ERR_ADDR_NACK, "address NACK is reported");
+	twiSim_nackNextData(1);
+	check(!wii_nunchuck_read() && twi_getError() == TWI_ERR_DATA_NACK, "data NACK is reported");
+	twiSim_busErrorAfter(3);
+	check(!wii_nunchuck_read() && twi_getError() == TWI_ERR_BUS, "bus error is reported");
+	check(wii_nunchuck_read(), "bus works again after the errors");
+
+	// An EEPROM that NACKs its address for 5ms after each page write
+	twiSim_reset();
+	twiSim_memoryInit(&eepromSlave, &eeprom, EEPROM_ADDRESS);
+	eeprom.writeCycleNs = 5e6;
+	twiSim_attach(&eepromSlave);
+	TWI_INIT_BUS();
+	for(i = 0; i < sizeof(page); ++i)
+		page[i] = i * 3 + 1;
+	check(twi_write_regs(EEPROM_ADDRESS, 0x13, page, sizeof(page), 16), "EEPROM write across page boundaries");
+	check(twi_read_regs(EEPROM_ADDRESS, 0x13, readBack, sizeof(readBack)) &&
+		!memcmp(page, readBack, sizeof(page)), "  read right after it returns the data");
+	check(twi_write_regs(EEPROM_ADDRESS, 0x80, page, 8, 16) && twi_write_regs(EEPROM_ADDRESS, 0x88, page, 8, 16),
+		"  back to back single page writes");
+	twiSim_busErrorAfter(7); // START, SLA+W, register, repeated START, SLA+R, one byte, then the error
+	check(!twi_read_regs(EEPROM_ADDRESS, 0x13, readBack, sizeof(readBack)) && twi_getError() == TWI_ERR_BUS,
+		"  bus error in the middle of a burst read is reported");
+
+	// An absent device
+	twiSim_reset();
+	wii_nunchuck_init_twi(DEMO_CLOCK, WII_NUNCHUCK_5V);
+	check(!wii_nunchuck_read() && twi_getError() == TWI_ERR_ADDR_NACK, "missing nunchuck NACKs its address");
+
+	printf("%d check(s) failed\n", failures);
+	return failures;
+}
@@ -0,0 +1,138 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host side decoder for twiTrace_dump output (controller/twi_trace.h).
+ * Prints every TWI step with its time, the time since the previous
+ * step and what it means on the bus, one transaction per block.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+/* USE NOTES:
+ * 1.)	Build with any C compiler:
+ *			gcc -O2 -o twi_trace_decode host/twi_trace_decode.c
+ * 2.)	Capture the USART output of twiTrace_dump to a file (or pipe
+ *		a serial terminal) and feed it on stdin:
+ *			./twi_trace_decode < capture.txt
+ *		Lines that are not trace lines are passed through, so the
+ *		whole session log can be fed in.
+ * 3.)	Without the "#twi" header line times are shown in ticks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pseudo status codes, keep in step with twi_trace.h
+#define TWI_TRACE_STOP		0x01
+#define TWI_TRACE_TIMEOUT	0x02
+#define TWI_TRACE_RECOVER	0x03
+
+// Sequence numbers and stamps are AVR unsigned longs: differences wrap at 32 bits
+#define AVR_ULONG(x)	((unsigned long)(x) & 0xFFFFFFFFUL)
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+/* Describe one step.  Address bytes are split into the 7-bit address
+ * and the direction. */
+void describe(unsigned int status, unsigned int data, char *out, size_t size) {
+	switch(status) {
+		case 0x08: snprintf(out, size, "START"); break;
+		case 0x10: snprintf(out, size, "repeated START"); break;
+		case 0x18: snprintf(out, size, "SLA+W 0x%02X  ACK", data >> 1); break;
+		case 0x20: snprintf(out, size, "SLA+W 0x%02X  NACK  <-- no device", data >> 1); break;
+		case 0x28: snprintf(out, size, "write 0x%02X  ACK", data); break;
+		case 0x30: snprintf(out, size, "write 0x%02X  NACK  <-- refused", data); break;
+		case 0x38: snprintf(out, size, "arbitration lost  <-- other master"); break;
+		case 0x40: snprintf(out, size, "SLA+R 0x%02X  ACK", data >> 1); break;
+		case 0x48: snprintf(out, size, "SLA+R 0x%02X  NACK  <-- no device", data >> 1); break;
+		case 0x50: snprintf(out, size, "read  0x%02X  ACK", data); break;
+		case 0x58: snprintf(out, size, "read  0x%02X  NACK (last byte)", data); break;
+		case 0x60: snprintf(out, size, "slave: own SLA+W 0x%02X", data >> 1); break;
+		case 0x68: snprintf(out, size, "slave: own SLA+W 0x%02X after lost arbitration", data >> 1); break;
+		case 0x70: snprintf(out, size, "slave: general call"); break;
+		case 0x78: snprintf(out, size, "slave: general call after lost arbitration"); break;
+		case 0x80: snprintf(out, size, "slave: received 0x%02X  ACK", data); break;
+		case 0x88: snprintf(out, size, "slave: received 0x%02X  NACK", data); break;
+		case 0x90: snprintf(out, size, "slave: general call data 0x%02X  ACK", data); break;
+		case 0x98: snprintf(out, size, "slave: general call data 0x%02X  NACK", data); break;
+		case 0xA0: snprintf(out, size, "slave: STOP or repeated START"); break;
+		case 0xA8: snprintf(out, size, "slave: own SLA+R 0x%02X", data >> 1); break;
+		case 0xB0: snprintf(out, size, "slave: own SLA+R 0x%02X after lost arbitration", data >> 1); break;
+		case 0xB8: snprintf(out, size, "slave: sent 0x%02X  ACK", data); break;
+		case 0xC0: snprintf(out, size, "slave: sent 0x%02X  NACK (master done)", data); break;
+		case 0xC8: snprintf(out, size, "slave: last byte sent  ACK"); break;
+		case 0xF8: snprintf(out, size, "no status"); break;
+		case 0x00: snprintf(out, size, "BUS ERROR  <-- illegal START/STOP"); break;
+		case TWI_TRACE_STOP: snprintf(out, size, "STOP"); break;
+		case TWI_TRACE_TIMEOUT: snprintf(out, size, "TIMEOUT  <-- TWSR was 0x%02X", data); break;
+		case TWI_TRACE_RECOVER: snprintf(out, size, "bus recovery, %s", data ? "bus free" : "STILL STUCK"); break;
+		default: snprintf(out, size, "unknown status"); break;
+	}
+}
+
+int main() {
+	char line[256], event[96];
+	unsigned long fcpu = 0, divider = 1, seq, stamp;
+	unsigned long lastSeq = 0, lastStamp = 0, startStamp = 0;
+	unsigned int status, data;
+	int haveLast = 0, inTransaction = 0;
+	double tickUs = 0;
+	const char *unit;
+
+	while(fgets(line, sizeof(line), stdin)) {
+		if(sscanf(line, "#twi %lu %lu", &fcpu, &divider) == 2) {
+			tickUs = fcpu ? 1e6 * divider / fcpu : 0;
+			unit = tickUs ? "us" : "ticks";
+			printf("%8s %12s %12s  %-4s %-4s  %s\n", "step", "time", "delta", "stat", "data", "event");
+			printf("%8s %12s %12s\n", "", unit, unit);
+			haveLast = 0;
+			inTransaction = 0;
+			continue;
+		}
+		if(sscanf(line, "%lu %lu %x %x", &seq, &stamp, &status, &data) != 4) {
+			fputs(line, stdout);
+			continue;
+		}
+
+		if(haveLast && AVR_ULONG(seq - lastSeq) != 1)
+			printf("%8s ... %lu steps lost ...\n", "", AVR_ULONG(seq - lastSeq - 1));
+		if(!inTransaction && (status == 0x08 || status == 0x60 || status == 0x70 || status == 0xA8)) {
+			inTransaction = 1;
+			startStamp = stamp;
+		}
+
+		describe(status, data, event, sizeof(event));
+		if(tickUs) {
+			printf("%8lu %12.3f ", seq, stamp * tickUs);
+			if(haveLast)
+				printf("%12.3f", AVR_ULONG(stamp - lastStamp) * tickUs);
+			else
+				printf("%12s", "");
+		}
+		else {
+			printf("%8lu %12lu ", seq, stamp);
+			if(haveLast)
+				printf("%12lu", AVR_ULONG(stamp - lastStamp));
+			else
+				printf("%12s", "");
+		}
+		printf("  0x%02X 0x%02X  %s\n", status, data, event);
+
+		// A transaction ends with STOP, a slave side STOP or a failure that released the bus
+		if(inTransaction && (status == TWI_TRACE_STOP || status == 0xA0 || status == 0xC0 ||
+			status == 0xC8 || status == 0x38 || status == 0x00 || status == TWI_TRACE_TIMEOUT)) {
+			if(tickUs)
+				printf("%8s transaction took %.3f us\n\n", "", AVR_ULONG(stamp - startStamp) * tickUs);
+			else
+				printf("%8s transaction took %lu ticks\n\n", "", AVR_ULONG(stamp - startStamp));
+			inTransaction = 0;
+		}
+
+		lastSeq = seq;
+		lastStamp = stamp;
+		haveLast = 1;
+	}
+	return 0;
+}
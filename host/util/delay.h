@@ -0,0 +1,19 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Host stand-in for <util/delay.h>: delays advance the simulated
+ * bus time instead of spinning (see host/twi_sim.h).
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+
+void twiSim_advanceNs(double ns);
+
+#define _delay_us(us)	twiSim_advanceNs((us) * 1000.0)
+#define _delay_ms(ms)	twiSim_advanceNs((ms) * 1000000.0)
+
+#endif
@@ -38,6 +38,12 @@
  *		project needs and their CPU clock rate. A lower prescaling
  *		value may result in greater measurement accuracy but may
  *		limit measurements to distances less than 4m.
+ * 7.)	Timer1 is never reset by a measurement.  If timer1 is
+ *		already running (ie. as the clock_utils.h time base) it is
+ *		left running and the echo is timed relative to the free
+ *		running count, so pass the prescaler the timer was started
+ *		with.  Otherwise the timer is started for the measurement
+ *		and stopped again afterwards.
  */
 
 //***********************USER ACCESS AREA*************************
@@ -147,24 +153,27 @@ unsigned short HC_SR04_convertUnits(unsigned short value, double soundSpeed, int
 
 unsigned short HC_SR04_getDistance(unsigned short soundSpeed, int tmrPrescaler, int units) {
 	unsigned short start, end;
+	// Leave a free running timer1 (shared time base) untouched
+	unsigned char tmrRunning = TCCR1B & ((1 << CS10) | (1 << CS11) | (1 << CS12));
 	// Send out sound pulses
 	TIFR = (1 << ICF1); // Clear the timer1 input capture flag
 	setTmr1EdgeTrigger(RISING_EDGE);
-	setTmr1(0); // Start timer at 0
-	setTmr1Prescaler(tmrPrescaler); // Turn on timer
+	if(!tmrRunning)
+		setTmr1Prescaler(tmrPrescaler); // Turn on timer
 	*HC_SR04_PORT |= HC_SR04_TRIG; // Trigger sound pulses
 	_delay_us(HC_SR04_MIN_TRIG_TIME);
 	*HC_SR04_PORT &= ~HC_SR04_TRIG; // Turn off trigger
 	// Listen for echo
 	while(!(TIFR & (1 << ICF1))); // Wait for rising edge
-	start = ICR1; // Get start time of duty cycle
+	start = readTmr1Capture(); // Get start time of duty cycle
 	TIFR = (1 << ICF1); // Clear the input capture flag
 	setTmr1EdgeTrigger(FALLING_EDGE);
 	while(!(TIFR & (1 << ICF1))); // Wait for falling edge
-	end = ICR1; // Get end of duty cycle
-	stopTmr1();
+	end = readTmr1Capture(); // Get end of duty cycle
+	if(!tmrRunning)
+		stopTmr1();
 	
-	end -= start; // Get duty cycle time
+	end -= start; // Get duty cycle time, unsigned math handles a timer wrap
 	return HC_SR04_convertUnits(end, soundSpeed, tmrPrescaler, units);
 }
 
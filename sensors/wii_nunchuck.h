@@ -8,7 +8,21 @@
  * Enjoy!
  */
 
-#include <avr/twi_utils.h>
+#include "twi_utils.h"
+#include "twi_rate.h"
+
+// Fastest SCL the nunchuck handles at 5V and at 3.3V
+#define WII_NUNCHUCK_MAX_SCL		TWI_SCL_FAST
+#define WII_NUNCHUCK_MAX_SCL_3_3V	TWI_SCL_STANDARD
+
+#if TWI_BUS_SCL > WII_NUNCHUCK_MAX_SCL
+#undef TWI_BUS_SCL
+#define TWI_BUS_SCL WII_NUNCHUCK_MAX_SCL
+#endif
+
+// Bus rate at 3.3V: TWI_BUS_SCL, at most WII_NUNCHUCK_MAX_SCL_3_3V
+#define WII_NUNCHUCK_BUS_SCL_3_3V \
+	(TWI_BUS_SCL < WII_NUNCHUCK_MAX_SCL_3_3V ? TWI_BUS_SCL : WII_NUNCHUCK_MAX_SCL_3_3V)
 
 //**************************USER AREA***************************
 
@@ -70,38 +84,55 @@ enum WII_NUNCHUCK_VOLTAGES { WII_NUNCHUCK_5V, WII_NUNCHUCK_3_3V };
 // Expected clock frequency values for TWI communication
 enum WII_NUNCHUCK_CLOCK { _8MHz, _16MHz, _20MHz };
 
-/** Initialize the TWI interface to work with the nunchuck.
- *  @param clockFrequency	WII_NUNCHUCK_BLOCK enum value to indicate the uC clock speed.
+/** Initialize the TWI interface to work with the nunchuck.  The bit rate
+ *  is TWI_BUS_SCL, limited to 100kHz at 3.3V, and is solved from F_CPU at
+ *  compile time (see twi_rate.h).  This is a macro that reads TWI_BUS_SCL
+ *  where the call is written, so call it from your own code after all
+ *  device headers are included and slower devices lower the rate too.
+ *  A rate F_CPU cannot reach fails to compile, as with TWI_INIT_SCL.
+ *  @param clockFrequency	WII_NUNCHUCK_CLOCK enum value, must match F_CPU
  *  @param voltage			WII_NUNCHUCK_VOLTAGES enum value.
  *  @return					1 for successful init, 0 for failed init
  */
-unsigned signed char wii_nunchuck_init_twi(int clockFrequency, int voltage);
+#define wii_nunchuck_init_twi(clockFrequency, voltage) \
+	wii_nunchuck_init_twi_rate((clockFrequency), (voltage), \
+		TWI_RATE_TWPS(TWI_BUS_SCL), TWI_RATE_TWBR_CHECKED(TWI_BUS_SCL), \
+		TWI_RATE_TWPS(WII_NUNCHUCK_BUS_SCL_3_3V), TWI_RATE_TWBR_CHECKED(WII_NUNCHUCK_BUS_SCL_3_3V))
 
 /** Initialize the nunchuck response interpreter so it can properly convert
  *  response values to real values.
  *  @param usingNintendoBrand	Is this a Nintendo manufactured device? 0 == false, all other == true.
  *  @return						1 for successful init, 0 for failed init
  */
-unsigned signed char wii_nunchuck_init(unsigned char usingNintendoBrand);
+unsigned char wii_nunchuck_init(unsigned char usingNintendoBrand);
 
 /** Sends the first read request to the nunchuck. The first
  *  request takes longer than updates.
  *  @return	1 for successful start request sent, 0 for failure
  */
-unsigned signed char wii_nunchuck_start_read();
+unsigned char wii_nunchuck_start_read();
 
 /** Set the controller's current position and orientation as the neutral/0 position.
  *  Give the read process time to complete then retrieve the results using the get methods.
  *  @return	1 for success, 0 for failure
  */
-unsigned signed char wii_nunchuck_calibrate();
+unsigned char wii_nunchuck_calibrate();
 
 /** Initiate another reading after the initial "start" read.
  *  Updates are faster than the initial read. Give the read process
  *  time to complete then retrieve the results using the get methods.
  *  @return	1 for success, 0 for failure
  */
-unsigned signed char wii_nunchuck_update();
+unsigned char wii_nunchuck_update();
+
+/** Request and read a new sample in one bus transaction: the read
+ *  pointer write and the 6 byte read are joined by a repeated START.
+ *  Replaces wii_nunchuck_start_read followed by wii_nunchuck_update.
+ *  Some third party nunchucks need a pause between the two halves;
+ *  keep using the separate calls for those.
+ *  @return	1 for success, 0 for failure
+ */
+unsigned char wii_nunchuck_read();
 
 /** After a read or update, get the joystick X axis position.
  *  Compare against the appropriate JOYX const values above.
@@ -200,30 +231,29 @@ unsigned char wii_nunchuck_decrypt_data(unsigned char data) {
 	return (data ^ WII_NUNCHUCK_DECODE_KEY) + WII_NUNCHUCK_DECODE_KEY;
 }
 
-unsigned char wii_nunchuck_init_twi(int clockFrequency, int voltage) {
+/* This function is designed to be used by the
+ * wii_nunchuck_init_twi macro only and is not intended to
+ * be used as a stand alone library function.  Takes the
+ * TWPS and TWBR values the macro solved for each voltage. */
+unsigned char wii_nunchuck_init_twi_rate(int clockFrequency, int voltage,
+	unsigned char twps5V, unsigned char twbr5V, unsigned char twps3V, unsigned char twbr3V) {
+	static const unsigned long CLOCK_HZ[] = { 8000000UL, 16000000UL, 20000000UL };
+
 	if(voltage != WII_NUNCHUCK_5V && voltage != WII_NUNCHUCK_3_3V)
 		return 0;
-	//static const unsigned long MIN_WII_CLK = 100000; // 100 kHz for 3.3V
-	//static const unsigned long MAX_WII_CLK = 400000; // 400 kHz for 5V
-
-	// How did I come up with these bit rate values? Well they work...
-	if(clockFrequency == _8MHz) {
-		if(voltage == WII_NUNCHUCK_5V)
-			twi_init(TWI_PRESCALER_ONE, 152);
-		else
-			twi_init(TWI_PRESCALER_4TH, 158);
-	} else if(clockFrequency == _16MHz) {
-		if(voltage == WII_NUNCHUCK_5V)
-			twi_init(TWI_PRESCALER_4TH, 76);
-		else
-			twi_init(TWI_PRESCALER_16TH, 79);
-	} else if(clockFrequency == _20MHz) {
-		if(voltage == WII_NUNCHUCK_5V)
-			twi_init(TWI_PRESCALER_4TH, 95);
-		else
-			twi_init(TWI_PRESCALER_64TH, 25);
-	} else {
+	// The rates were solved from F_CPU, so the clock named must be F_CPU
+	if(clockFrequency != _8MHz && clockFrequency != _16MHz && clockFrequency != _20MHz)
 		return 0;
+	if(CLOCK_HZ[clockFrequency] != F_CPU)
+		return 0;
+
+	if(voltage == WII_NUNCHUCK_5V) {
+		TWSR = twps5V;
+		TWBR = twbr5V;
+	}
+	else {
+		TWSR = twps3V;
+		TWBR = twbr3V;
 	}
 
 	return 1;
@@ -341,6 +371,20 @@ unsigned char wii_nunchuck_update() {
 	return 1;
 }
 
+unsigned char wii_nunchuck_read() {
+	unsigned char raw[6];
+	unsigned char i;
+
+	if(!twi_writeRead(WII_NUNCHUCK_ADDRESS, &WII_NUNCHUCK_INIT_READ, 1, raw, 6))
+		return 0;
+	for(i = 0; i < 6; ++i) {
+		if(wii_nunchuck_usingNintendoNunchuck)
+			raw[i] = wii_nunchuck_decrypt_data(raw[i]);
+		wii_nunchuck_data_buf[i] = raw[i];
+	}
+	return 1;
+}
+
 char wii_nunchuck_get_joyX() {
 	return wii_nunchuck_data_buf[0] - wii_nunchuck_0joyX;
 }
@@ -0,0 +1,698 @@
+/* This code is made available for anyone to use but
+ * please leave this header intact.
+ *
+ * Code is designed for use with AVR micro-controllers (MCUs).  This
+ * code was made for the atmega32 MCU but may also work with
+ * other AVR MCUs.
+ *
+ * SD/MMC card raw block driver over SPI with streamed multi-block
+ * writes and a double buffered logger.
+ *
+ * This library was produced by Sean D. Cherbone (scherbone@gmail.com)
+ * Enjoy!
+ */
+
+#ifndef SD_CARD_H
+#define SD_CARD_H
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "spi_utils.h"
+#include "spi_bus.h"
+
+/* USE NOTES:
+ * 1.)	Set up the master with initMasterSPI from spi_utils.h
+ *		first, with allowSlaveSwitch 0, then call sd_init with the
+ *		card's chip select pin and the prescaler to run at once
+ *		it is up.  Initialization runs at SPI_PRESCALER_128TH to
+ *		stay under the 400kHz the cards allow until then.  Cards
+ *		run at up to 25MHz afterwards, so SPI_PRESCALER_HALF is
+ *		fine.  MMC, SD version 1, SD version 2 and SDHC/SDXC cards
+ *		are recognized; blocks are always 512 bytes and addressed
+ *		by block number.
+ * 2.)	Every access takes the spi_bus.h lock, so other devices on
+ *		the bus (and spi_master_async.h queues) can be used
+ *		between card accesses.  Call the sd_ functions from the
+ *		main loop only.
+ * 3.)	Writes return as soon as the card has accepted the data;
+ *		the card then programs it while holding its data line low
+ *		(busy), which can take anything up to 250ms.  The next
+ *		access waits for the card, releasing the bus and calling
+ *		the function set with sd_setYield every SD_YIELD_POLLS
+ *		polls, so other work goes on meanwhile.  sd_isBusy checks
+ *		without waiting.
+ * 4.)	With SD_CRC 1 (default) CRC checking is turned on in the
+ *		card (CMD59), every data block carries its CRC16 and read
+ *		blocks are checked.  This costs about 10 cycles per byte;
+ *		define SD_CRC 0 for the highest rates.  Commands always
+ *		carry their CRC7.
+ * 5.)	For sustained logging stream blocks with sd_writeStart,
+ *		sd_writeNext and sd_writeStop (CMD25): no command per block
+ *		and the card can erase ahead if told how many blocks will
+ *		follow.  If sd_writeNext fails, end the stream with
+ *		sd_writeStop before doing anything else.
+ * 6.)	struct sd_log wraps the stream with two 512 byte buffers:
+ *		sd_logPut fills one (it may be called from an interrupt,
+ *		ie. the ADC) while sd_logService, called from the main
+ *		loop, writes the other once the card is ready.  Data that
+ *		arrives while both buffers are full is counted in dropped.
+ *		sd_logEnd pads the last block with SD_LOG_PAD.  The log
+ *		takes a little over 1KB of RAM.
+ * 7.)	host/sd_sim.h emulates a card backed by an image file so
+ *		the driver can be tested on a PC, see host/sd_sim_demo.cpp.
+ */
+
+#define SD_BLOCK_SIZE 512
+
+#ifndef SD_CRC
+#define SD_CRC 1
+#endif
+
+// Polls of the busy card between calls of the yield function, a power of two
+#ifndef SD_YIELD_POLLS
+#define SD_YIELD_POLLS 64
+#endif
+
+// Polls before giving up on a busy card (about 500ms at 8MHz / 2)
+#ifndef SD_BUSY_POLLS
+#define SD_BUSY_POLLS 250000UL
+#endif
+
+// Polls for the start of a read block (about 100ms at 8MHz / 2)
+#ifndef SD_TOKEN_POLLS
+#define SD_TOKEN_POLLS 50000U
+#endif
+
+// Attempts of the initialization command before giving up (about 2s)
+#ifndef SD_INIT_TRIES
+#define SD_INIT_TRIES 1000
+#endif
+
+// Fills the unused end of the last block written by sd_logEnd
+#ifndef SD_LOG_PAD
+#define SD_LOG_PAD 0x00
+#endif
+
+// Card types, see sd_init
+enum SD_TYPES { SD_TYPE_NONE, SD_TYPE_MMC, SD_TYPE_SD1, SD_TYPE_SD2, SD_TYPE_SDHC };
+
+// Why the last call failed, see sd_getError
+enum SD_ERRORS { SD_OK, SD_ERR_TIMEOUT, SD_ERR_NO_CARD, SD_ERR_VOLTAGE, SD_ERR_INIT,
+	SD_ERR_CMD, SD_ERR_TOKEN, SD_ERR_CRC, SD_ERR_WRITE, SD_ERR_STATE };
+
+// A card, set up with sd_init
+struct sd_card {
+	struct spi_device dev;
+	unsigned char type; // enum SD_TYPES value
+	unsigned char error; // enum SD_ERRORS value of the last failure
+	unsigned char response; // Last R1 or data response from the card
+	unsigned char busy; // 1 while the card may still be programming
+	unsigned char streaming; // 1 between sd_writeStart and sd_writeStop
+};
+
+// Double buffered logger, set up with sd_logBegin
+struct sd_log {
+	struct sd_card *card;
+	unsigned char buf[2][SD_BLOCK_SIZE];
+	unsigned short fill; // Bytes in the buffer being filled
+	volatile unsigned char filling; // Buffer being filled; the other one is written
+	volatile unsigned char pending; // 1 while the other buffer waits for the card
+	unsigned long blocks; // Blocks written
+	unsigned long dropped; // Bytes lost because both buffers were full
+};
+
+//**************************USER AREA***************************
+
+/** Bring a card up in SPI mode.
+ *  @param card			Descriptor to fill in
+ *  @param port			Port of the chip select pin, ie. &PORTB
+ *  @param ddr			Direction register of that port, ie. &DDRB
+ *  @param csMask		Chip select pin mask, ie. (1 << 4)
+ *  @param prescaler	enum SPI_PRESCALERS value to run at after initialization
+ *  @return				1 on success, 0 else (see sd_getError)
+ */
+unsigned char sd_init(struct sd_card *card, volatile unsigned char *port,
+	volatile unsigned char *ddr, unsigned char csMask, unsigned char prescaler);
+
+/** @return	enum SD_ERRORS value of the card's last failure
+ */
+unsigned char sd_getError(const struct sd_card *card);
+
+/** @param yield	Called while waiting for a busy card, with the bus released, or 0
+ */
+void sd_setYield(void (*yield)());
+
+/** @return	1 if the card is still programming, 0 if it is ready (does not wait)
+ */
+unsigned char sd_isBusy(struct sd_card *card);
+
+/** Wait until the card is ready, yielding meanwhile.
+ *  @return	1 when ready, 0 on timeout
+ */
+unsigned char sd_waitReady(struct sd_card *card);
+
+/** Read one block (CMD17).
+ *  @param block	Block number
+ *  @param buf		Receives SD_BLOCK_SIZE bytes
+ *  @return			1 on success, 0 else
+ */
+unsigned char sd_readBlock(struct sd_card *card, unsigned long block, unsigned char *buf);
+
+/** Read consecutive blocks (CMD18).
+ *  @param block	First block number
+ *  @param buf		Receives count * SD_BLOCK_SIZE bytes
+ *  @param count	Number of blocks
+ *  @return			1 on success, 0 else
+ */
+unsigned char sd_readBlocks(struct sd_card *card, unsigned long block, unsigned char *buf,
+	unsigned short count);
+
+/** Write one block (CMD24).  Returns once the card accepted the data.
+ *  @param block	Block number
+ *  @param buf		SD_BLOCK_SIZE bytes
+ *  @return			1 on success, 0 else
+ */
+unsigned char sd_writeBlock(struct sd_card *card, unsigned long block, const unsigned char *buf);
+
+/** Start a multi-block write stream (CMD25).
+ *  @param block	First block number
+ *  @param preErase	Number of blocks that will follow if known (ACMD23), 0 else
+ *  @return			1 on success, 0 else
+ */
+unsigned char sd_writeStart(struct sd_card *card, unsigned long block, unsigned long preErase);
+
+/** Write the next block of the stream.  Returns once the card accepted the data.
+ *  @param buf	SD_BLOCK_SIZE bytes
+ *  @return		1 on success, 0 else
+ */
+unsigned char sd_writeNext(struct sd_card *card, const unsigned char *buf);
+
+/** End the write stream.
+ *  @return	1 on success, 0 else
+ */
+unsigned char sd_writeStop(struct sd_card *card);
+
+/** Start logging to consecutive blocks.
+ *  @param log		Logger to set up
+ *  @param card		Initialized card
+ *  @param block	First block number
+ *  @param preErase	Number of blocks that will be logged if known, 0 else
+ *  @return			1 on success, 0 else
+ */
+unsigned char sd_logBegin(struct sd_log *log, struct sd_card *card, unsigned long block,
+	unsigned long preErase);
+
+/** Append data to the log.  May be called from one interrupt or from the main loop.
+ *  @return	1 if all of it was stored, 0 if some was dropped
+ */
+unsigned char sd_logPut(struct sd_log *log, const unsigned char *data, unsigned short len);
+
+/** Write the full buffer, if there is one and the card is ready.  Call from the main loop.
+ *  @return	1 if a block was written, 0 else
+ */
+unsigned char sd_logService(struct sd_log *log);
+
+/** Write what is left, padding the last block, and end the stream.
+ *  Stop calling sd_logPut first.
+ *  @return	1 on success, 0 else
+ */
+unsigned char sd_logEnd(struct sd_log *log);
+
+/** @return	CRC7 of a command frame, as sent in its last byte's upper 7 bits
+ */
+unsigned char sd_crc7(const unsigned char *data, unsigned char len);
+
+/** @param crc	CRC of the data before, 0 to start
+ *  @return		CRC16 (CCITT, as used by the data blocks) continued over data
+ */
+unsigned short sd_crc16(unsigned short crc, const unsigned char *data, unsigned short len);
+
+//****************************END USER AREA**************************************
+
+// Commands used by the driver
+#define SD_CMD_GO_IDLE			0
+#define SD_CMD_SEND_OP_MMC		1
+#define SD_CMD_SEND_IF_COND		8
+#define SD_CMD_STOP				12
+#define SD_CMD_SET_BLOCKLEN		16
+#define SD_CMD_READ_SINGLE		17
+#define SD_CMD_READ_MULTI		18
+#define SD_CMD_WRITE_SINGLE		24
+#define SD_CMD_WRITE_MULTI		25
+#define SD_CMD_APP				55
+#define SD_CMD_READ_OCR			58
+#define SD_CMD_CRC_ON_OFF		59
+#define SD_ACMD_PRE_ERASE		23
+#define SD_ACMD_SEND_OP_COND	41
+
+// R1 bits and data tokens
+#define SD_R1_IDLE				0x01
+#define SD_R1_ILLEGAL			0x04
+#define SD_TOKEN_SINGLE			0xFE // Starts a read block and a CMD24 write block
+#define SD_TOKEN_MULTI			0xFC // Starts a CMD25 write block
+#define SD_TOKEN_STOP			0xFD // Ends a CMD25 stream
+#define SD_DATA_ACCEPTED		0x05
+#define SD_DATA_CRC_ERROR		0x0B
+
+// GLOBAL VARIABLES FOR LIBRARY FUNCTION ACCESS ONLY
+static void (*sd_yield)() = 0;
+
+//-----------------FUNCTION DEFINITIONS---------------------
+
+unsigned char sd_crc7(const unsigned char *data, unsigned char len) {
+	unsigned char crc = 0, i, bit, d;
+
+	for(i = 0; i < len; ++i) {
+		d = data[i];
+		for(bit = 0; bit < 8; ++bit) {
+			crc <<= 1;
+			if((d ^ crc) & 0x80)
+				crc ^= 0x09;
+			d <<= 1;
+		}
+	}
+	return crc & 0x7F;
+}
+
+unsigned short sd_crc16(unsigned short crc, const unsigned char *data, unsigned short len) {
+	unsigned short i;
+
+	// Byte at a time CCITT update, no table needed
+	for(i = 0; i < len; ++i) {
+		crc = (crc >> 8) | (crc << 8);
+		crc ^= data[i];
+		crc ^= (crc & 0xFF) >> 4;
+		crc ^= crc << 12;
+		crc ^= (crc & 0xFF) << 5;
+	}
+	return crc;
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Takes the bus and
+ * selects the card. */
+void sd_select(struct sd_card *card) {
+	spiBus_acquire(&card->dev);
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Deselects the card and
+ * clocks one more byte so it lets go of its data line. */
+void sd_deselect(struct sd_card *card) {
+	*card->dev.port |= card->dev.csMask;
+	spi_transfer(0xFF);
+	spiBus_unlock();
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned char sd_fail(struct sd_card *card, unsigned char error) {
+	card->error = error;
+	return 0;
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Sends a command to the
+ * selected card.
+ * @return	R1, 0xFF if the card did not answer */
+unsigned char sd_command(struct sd_card *card, unsigned char cmd, unsigned long arg) {
+	unsigned char frame[6], i, r1 = 0xFF;
+
+	frame[0] = 0x40 | cmd;
+	frame[1] = arg >> 24;
+	frame[2] = arg >> 16;
+	frame[3] = arg >> 8;
+	frame[4] = arg;
+	frame[5] = (sd_crc7(frame, 5) << 1) | 0x01;
+	spi_transfer_buf(frame, 0, 6);
+	if(cmd == SD_CMD_STOP)
+		spi_transfer(0xFF); // Stuff byte
+	// The answer comes within 8 bytes
+	for(i = 0; i < 10; ++i) {
+		r1 = spi_transfer(0xFF);
+		if(!(r1 & 0x80))
+			break;
+	}
+	card->response = r1;
+	return r1;
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function. */
+unsigned char sd_appCommand(struct sd_card *card, unsigned char cmd, unsigned long arg) {
+	sd_command(card, SD_CMD_APP, 0);
+	return sd_command(card, cmd, arg);
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Waits for the card,
+ * then selects it. */
+unsigned char sd_begin(struct sd_card *card) {
+	if(!sd_waitReady(card))
+		return 0;
+	sd_select(card);
+	return 1;
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.
+ * @return	Command argument addressing a block */
+unsigned long sd_address(const struct sd_card *card, unsigned long block) {
+	return card->type == SD_TYPE_SDHC ? block : block << 9;
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Receives one data block
+ * from the selected card. */
+unsigned char sd_readData(struct sd_card *card, unsigned char *buf) {
+	unsigned short polls, crc;
+	unsigned char token = 0xFF;
+
+	for(polls = 0; polls < SD_TOKEN_POLLS && token == 0xFF; ++polls)
+		token = spi_transfer(0xFF);
+	if(token != SD_TOKEN_SINGLE) {
+		card->response = token;
+		return sd_fail(card, token == 0xFF ? SD_ERR_TIMEOUT : SD_ERR_TOKEN);
+	}
+	spi_transfer_buf(0, buf, SD_BLOCK_SIZE);
+	crc = spi_transfer(0xFF) << 8;
+	crc |= spi_transfer(0xFF);
+#if SD_CRC
+	if(crc != sd_crc16(0, buf, SD_BLOCK_SIZE))
+		return sd_fail(card, SD_ERR_CRC);
+#endif
+	return 1;
+}
+
+/* This function is designed to be used by the SD
+ * functions only and is not intended to be used as a
+ * stand alone library function.  Sends one data block to
+ * the selected card and leaves it busy. */
+unsigned char sd_writeData(struct sd_card *card, unsigned char token, const unsigned char *buf) {
+	unsigned short crc = 0xFFFF;
+	unsigned char response;
+
+#if SD_CRC
+	crc = sd_crc16(0, buf, SD_BLOCK_SIZE);
+#endif
+	spi_transfer(0xFF);
+	spi_transfer(token);
+	spi_transfer_buf(buf, 0, SD_BLOCK_SIZE);
+	spi_transfer(crc >> 8);
+	spi_transfer(crc);
+	response = spi_transfer(0xFF) & 0x1F;
+	card->response = response;
+	card->busy = 1;
+	if(response != SD_DATA_ACCEPTED)
+		return sd_fail(card, response == SD_DATA_CRC_ERROR ? SD_ERR_CRC : SD_ERR_WRITE);
+	return 1;
+}
+
+unsigned char sd_init(struct sd_card *card, volatile unsigned char *port,
+	volatile unsigned char *ddr, unsigned char csMask, unsigned char prescaler) {
+	unsigned char i, r1, ocr[4];
+	unsigned short tries;
+	unsigned long arg;
+
+	card->type = SD_TYPE_NONE;
+	card->error = SD_OK;
+	card->busy = 0;
+	card->streaming = 0;
+	spiBus_deviceInit(&card->dev, port, ddr, csMask, SPI_MODE0, SPI_MSB_FIRST, SPI_PRESCALER_128TH);
+
+	// At least 74 clocks with the card deselected to wake it up
+	while(!spiBus_tryLock())
+		continue;
+	spiBus_select(&card->dev);
+	for(i = 0; i < 10; ++i)
+		spi_transfer(0xFF);
+	spiBus_unlock();
+
+	sd_select(card);
+	for(i = 0; i < 10; ++i) {
+		if(sd_command(card, SD_CMD_GO_IDLE, 0) == SD_R1_IDLE)
+			break;
+	}
+	if(i == 10) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_NO_CARD);
+	}
+
+	// Version 2 cards echo the check pattern; older ones reject the command
+	card->type = SD_TYPE_SD1;
+	if(!(sd_command(card, SD_CMD_SEND_IF_COND, 0x1AA) & SD_R1_ILLEGAL)) {
+		for(i = 0; i < 4; ++i)
+			ocr[i] = spi_transfer(0xFF);
+		if((ocr[2] & 0x0F) != 0x01 || ocr[3] != 0xAA) {
+			sd_deselect(card);
+			return sd_fail(card, SD_ERR_VOLTAGE);
+		}
+		card->type = SD_TYPE_SD2;
+	}
+#if SD_CRC
+	sd_command(card, SD_CMD_CRC_ON_OFF, 1);
+#endif
+
+	arg = card->type == SD_TYPE_SD2 ? 0x40000000UL : 0; // Announce high capacity support
+	for(tries = 0; tries < SD_INIT_TRIES; ++tries) {
+		r1 = sd_appCommand(card, SD_ACMD_SEND_OP_COND, arg);
+		if(r1 & SD_R1_ILLEGAL && card->type == SD_TYPE_SD1)
+			card->type = SD_TYPE_MMC;
+		if(card->type == SD_TYPE_MMC)
+			r1 = sd_command(card, SD_CMD_SEND_OP_MMC, 0);
+		if(!r1)
+			break;
+	}
+	if(tries == SD_INIT_TRIES) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_INIT);
+	}
+
+	if(card->type == SD_TYPE_SD2) {
+		if(sd_command(card, SD_CMD_READ_OCR, 0)) {
+			sd_deselect(card);
+			return sd_fail(card, SD_ERR_CMD);
+		}
+		for(i = 0; i < 4; ++i)
+			ocr[i] = spi_transfer(0xFF);
+		if(ocr[0] & 0x40)
+			card->type = SD_TYPE_SDHC;
+	}
+	if(card->type != SD_TYPE_SDHC && sd_command(card, SD_CMD_SET_BLOCKLEN, SD_BLOCK_SIZE)) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_CMD);
+	}
+	sd_deselect(card);
+
+	spiBus_deviceInit(&card->dev, port, ddr, csMask, SPI_MODE0, SPI_MSB_FIRST, prescaler);
+	return 1;
+}
+
+unsigned char sd_getError(const struct sd_card *card) {
+	return card->error;
+}
+
+void sd_setYield(void (*yield)()) {
+	sd_yield = yield;
+}
+
+unsigned char sd_isBusy(struct sd_card *card) {
+	if(!card->busy)
+		return 0;
+	sd_select(card);
+	if(spi_transfer(0xFF) == 0xFF)
+		card->busy = 0;
+	sd_deselect(card);
+	return card->busy;
+}
+
+unsigned char sd_waitReady(struct sd_card *card) {
+	unsigned long polls = 0;
+
+	if(!card->busy)
+		return 1;
+	sd_select(card);
+	while(spi_transfer(0xFF) != 0xFF) {
+		if(++polls >= SD_BUSY_POLLS) {
+			sd_deselect(card);
+			return sd_fail(card, SD_ERR_TIMEOUT);
+		}
+		if(sd_yield && !(polls & (SD_YIELD_POLLS - 1))) {
+			// The card keeps programming while deselected
+			sd_deselect(card);
+			sd_yield();
+			sd_select(card);
+		}
+	}
+	card->busy = 0;
+	sd_deselect(card);
+	return 1;
+}
+
+unsigned char sd_readBlock(struct sd_card *card, unsigned long block, unsigned char *buf) {
+	unsigned char ok;
+
+	if(!sd_begin(card))
+		return 0;
+	if(sd_command(card, SD_CMD_READ_SINGLE, sd_address(card, block))) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_CMD);
+	}
+	ok = sd_readData(card, buf);
+	sd_deselect(card);
+	return ok;
+}
+
+unsigned char sd_readBlocks(struct sd_card *card, unsigned long block, unsigned char *buf,
+	unsigned short count) {
+	unsigned char ok = 1;
+
+	if(!count)
+		return 1;
+	if(!sd_begin(card))
+		return 0;
+	if(sd_command(card, SD_CMD_READ_MULTI, sd_address(card, block))) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_CMD);
+	}
+	for(; count && ok; --count, buf += SD_BLOCK_SIZE)
+		ok = sd_readData(card, buf);
+	sd_command(card, SD_CMD_STOP, 0);
+	card->busy = 1;
+	sd_deselect(card);
+	return ok;
+}
+
+unsigned char sd_writeBlock(struct sd_card *card, unsigned long block, const unsigned char *buf) {
+	unsigned char ok;
+
+	if(card->streaming)
+		return sd_fail(card, SD_ERR_STATE);
+	if(!sd_begin(card))
+		return 0;
+	if(sd_command(card, SD_CMD_WRITE_SINGLE, sd_address(card, block))) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_CMD);
+	}
+	ok = sd_writeData(card, SD_TOKEN_SINGLE, buf);
+	sd_deselect(card);
+	return ok;
+}
+
+unsigned char sd_writeStart(struct sd_card *card, unsigned long block, unsigned long preErase) {
+	if(card->streaming)
+		return sd_fail(card, SD_ERR_STATE);
+	if(!sd_begin(card))
+		return 0;
+	if(preErase && card->type != SD_TYPE_MMC)
+		sd_appCommand(card, SD_ACMD_PRE_ERASE, preErase);
+	if(sd_command(card, SD_CMD_WRITE_MULTI, sd_address(card, block))) {
+		sd_deselect(card);
+		return sd_fail(card, SD_ERR_CMD);
+	}
+	card->streaming = 1;
+	sd_deselect(card);
+	return 1;
+}
+
+unsigned char sd_writeNext(struct sd_card *card, const unsigned char *buf) {
+	unsigned char ok;
+
+	if(!card->streaming)
+		return sd_fail(card, SD_ERR_STATE);
+	if(!sd_begin(card))
+		return 0;
+	ok = sd_writeData(card, SD_TOKEN_MULTI, buf);
+	sd_deselect(card);
+	return ok;
+}
+
+unsigned char sd_writeStop(struct sd_card *card) {
+	if(!card->streaming)
+		return sd_fail(card, SD_ERR_STATE);
+	if(!sd_begin(card))
+		return 0;
+	spi_transfer(SD_TOKEN_STOP);
+	spi_transfer(0xFF); // The card turns busy one byte after the token
+	card->streaming = 0;
+	card->busy = 1;
+	sd_deselect(card);
+	return 1;
+}
+
+unsigned char sd_logBegin(struct sd_log *log, struct sd_card *card, unsigned long block,
+	unsigned long preErase) {
+	log->card = card;
+	log->fill = 0;
+	log->filling = 0;
+	log->pending = 0;
+	log->blocks = 0;
+	log->dropped = 0;
+	return sd_writeStart(card, block, preErase);
+}
+
+unsigned char sd_logPut(struct sd_log *log, const unsigned char *data, unsigned short len) {
+	unsigned short n;
+
+	while(len) {
+		if(log->fill == SD_BLOCK_SIZE) {
+			if(log->pending) {
+				log->dropped += len;
+				return 0;
+			}
+			// Hand the full buffer to sd_logService and fill the other one
+			log->filling ^= 1;
+			log->pending = 1;
+			log->fill = 0;
+		}
+		n = SD_BLOCK_SIZE - log->fill;
+		if(n > len)
+			n = len;
+		memcpy(&log->buf[log->filling][log->fill], data, n);
+		log->fill += n;
+		data += n;
+		len -= n;
+	}
+	if(log->fill == SD_BLOCK_SIZE && !log->pending) {
+		log->filling ^= 1;
+		log->pending = 1;
+		log->fill = 0;
+	}
+	return 1;
+}
+
+unsigned char sd_logService(struct sd_log *log) {
+	if(!log->pending || sd_isBusy(log->card))
+		return 0;
+	if(!sd_writeNext(log->card, log->buf[log->filling ^ 1]))
+		return 0;
+	++log->blocks;
+	log->pending = 0;
+	return 1;
+}
+
+unsigned char sd_logEnd(struct sd_log *log) {
+	while(log->pending) {
+		if(!sd_waitReady(log->card) || !sd_logService(log))
+			return 0;
+	}
+	if(log->fill) {
+		memset(&log->buf[log->filling][log->fill], SD_LOG_PAD, SD_BLOCK_SIZE - log->fill);
+		if(!sd_writeNext(log->card, log->buf[log->filling]))
+			return 0;
+		++log->blocks;
+		log->fill = 0;
+	}
+	return sd_writeStop(log->card);
+}
+
+#endif